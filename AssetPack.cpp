@@ -0,0 +1,426 @@
+//
+// AssetPack.cpp
+//
+// One file holding every asset the program loads, cooked offline by the
+// PackCooker into the form it is uploaded in: meshes in their final vertex
+// and element layout, textures decoded with every mipmap level, and the
+// text of the shaders.  At run time the pack is mapped into memory and the
+// buffers and textures are made straight from the mapping.
+//
+// Author:  Jietong Chen
+//
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "AssetPack.h"
+#include "Shapes.h"
+#include "Textures.h"
+
+using namespace std;
+
+// the mapping of the pack, NULL if none is mapped
+static const unsigned char *packBase = NULL;
+static size_t packSize = 0;
+
+// the table of contents, in the mapping
+static const PackEntry *packEntries = NULL;
+static unsigned int packNumEntries = 0;
+
+#if defined(_WIN32) || defined(_WIN64)
+static HANDLE packFile = INVALID_HANDLE_VALUE;
+static HANDLE packMapping = NULL;
+#endif
+
+///
+// Map a file read-only into memory.
+//
+// @param filename - the name of the file
+// @param size     - receives its size
+//
+// @return the mapping, or NULL if the file could not be mapped
+///
+static const unsigned char *mapFile( const char *filename, size_t &size ) {
+#if defined(_WIN32) || defined(_WIN64)
+    packFile = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+
+    if( packFile == INVALID_HANDLE_VALUE ) {
+        return NULL;
+    }
+
+    LARGE_INTEGER length;
+    GetFileSizeEx( packFile, &length );
+    size = size_t( length.QuadPart );
+
+    packMapping = CreateFileMappingA( packFile, NULL, PAGE_READONLY, 0, 0,
+                                      NULL );
+    void *data = packMapping == NULL ? NULL :
+                 MapViewOfFile( packMapping, FILE_MAP_READ, 0, 0, 0 );
+
+    if( data == NULL ) {
+        if( packMapping != NULL ) {
+            CloseHandle( packMapping );
+            packMapping = NULL;
+        }
+        CloseHandle( packFile );
+        packFile = INVALID_HANDLE_VALUE;
+    }
+
+    return (const unsigned char *) data;
+#else
+    int fd = open( filename, O_RDONLY );
+
+    if( fd < 0 ) {
+        return NULL;
+    }
+
+    struct stat info;
+    void *data = MAP_FAILED;
+
+    if( fstat( fd, &info ) == 0 && info.st_size > 0 ) {
+        size = size_t( info.st_size );
+        data = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+
+    // the mapping keeps the file open
+    close( fd );
+
+    if( data == MAP_FAILED ) {
+        return NULL;
+    }
+
+    // the whole pack is read front to back while loading
+    madvise( data, size, MADV_WILLNEED );
+
+    return (const unsigned char *) data;
+#endif
+}
+
+///
+// Unmap a file mapped by mapFile().
+//
+// @param data - the mapping
+// @param size - its size
+///
+static void unmapFile( const unsigned char *data, size_t size ) {
+#if defined(_WIN32) || defined(_WIN64)
+    UnmapViewOfFile( data );
+    CloseHandle( packMapping );
+    CloseHandle( packFile );
+    packMapping = NULL;
+    packFile = INVALID_HANDLE_VALUE;
+#else
+    munmap( (void *) data, size );
+#endif
+}
+
+///
+// Map a pack into memory, so the loaders take their assets from it.
+//
+// @param filename - the name of the pack
+//
+// @return true if the pack was mapped; if not, everything is loaded from
+//         the source files
+///
+bool openAssetPack( const char *filename ) {
+    closeAssetPack();
+
+    size_t size = 0;
+    const unsigned char *data = mapFile( filename, size );
+
+    if( data == NULL ) {
+        return false;
+    }
+
+    PackHeader header;
+    bool valid = size >= sizeof( header );
+
+    if( valid ) {
+        memcpy( &header, data, sizeof( header ) );
+        valid = header.magic == PACK_MAGIC &&
+                header.version == PACK_VERSION &&
+                sizeof( header ) + header.numEntries * sizeof( PackEntry )
+                <= size;
+    }
+
+    const PackEntry *entries = (const PackEntry *) ( data + sizeof( header ) );
+
+    // every entry must lie within the pack
+    for( unsigned int i = 0; valid && i < header.numEntries; i++ ) {
+        valid = entries[ i ].offset <= size &&
+                entries[ i ].size <= size - entries[ i ].offset &&
+                entries[ i ].name[ sizeof( entries[ i ].name ) - 1 ] == '\0';
+    }
+
+    if( !valid ) {
+        cerr << "Asset pack " << filename << " is not valid, ignored" << endl;
+        unmapFile( data, size );
+        return false;
+    }
+
+    packBase = data;
+    packSize = size;
+    packEntries = entries;
+    packNumEntries = header.numEntries;
+
+    return true;
+}
+
+///
+// Unmap the pack, if one is mapped.
+///
+void closeAssetPack( void ) {
+    if( packBase == NULL ) {
+        return;
+    }
+
+    unmapFile( packBase, packSize );
+
+    packBase = NULL;
+    packSize = 0;
+    packEntries = NULL;
+    packNumEntries = 0;
+}
+
+///
+// Is the file an entry was cooked from the same as it was then?
+//
+// @param entry  - the entry
+// @param source - the file, NULL if the asset is made in code
+// @param flags  - the processing the asset would have now
+//
+// @return true if the entry may stand in for the file
+///
+static bool sameSource( const PackEntry &entry, const char *source,
+                        unsigned int flags ) {
+    if( entry.flags != flags ) {
+        return false;
+    }
+
+    if( source == NULL ) {
+        return entry.sourceSize == 0 && entry.sourceTime == 0;
+    }
+
+    struct stat info;
+
+    return stat( source, &info ) == 0 &&
+           (unsigned long long) info.st_size == entry.sourceSize &&
+           (long long) info.st_mtime == entry.sourceTime;
+}
+
+///
+// Find an entry of the pack by binary search of the table of contents.
+//
+// @param name   - the name of the entry
+// @param kind   - the kind it must be
+// @param size   - the smallest size it may have
+// @param source - the file it was cooked from, NULL if made in code
+// @param flags  - the processing the asset would have now
+//
+// @return the entry, or NULL if there is none or its file has changed
+///
+static const PackEntry *findEntry( const string &name, unsigned int kind,
+                                   size_t size, const char *source,
+                                   unsigned int flags = 0 ) {
+    unsigned int lo = 0, hi = packNumEntries;
+
+    while( lo < hi ) {
+        unsigned int mid = ( lo + hi ) / 2;
+        int order = strcmp( packEntries[ mid ].name, name.c_str() );
+
+        if( order == 0 ) {
+            const PackEntry &entry = packEntries[ mid ];
+
+            if( entry.kind != kind || entry.size < size ) {
+                return NULL;
+            }
+
+            if( !sameSource( entry, source, flags ) ) {
+                cout << name << " changed since it was cooked, loading it "
+                     "from its file" << endl;
+                return NULL;
+            }
+
+            return &entry;
+        }
+
+        if( order < 0 ) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+///
+// Make the buffers of a shape from the pack.
+//
+// @param shape - which shape to make
+// @param mesh  - the BufferSet to make the buffers in, not yet made
+//
+// @return true if the shape was in the pack and its layout can be drawn
+///
+bool loadPackedMesh( int shape, BufferSet &mesh ) {
+    if( packBase == NULL || shapeName( shape ) == NULL ) {
+        return false;
+    }
+
+    const PackEntry *entry = findEntry( string( "mesh/" ) + shapeName( shape ),
+                                        PACK_MESH, sizeof( PackMesh ),
+                                        shapeFile( shape ),
+                                        shapeFlags( shape ) );
+
+    if( entry == NULL ) {
+        return false;
+    }
+
+    PackMesh m;
+    memcpy( &m, packBase + entry->offset, sizeof( m ) );
+
+    long long vBytes = m.vSize + m.cSize + m.nSize + m.tSize;
+
+    if( m.vertexData + vBytes > packSize ||
+        m.elementData + m.eSize > packSize ) {
+        return false;
+    }
+
+    if( m.format == VERTEX_PACKED && !packedSupported() ) {
+        return false;
+    }
+
+    mesh.format = m.format;
+    mesh.stride = m.stride;
+    mesh.numVertices = m.numVertices;
+    mesh.numElements = m.numElements;
+    mesh.eType = m.eType;
+    mesh.vSize = long( m.vSize );
+    mesh.cSize = long( m.cSize );
+    mesh.nSize = long( m.nSize );
+    mesh.tSize = long( m.tSize );
+    mesh.eSize = long( m.eSize );
+    mesh.vOffset = long( m.vOffset );
+    mesh.cOffset = long( m.cOffset );
+    mesh.nOffset = long( m.nOffset );
+    mesh.tOffset = long( m.tOffset );
+
+    memcpy( &mesh.decodeMat[0][0], m.decodeMat, sizeof( m.decodeMat ) );
+    mesh.center = glm::vec3( m.center[0], m.center[1], m.center[2] );
+    mesh.extent = glm::vec3( m.extent[0], m.extent[1], m.extent[2] );
+    mesh.radius = m.radius;
+
+    mesh.storeBuffers( packBase + m.vertexData, packBase + m.elementData );
+
+    return true;
+}
+
+///
+// Get the triangles of a shape from the pack, as three corners of XYZ per
+// triangle in object space.
+//
+// @param shape      - which shape to get
+// @param numCorners - receives the number of corners
+//
+// @return the corners, in the mapping, or NULL if they are not in the pack
+///
+const float *packedCorners( int shape, size_t &numCorners ) {
+    if( packBase == NULL || shapeName( shape ) == NULL ) {
+        return NULL;
+    }
+
+    const PackEntry *entry = findEntry( string( "corners/" ) +
+                                        shapeName( shape ), PACK_CORNERS, 0,
+                                        shapeFile( shape ),
+                                        shapeFlags( shape ) );
+
+    if( entry == NULL ) {
+        return NULL;
+    }
+
+    numCorners = size_t( entry->size / ( 3 * sizeof( float ) ) );
+
+    return (const float *) ( packBase + entry->offset );
+}
+
+///
+// Make a texture from the pack, with all of its mipmap levels.
+//
+// @param filename - the name of the image file it was cooked from
+//
+// @return the OpenGL texture handle, 0 if the file is not in the pack
+///
+GLuint loadPackedTexture( const char *filename ) {
+    if( packBase == NULL ) {
+        return 0;
+    }
+
+    const PackEntry *entry = findEntry( filename, PACK_TEXTURE,
+                                        sizeof( PackTexture ), filename );
+
+    if( entry == NULL ) {
+        return 0;
+    }
+
+    PackTexture t;
+    memcpy( &t, packBase + entry->offset, sizeof( t ) );
+
+    if( t.channels < 1 || t.channels > 4 || t.numLevels < 1 ||
+        t.numLevels > PACK_MAX_LEVELS ) {
+        return 0;
+    }
+
+    const unsigned char *levels[ PACK_MAX_LEVELS ];
+    int w = t.width, h = t.height;
+
+    // every level must lie within the pack
+    for( int level = 0; level < t.numLevels; level++ ) {
+        if( t.levelData[ level ] + (unsigned long long) w * h * t.channels >
+            packSize ) {
+            return 0;
+        }
+
+        levels[ level ] = packBase + t.levelData[ level ];
+
+        w = w / 2 > 0 ? w / 2 : 1;
+        h = h / 2 > 0 ? h / 2 : 1;
+    }
+
+    return makeTexture( t.width, t.height, t.channels, t.numLevels, levels );
+}
+
+///
+// Get a copy of the text of a file from the pack.
+//
+// @param filename - the name of the text file
+//
+// @return the text in a dynamically-allocated string buffer, or NULL if
+//         the file is not in the pack
+///
+GLchar *readPackedText( const char *filename ) {
+    if( packBase == NULL ) {
+        return NULL;
+    }
+
+    const PackEntry *entry = findEntry( filename, PACK_TEXT, 0, filename );
+
+    if( entry == NULL ) {
+        return NULL;
+    }
+
+    // the caller owns the text, as with a file read from disk
+    GLchar *content = new GLchar[ entry->size + 1 ];
+    memcpy( content, packBase + entry->offset, size_t( entry->size ) );
+    content[ entry->size ] = '\0';
+
+    return content;
+}
@@ -0,0 +1,177 @@
+//
+// AssetPack.h
+//
+// One file holding every asset the program loads, cooked offline by the
+// PackCooker into the form it is uploaded in: meshes in their final vertex
+// and element layout, textures decoded with every mipmap level, and the
+// text of the shaders.  At run time the pack is mapped into memory and the
+// buffers and textures are made straight from the mapping.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _ASSETPACK_H_
+#define _ASSETPACK_H_
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+#ifndef __APPLE__
+#include <GL/glew.h>
+#endif
+
+#include <GLFW/glfw3.h>
+
+#include "Buffers.h"
+
+// Macros for the kinds of entries in a pack
+#define PACK_MESH    0
+#define PACK_TEXTURE 1
+#define PACK_TEXT    2
+#define PACK_CORNERS 3
+
+// the data of every entry starts on a boundary of this many bytes
+#define PACK_ALIGN 4096
+
+// the most mipmap levels a texture can have
+#define PACK_MAX_LEVELS 16
+
+// "TCPK", the first bytes of every pack
+#define PACK_MAGIC 0x4b504354
+
+// bump whenever the layout of the pack changes
+#define PACK_VERSION 2
+
+///
+// Header of a pack, followed by its table of contents.
+///
+struct PackHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int numEntries;
+    unsigned int reserved;
+};
+
+///
+// One entry of the table of contents, which is sorted by name.
+//
+// The meshes are named "mesh/" and the occluder triangles "corners/"
+// followed by the name of the shape; the textures and shaders by their
+// file names.
+//
+// An entry is used only while the file it was cooked from has the size
+// and modification time it had then, and the processing is the same; if
+// not, the asset is loaded from the file.
+///
+struct PackEntry {
+    char name[56];
+    unsigned int kind;
+
+    // the SHAPE_ flags a shape was processed with, 0 for other kinds
+    unsigned int flags;
+
+    // where the data of the entry is in the pack, and its size in bytes
+    unsigned long long offset;
+    unsigned long long size;
+
+    // the size and modification time of the file it was cooked from, both
+    // 0 if it was made in code
+    unsigned long long sourceSize;
+    long long sourceTime;
+};
+
+///
+// The data of a mesh entry: the layout of a BufferSet, with the vertex and
+// element data following as they are uploaded.
+///
+struct PackMesh {
+    int format;
+    int stride;
+    int numVertices;
+    int numElements;
+    unsigned int eType;
+    unsigned int reserved;
+
+    long long vSize, cSize, nSize, tSize, eSize;
+    long long vOffset, cOffset, nOffset, tOffset;
+
+    float decodeMat[16];
+    float center[3], extent[3];
+    float radius;
+    float pad;
+
+    // where the vertex and element data are in the pack
+    unsigned long long vertexData;
+    unsigned long long elementData;
+};
+
+///
+// The data of a texture entry, with its levels following, largest first,
+// each row bottom up and packed tightly.
+///
+struct PackTexture {
+    int width, height;
+    int channels;
+    int numLevels;
+
+    // where each level is in the pack
+    unsigned long long levelData[ PACK_MAX_LEVELS ];
+};
+
+///
+// Map a pack into memory, so the loaders take their assets from it.
+//
+// @param filename - the name of the pack
+//
+// @return true if the pack was mapped; if not, everything is loaded from
+//         the source files
+///
+bool openAssetPack( const char *filename );
+
+///
+// Unmap the pack, if one is mapped.
+///
+void closeAssetPack( void );
+
+///
+// Make the buffers of a shape from the pack.
+//
+// @param shape - which shape to make
+// @param mesh  - the BufferSet to make the buffers in, not yet made
+//
+// @return true if the shape was in the pack and its layout can be drawn
+///
+bool loadPackedMesh( int shape, BufferSet &mesh );
+
+///
+// Get the triangles of a shape from the pack, as three corners of XYZ per
+// triangle in object space.
+//
+// @param shape      - which shape to get
+// @param numCorners - receives the number of corners
+//
+// @return the corners, in the mapping, or NULL if they are not in the pack
+///
+const float *packedCorners( int shape, size_t &numCorners );
+
+///
+// Make a texture from the pack, with all of its mipmap levels.
+//
+// @param filename - the name of the image file it was cooked from
+//
+// @return the OpenGL texture handle, 0 if the file is not in the pack
+///
+GLuint loadPackedTexture( const char *filename );
+
+///
+// Get a copy of the text of a file from the pack.
+//
+// @param filename - the name of the text file
+//
+// @return the text in a dynamically-allocated string buffer, or NULL if
+//         the file is not in the pack
+///
+GLchar *readPackedText( const char *filename );
+
+#endif
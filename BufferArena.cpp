@@ -0,0 +1,583 @@
+//
+// BufferArena.cpp
+//
+// Large vertex and element buffers shared by the shapes in the scene, each
+// shape holding a range of a page rather than buffers of its own, so the
+// shapes of a page are drawn from one vertex array object.
+//
+// Author:  Jietong Chen
+//
+
+#include <algorithm>
+
+#include "BufferArena.h"
+#include "RenderState.h"
+
+///
+// Constructor
+///
+BuddyAllocator::BuddyAllocator() : usedBytes( 0 ) {
+}
+
+///
+// Start over with every byte free.
+//
+// @param capacity - bytes to manage, ARENA_MIN_BLOCK times a power of two
+///
+void BuddyAllocator::init( GLsizeiptr capacity ) {
+    int maxOrder = 0;
+    while( ( GLsizeiptr( ARENA_MIN_BLOCK ) << maxOrder ) < capacity ) {
+        maxOrder++;
+    }
+
+    freeBlocks.assign( maxOrder + 1, set< GLsizeiptr >() );
+    freeBlocks[ maxOrder ].insert( 0 );
+    usedBlocks.clear();
+    usedBytes = 0;
+}
+
+///
+// Allocate a block.
+//
+// @param size   - bytes needed
+// @param offset - receives the offset of the block
+//
+// @return false if no free block is large enough
+///
+bool BuddyAllocator::allocate( GLsizeiptr size, GLsizeiptr &offset ) {
+    int order = 0;
+    while( ( GLsizeiptr( ARENA_MIN_BLOCK ) << order ) < size ) {
+        order++;
+    }
+
+    // the smallest free block that fits
+    int from = order;
+    while( from < int( freeBlocks.size() ) && freeBlocks[ from ].empty() ) {
+        from++;
+    }
+
+    if( from >= int( freeBlocks.size() ) ) {
+        return false;
+    }
+
+    // the lowest one, keeping the used blocks toward the start
+    offset = *freeBlocks[ from ].begin();
+    freeBlocks[ from ].erase( freeBlocks[ from ].begin() );
+
+    // split it, freeing the upper halves
+    while( from > order ) {
+        from--;
+        freeBlocks[ from ].insert( offset +
+                                   ( GLsizeiptr( ARENA_MIN_BLOCK ) << from ) );
+    }
+
+    usedBlocks[ offset ] = order;
+    usedBytes += GLsizeiptr( ARENA_MIN_BLOCK ) << order;
+
+    return true;
+}
+
+///
+// Free a block, merging it with its free buddies.
+//
+// @param offset - offset of a block returned by allocate()
+///
+void BuddyAllocator::release( GLsizeiptr offset ) {
+    map< GLsizeiptr, int >::iterator it = usedBlocks.find( offset );
+
+    if( it == usedBlocks.end() ) {
+        return;
+    }
+
+    int order = it->second;
+    usedBlocks.erase( it );
+    usedBytes -= GLsizeiptr( ARENA_MIN_BLOCK ) << order;
+
+    // the buddy of a block differs from it in the bit of its size only
+    while( order + 1 < int( freeBlocks.size() ) ) {
+        GLsizeiptr buddy = offset ^ ( GLsizeiptr( ARENA_MIN_BLOCK ) << order );
+        set< GLsizeiptr >::iterator b = freeBlocks[ order ].find( buddy );
+
+        if( b == freeBlocks[ order ].end() ) {
+            break;
+        }
+
+        freeBlocks[ order ].erase( b );
+        offset = min( offset, buddy );
+        order++;
+    }
+
+    freeBlocks[ order ].insert( offset );
+}
+
+///
+// Get the bytes managed.
+//
+// @return the capacity
+///
+GLsizeiptr BuddyAllocator::capacity( void ) const {
+    return freeBlocks.empty() ? 0 :
+           GLsizeiptr( ARENA_MIN_BLOCK ) << ( freeBlocks.size() - 1 );
+}
+
+///
+// Get the bytes in allocated blocks.
+//
+// @return the bytes used, rounded up to whole blocks
+///
+GLsizeiptr BuddyAllocator::used( void ) const {
+    return usedBytes;
+}
+
+///
+// Get the size of the largest free block.
+//
+// @return its bytes, 0 if the allocator is full
+///
+GLsizeiptr BuddyAllocator::largestFree( void ) const {
+    for( int order = int( freeBlocks.size() ) - 1; order >= 0; order-- ) {
+        if( !freeBlocks[ order ].empty() ) {
+            return GLsizeiptr( ARENA_MIN_BLOCK ) << order;
+        }
+    }
+
+    return 0;
+}
+
+///
+// Get the pages of the arena.
+//
+// Never destroyed, since shapes released during static destruction may
+// still reach them.
+//
+// @return the pages, by index
+///
+static vector< ArenaPage > &pages() {
+    static vector< ArenaPage > *arena = new vector< ArenaPage >();
+
+    return *arena;
+}
+
+///
+// Get the capacity of an allocator holding a number of bytes.
+//
+// @param bytes - the bytes to hold
+//
+// @return ARENA_MIN_BLOCK times the smallest power of two holding them
+///
+static GLsizeiptr blockCapacity( GLsizeiptr bytes ) {
+    GLsizeiptr capacity = ARENA_MIN_BLOCK;
+
+    while( capacity < bytes ) {
+        capacity <<= 1;
+    }
+
+    return capacity;
+}
+
+///
+// Make a page, reusing the slot of one no longer in use.
+//
+// @param mesh      - the first shape of the page, giving its layout
+// @param vBytes    - bytes of the vertex buffer
+// @param eBytes    - bytes of the element buffer
+// @param dedicated - whether the page holds this shape only
+//
+// @return the index of the page
+///
+static int makePage( const BufferSet &mesh, GLsizeiptr vBytes,
+                     GLsizeiptr eBytes, bool dedicated ) {
+    vector< ArenaPage > &arena = pages();
+
+    int index = 0;
+    while( index < int( arena.size() ) && arena[ index ].vbuffer != 0 ) {
+        index++;
+    }
+
+    if( index == int( arena.size() ) ) {
+        arena.push_back( ArenaPage() );
+    }
+
+    ArenaPage &page = arena[ index ];
+
+    page.dedicated = dedicated;
+    page.vBytes = vBytes;
+    page.eBytes = eBytes;
+    page.layout = mesh;
+    page.meshes.clear();
+
+    // a dedicated page is sized to its shape, its allocators only round up
+    page.vertices.init( blockCapacity( vBytes ) );
+    page.elements.init( blockCapacity( eBytes ) );
+
+    // the copy target leaves the element buffer of the bound vertex array
+    // object alone
+    page.vbuffer = page.layout.makeBuffer( GL_COPY_WRITE_BUFFER, NULL,
+                                           vBytes );
+    page.ebuffer = page.layout.makeBuffer( GL_COPY_WRITE_BUFFER, NULL,
+                                           eBytes );
+
+    // every shape of the page is read through the same attribute layout,
+    // its vertices found at its base vertex
+    page.layout.page = index;
+
+    glGenVertexArrays( 1, &page.vao );
+    glBindVertexArray( page.vao );
+    page.layout.setUpAttributes();
+    glBindVertexArray( 0 );
+    invalidateState();
+
+    return index;
+}
+
+///
+// Allocate the ranges of a shape in a page.
+//
+// @param page   - the page
+// @param mesh   - the shape
+// @param vBytes - bytes of vertex data
+//
+// @return false if the page has no room for the shape
+///
+static bool allocateRanges( ArenaPage &page, BufferSet &mesh,
+                            GLsizeiptr vBytes ) {
+    // room to round the start up to a whole vertex record
+    GLsizeiptr slack = page.dedicated ? 0 : mesh.stride - 1;
+    GLsizeiptr vFirst, eFirst;
+
+    if( !page.vertices.allocate( vBytes + slack, vFirst ) ) {
+        return false;
+    }
+
+    if( !page.elements.allocate( mesh.eSize, eFirst ) ) {
+        page.vertices.release( vFirst );
+        return false;
+    }
+
+    mesh.vFirst = vFirst;
+    mesh.eFirst = eFirst;
+    mesh.baseVertex = page.dedicated ? 0 :
+                      GLint( ( vFirst + slack ) / mesh.stride );
+
+    return true;
+}
+
+///
+// Can the context draw at a base vertex?
+//
+// @return true if glDrawElementsBaseVertex is available
+///
+bool baseVertexSupported( void ) {
+#ifdef __APPLE__
+    return false;
+#else
+    return GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex;
+#endif
+}
+
+///
+// Store a shape in a page laid out like it, making a page if none has
+// room, and set the page, base vertex and element offset of the shape.
+//
+// @param mesh     - the shape, with its layout, counts and sizes set
+// @param vertices - the vertex data
+// @param vBytes   - bytes of vertex data
+// @param elements - the element data, eSize bytes
+///
+void arenaStore( BufferSet &mesh, const void *vertices, GLsizeiptr vBytes,
+                 const void *elements ) {
+    vector< ArenaPage > &arena = pages();
+
+    // planar arrays place each attribute by the vertex count, so they
+    // cannot share a layout with other shapes
+    bool dedicated = mesh.format != VERTEX_PACKED || !baseVertexSupported();
+
+    mesh.page = -1;
+
+    for( int i = 0; !dedicated && i < int( arena.size() ); i++ ) {
+        ArenaPage &page = arena[ i ];
+
+        if( page.vbuffer != 0 && !page.dedicated &&
+            page.layout.sameLayout( mesh ) &&
+            allocateRanges( page, mesh, vBytes ) ) {
+            mesh.page = i;
+            break;
+        }
+    }
+
+    if( mesh.page < 0 ) {
+        GLsizeiptr vPage = vBytes, ePage = mesh.eSize;
+
+        if( !dedicated ) {
+            vPage = max( GLsizeiptr( ARENA_VERTEX_BYTES ),
+                         blockCapacity( vBytes + mesh.stride ) );
+            ePage = max( GLsizeiptr( ARENA_ELEMENT_BYTES ),
+                         blockCapacity( mesh.eSize ) );
+        }
+
+        mesh.page = makePage( mesh, vPage, ePage, dedicated );
+        allocateRanges( arena[ mesh.page ], mesh, vBytes );
+    }
+
+    ArenaPage &page = arena[ mesh.page ];
+    page.meshes.push_back( &mesh );
+
+    glBindBuffer( GL_COPY_WRITE_BUFFER, page.vbuffer );
+    glBufferSubData( GL_COPY_WRITE_BUFFER,
+                     GLintptr( mesh.baseVertex ) * mesh.stride, vBytes,
+                     vertices );
+
+    glBindBuffer( GL_COPY_WRITE_BUFFER, page.ebuffer );
+    glBufferSubData( GL_COPY_WRITE_BUFFER, mesh.eFirst, mesh.eSize,
+                     elements );
+}
+
+///
+// Order shapes by the size of their vertex data, largest first.
+//
+// @param a - the first shape
+// @param b - the second shape
+//
+// @return true if a goes before b
+///
+static bool largerFirst( const BufferSet *a, const BufferSet *b ) {
+    return GLsizeiptr( a->numVertices ) * a->stride >
+           GLsizeiptr( b->numVertices ) * b->stride;
+}
+
+///
+// Copy ranges of a buffer to new offsets, through a copy of the buffer.
+//
+// @param buffer - the buffer
+// @param size   - bytes of the buffer
+// @param from   - old offset of each range
+// @param to     - new offset of each range
+// @param bytes  - bytes of each range
+///
+static void moveRanges( GLuint buffer, GLsizeiptr size,
+                        const vector< GLintptr > &from,
+                        const vector< GLintptr > &to,
+                        const vector< GLsizeiptr > &bytes ) {
+    GLuint copy;
+    glGenBuffers( 1, &copy );
+
+    glBindBuffer( GL_COPY_WRITE_BUFFER, copy );
+    glBufferData( GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_COPY );
+    glBindBuffer( GL_COPY_READ_BUFFER, buffer );
+    glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                         size );
+
+    // the ranges read from the copy may overlap where they are written
+    glBindBuffer( GL_COPY_READ_BUFFER, copy );
+    glBindBuffer( GL_COPY_WRITE_BUFFER, buffer );
+    for( size_t i = 0; i < from.size(); i++ ) {
+        if( from[ i ] != to[ i ] ) {
+            glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                                 from[ i ], to[ i ], bytes[ i ] );
+        }
+    }
+
+    glDeleteBuffers( 1, &copy );
+}
+
+// bumped whenever a shape leaves a page or defragmentation moves one
+static int generation = 0;
+
+///
+// Move the shapes of a shared page to its start, so its free space is one
+// block again.
+//
+// @param page - the page
+//
+// @return the number of shapes moved
+///
+static int defragmentPage( ArenaPage &page ) {
+    int moved = 0;
+
+    // largest first, a buddy allocator packs blocks without gaps
+    vector< BufferSet * > meshes( page.meshes );
+    sort( meshes.begin(), meshes.end(), largerFirst );
+
+    vector< GLintptr > vFrom, vTo, eFrom, eTo;
+    vector< GLsizeiptr > vBytes, eBytes;
+
+    page.vertices.init( page.vertices.capacity() );
+    page.elements.init( page.elements.capacity() );
+
+    for( size_t m = 0; m < meshes.size(); m++ ) {
+        BufferSet &mesh = *meshes[ m ];
+        GLsizeiptr bytes = GLsizeiptr( mesh.numVertices ) * mesh.stride;
+
+        vFrom.push_back( GLintptr( mesh.baseVertex ) * mesh.stride );
+        eFrom.push_back( mesh.eFirst );
+
+        // the blocks fit, having fit before in a worse order
+        allocateRanges( page, mesh, bytes );
+
+        vTo.push_back( GLintptr( mesh.baseVertex ) * mesh.stride );
+        eTo.push_back( mesh.eFirst );
+        vBytes.push_back( bytes );
+        eBytes.push_back( mesh.eSize );
+
+        if( vFrom.back() != vTo.back() || eFrom.back() != eTo.back() ) {
+            moved++;
+        }
+    }
+
+    if( moved > 0 ) {
+        moveRanges( page.vbuffer, page.vBytes, vFrom, vTo, vBytes );
+        moveRanges( page.ebuffer, page.eBytes, eFrom, eTo, eBytes );
+        invalidateState();
+        generation++;
+    }
+
+    return moved;
+}
+
+///
+// Is the free space of an allocator split up, so packing its blocks at
+// the start would leave a larger free block than it has?
+//
+// Packed largest first, the used blocks fill the start without gaps, and
+// the largest free block is the largest one aligned after them.
+//
+// @param blocks - the allocator
+//
+// @return true if defragmenting would give a larger free block
+///
+static bool fragmented( const BuddyAllocator &blocks ) {
+    GLsizeiptr capacity = blocks.capacity(), used = blocks.used();
+    GLsizeiptr packed = 0;
+
+    for( GLsizeiptr size = ARENA_MIN_BLOCK; size <= capacity; size <<= 1 ) {
+        GLsizeiptr start = ( used + size - 1 ) / size * size;
+
+        if( start + size <= capacity ) {
+            packed = size;
+        }
+    }
+
+    return blocks.largestFree() < packed;
+}
+
+///
+// Free the ranges of a shape, deleting its page once it is empty, and
+// defragmenting it if that would leave a larger free block.
+//
+// @param mesh - a shape stored with arenaStore()
+///
+void arenaRelease( BufferSet &mesh ) {
+    vector< ArenaPage > &arena = pages();
+
+    if( mesh.page < 0 || mesh.page >= int( arena.size() ) ) {
+        return;
+    }
+
+    ArenaPage &page = arena[ mesh.page ];
+
+    page.vertices.release( mesh.vFirst );
+    page.elements.release( mesh.eFirst );
+    page.meshes.erase( remove( page.meshes.begin(), page.meshes.end(),
+                               &mesh ), page.meshes.end() );
+
+    // a shape stored again is at other ranges
+    mesh.page = -1;
+    generation++;
+
+    if( !page.meshes.empty() ) {
+        // close the hole the shape left, if it split up the free space;
+        // never once the context is gone
+        if( !page.dedicated && glfwGetCurrentContext() != NULL &&
+            ( fragmented( page.vertices ) || fragmented( page.elements ) ) ) {
+            defragmentPage( page );
+        }
+
+        return;
+    }
+
+    // the GL objects are gone with the context, if it is gone already
+    if( glfwGetCurrentContext() != NULL ) {
+        glDeleteBuffers( 1, &page.vbuffer );
+        glDeleteBuffers( 1, &page.ebuffer );
+        glDeleteVertexArrays( 1, &page.vao );
+        invalidateState();
+    }
+
+    page.vbuffer = page.ebuffer = page.vao = 0;
+}
+
+///
+// Get a page of the arena.
+//
+// @param page - index of the page
+//
+// @return the page
+///
+const ArenaPage &arenaPage( int page ) {
+    return pages()[ page ];
+}
+
+///
+// Move the shapes of every shared page to its start, so the free space of
+// a page is one block again.
+//
+// @return the number of shapes moved
+///
+int defragmentArena( void ) {
+    vector< ArenaPage > &arena = pages();
+    int moved = 0;
+
+    for( size_t p = 0; p < arena.size(); p++ ) {
+        ArenaPage &page = arena[ p ];
+
+        if( page.vbuffer != 0 && !page.dedicated ) {
+            moved += defragmentPage( page );
+        }
+    }
+
+    return moved;
+}
+
+///
+// Get the number of times shapes have left the arena or been moved in it.
+//
+// @return the count, which changes whenever base vertices and element
+//         offsets recorded from the shapes go stale
+///
+int arenaGeneration( void ) {
+    return generation;
+}
+
+///
+// Get the number of pages in use, and the bytes of their buffers in use
+// and in all.
+//
+// @param numPages - receives the number of pages
+// @param used     - receives the bytes in allocated blocks
+// @param total    - receives the bytes of the buffers
+///
+void arenaUsage( int &numPages, long &used, long &total ) {
+    vector< ArenaPage > &arena = pages();
+
+    numPages = 0;
+    used = total = 0;
+
+    for( size_t p = 0; p < arena.size(); p++ ) {
+        const ArenaPage &page = arena[ p ];
+
+        if( page.vbuffer == 0 ) {
+            continue;
+        }
+
+        numPages++;
+
+        // a dedicated page is sized to its shape, not to its blocks
+        if( page.dedicated ) {
+            used += long( page.vBytes + page.eBytes );
+        } else {
+            used += long( page.vertices.used() + page.elements.used() );
+        }
+
+        total += long( page.vBytes + page.eBytes );
+    }
+}
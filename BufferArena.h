@@ -0,0 +1,190 @@
+//
+// BufferArena.h
+//
+// Large vertex and element buffers shared by the shapes in the scene, each
+// shape holding a range of a page rather than buffers of its own, so the
+// shapes of a page are drawn from one vertex array object.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _BUFFERARENA_H_
+#define _BUFFERARENA_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "Buffers.h"
+
+// bytes of the vertex and the element buffer of a page; larger shapes get
+// a page of their own
+#define ARENA_VERTEX_BYTES  ( 1 << 22 )
+#define ARENA_ELEMENT_BYTES ( 1 << 21 )
+
+// smallest block handed out, in bytes; every block starts at a multiple of
+// its size, so elements are always aligned to their type
+#define ARENA_MIN_BLOCK 256
+
+///
+// Buddy allocator over the bytes of one buffer: blocks are powers of two,
+// split in halves to fit a request and merged with their buddy when freed.
+///
+class BuddyAllocator {
+
+    // free blocks of each order, by offset; a block of order k is
+    // ARENA_MIN_BLOCK << k bytes
+    vector< set< GLsizeiptr > > freeBlocks;
+
+    // order of each allocated block, by offset
+    map< GLsizeiptr, int > usedBlocks;
+
+    // bytes in allocated blocks
+    GLsizeiptr usedBytes;
+
+public:
+
+    ///
+    // Constructor
+    ///
+    BuddyAllocator();
+
+    ///
+    // Start over with every byte free.
+    //
+    // @param capacity - bytes to manage, ARENA_MIN_BLOCK times a power
+    //                   of two
+    ///
+    void init( GLsizeiptr capacity );
+
+    ///
+    // Allocate a block.
+    //
+    // @param size   - bytes needed
+    // @param offset - receives the offset of the block
+    //
+    // @return false if no free block is large enough
+    ///
+    bool allocate( GLsizeiptr size, GLsizeiptr &offset );
+
+    ///
+    // Free a block, merging it with its free buddies.
+    //
+    // @param offset - offset of a block returned by allocate()
+    ///
+    void release( GLsizeiptr offset );
+
+    ///
+    // Get the bytes managed.
+    //
+    // @return the capacity
+    ///
+    GLsizeiptr capacity( void ) const;
+
+    ///
+    // Get the bytes in allocated blocks.
+    //
+    // @return the bytes used, rounded up to whole blocks
+    ///
+    GLsizeiptr used( void ) const;
+
+    ///
+    // Get the size of the largest free block.
+    //
+    // @return its bytes, 0 if the allocator is full
+    ///
+    GLsizeiptr largestFree( void ) const;
+};
+
+///
+// A vertex and an element buffer holding shapes of one vertex layout.
+///
+struct ArenaPage {
+    // the buffers, 0 for a page not in use
+    GLuint vbuffer, ebuffer;
+
+    // bytes of each buffer
+    GLsizeiptr vBytes, eBytes;
+
+    // vertex array object reading both buffers, with the layout below
+    GLuint vao;
+
+    // the page holds one shape only; its layout cannot be drawn at a base
+    // vertex, or the context cannot draw at a base vertex at all
+    bool dedicated;
+
+    // the vertex layout of the shapes of the page
+    BufferSet layout;
+
+    // the blocks of each buffer
+    BuddyAllocator vertices, elements;
+
+    // the shapes held, for defragmentation
+    vector< BufferSet * > meshes;
+};
+
+///
+// Can the context draw at a base vertex?
+//
+// @return true if glDrawElementsBaseVertex is available
+///
+bool baseVertexSupported( void );
+
+///
+// Store a shape in a page laid out like it, making a page if none has
+// room, and set the page, base vertex and element offset of the shape.
+//
+// @param mesh     - the shape, with its layout, counts and sizes set
+// @param vertices - the vertex data
+// @param vBytes   - bytes of vertex data
+// @param elements - the element data, eSize bytes
+///
+void arenaStore( BufferSet &mesh, const void *vertices, GLsizeiptr vBytes,
+                 const void *elements );
+
+///
+// Free the ranges of a shape, deleting its page once it is empty, and
+// defragmenting it if that would leave a larger free block.
+//
+// @param mesh - a shape stored with arenaStore()
+///
+void arenaRelease( BufferSet &mesh );
+
+///
+// Get a page of the arena.
+//
+// @param page - index of the page
+//
+// @return the page
+///
+const ArenaPage &arenaPage( int page );
+
+///
+// Move the shapes of every shared page to its start, so the free space of
+// a page is one block again. The buffers keep their names, but the base
+// vertices and element offsets change, so draws recorded from them (such
+// as indirect commands) must be rebuilt.
+//
+// @return the number of shapes moved
+///
+int defragmentArena( void );
+
+///
+// Get the number of times shapes have left the arena or been moved in it.
+//
+// @return the count, which changes whenever base vertices and element
+//         offsets recorded from the shapes go stale
+///
+int arenaGeneration( void );
+
+///
+// Get the number of pages in use, and the bytes of their buffers in use
+// and in all.
+//
+// @param numPages - receives the number of pages
+// @param used     - receives the bytes in allocated blocks
+// @param total    - receives the bytes of the buffers
+///
+void arenaUsage( int &numPages, long &used, long &total );
+
+#endif
@@ -9,8 +9,12 @@
 //  This file should not be modified by students.
 //
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
@@ -22,8 +26,13 @@
 
 #include <GLFW/glfw3.h>
 
+#include "BufferArena.h"
 #include "Buffers.h"
 #include "Canvas.h"
+#include "ShaderSetup.h"
+
+// How to calculate an offset into the vertex buffer
+#define BUFFER_OFFSET( i ) ((char *)NULL + (i))
 
 ///
 // Constructor
@@ -37,9 +46,18 @@ BufferSet::BufferSet( void ) {
 // initBuffer() - reset the supplied BufferSet to its "empty" state
 ///
 void BufferSet::initBuffer( void ) {
-    vbuffer = ebuffer = 0;
-    numElements = 0;
+    page = -1;
+    vFirst = eFirst = 0;
+    baseVertex = 0;
+    numVertices = numElements = 0;
+    eType = GL_UNSIGNED_INT;
     vSize = eSize = tSize = cSize = nSize = 0;
+    format = VERTEX_PLANAR;
+    stride = 0;
+    vOffset = cOffset = nOffset = tOffset = 0;
+    decodeMat = glm::mat4( 1.0f );
+    center = extent = glm::vec3( 0.0f );
+    radius = 0.0f;
     bufferInit = false;
 }
 
@@ -55,10 +73,17 @@ void BufferSet::dumpBuffer( const char *which ) {
     } else {
         cout << "not initialized)" << endl;
     }
-    cout << "  IDs: v " << vbuffer << " e " << ebuffer <<
-        " #elements: " << numElements << endl;
+    cout << "  Page " << page << ": base vertex " << baseVertex <<
+        " at " << vFirst << ", elements at " << eFirst << endl;
+    cout << "  #vertices: " << numVertices << " #elements: " << numElements <<
+        ( eType == GL_UNSIGNED_SHORT ? " (16-bit)" : " (32-bit)" ) << endl;
     cout << "  Sizes:  v " << vSize << " e " << eSize <<
         " t " << tSize << " c " << cSize << " n " << nSize << endl;
+    if( format == VERTEX_PACKED ) {
+        cout << "  Packed, " << stride << " bytes per vertex" << endl;
+    } else {
+        cout << "  Planar" << endl;
+    }
 }
 
 ///
@@ -82,22 +107,188 @@ GLuint BufferSet::makeBuffer( GLenum target, const void *data,
     return( buffer );
 }
 
+///
+// Convert a float to a half float, rounding to nearest.
+//
+// @param value - the float to convert
+//
+// @return the bits of the half float
+///
+static GLushort packHalf( float value ) {
+    unsigned int bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+
+    GLushort sign = ( bits >> 16 ) & 0x8000;
+    int exponent = int( ( bits >> 23 ) & 0xff ) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    // infinity and NaN
+    if( ( bits & 0x7fffffff ) >= 0x7f800000 ) {
+        return sign | 0x7c00 | ( mantissa != 0 ? 0x200 : 0 );
+    }
+
+    // too large, becomes infinity
+    if( exponent >= 31 ) {
+        return sign | 0x7c00;
+    }
+
+    // too small for a normal half float
+    if( exponent <= 0 ) {
+        if( exponent < -10 ) {
+            return sign;
+        }
+
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        half += ( mantissa >> ( shift - 1 ) ) & 1;
+
+        return sign | half;
+    }
+
+    // a carry out of the mantissa correctly bumps the exponent
+    unsigned int half = ( exponent << 10 ) | ( mantissa >> 13 );
+    half += ( mantissa >> 12 ) & 1;
+
+    return sign | half;
+}
+
+///
+// Pack a normal vector into GL_INT_2_10_10_10_REV, with w = 0.
+//
+// @param n - the x, y and z of the normal
+//
+// @return the packed normal
+///
+static GLuint packNormal( const float *n ) {
+    float length = sqrtf( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+    float scale = length > 0.0f ? 511.0f / length : 0.0f;
+    GLuint packed = 0;
+
+    for( int i = 0; i < 3; i++ ) {
+        int q = int( floorf( n[i] * scale + 0.5f ) );
+        q = max( -511, min( 511, q ) );
+        packed |= ( GLuint( q ) & 0x3ff ) << ( 10 * i );
+    }
+
+    return packed;
+}
+
+///
+// Can the context fetch the attributes of VERTEX_PACKED?
+//
+// @return true if GL_INT_2_10_10_10_REV and half float attributes work
+///
+bool packedSupported( void ) {
+#ifdef __APPLE__
+    return false;
+#else
+    return GLEW_VERSION_3_3 ||
+           ( GLEW_ARB_vertex_type_2_10_10_10_rev &&
+             ( GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex ) );
+#endif
+}
+
 ///
 // createBuffers(buf,canvas) create a set of buffers for the object
 //     currently held in 'canvas'.
 //
-// @param C   - the Canvas we'll use for drawing
+// @param C      - the Canvas we'll use for drawing
+// @param format - the layout of the vertex buffer
 ///
-void BufferSet::createBuffers( Canvas &C ) {
+void BufferSet::createBuffers( Canvas &C, int format ) {
+    // the element list first, as it may index the shape
+    Span<GLuint> elements = C.elementSpan();
+
+    createBuffers( C.vertexSpan(), C.colorSpan(), C.normalSpan(),
+                   C.uvSpan(), elements, format );
+}
+
+///
+// createBuffers(buf,streams) create a set of buffers from the streams
+//     taken out of a Canvas, releasing them once they are uploaded.
+//
+// @param S      - the streams of the shape
+// @param format - the layout of the vertex buffer
+///
+void BufferSet::createBuffers( CanvasStreams &S, int format ) {
+    createBuffers( Span<float>( S.points ), Span<float>( S.colors ),
+                   Span<float>( S.normals ), Span<float>( S.uv ),
+                   Span<GLuint>( S.elements ), format );
+
+    // swap rather than clear, to hand the memory back
+    vector<float>().swap( S.points );
+    vector<float>().swap( S.normals );
+    vector<float>().swap( S.uv );
+    vector<float>().swap( S.colors );
+    vector<GLuint>().swap( S.elements );
+}
+
+///
+// createBuffers(points,colors,normals,uv,elements) create a set of
+//     buffers from views of the streams of a shape.
+//
+// VERTEX_PACKED falls back to VERTEX_PLANAR if the context cannot
+// fetch GL_INT_2_10_10_10_REV or half float attributes.
+//
+// @param points   - vertex locations, XYZW
+// @param colors   - vertex colors, RGBA (may be empty)
+// @param normals  - vertex normals, XYZ (may be empty)
+// @param uv       - vertex (u,v) coordinates (may be empty)
+// @param elements - indices of the vertices of each triangle
+// @param format   - the layout of the vertex buffer
+///
+void BufferSet::createBuffers( Span<float> points, Span<float> colors,
+                               Span<float> normals, Span<float> uv,
+                               Span<GLuint> elements, int format ) {
 
     // first, reset this BufferSet
     if( bufferInit ) {
-        // must delete the existing buffer IDs first
-        glDeleteBuffers( 1, &(vbuffer) );
-        glDeleteBuffers( 1, &(ebuffer) );
+        // must give back the existing ranges first
+        arenaRelease( *this );
         initBuffer();
     }
 
+    if( format == VERTEX_PACKED && !packedSupported() ) {
+        format = VERTEX_PLANAR;
+    }
+
+    vector< GLubyte > data;
+    vector< GLushort > shortElements;
+
+    const void *elementData = layOut( points, colors, normals, uv, elements,
+                                      format, data, shortElements );
+
+    // if there are no vertices, there's nothing for us to do
+    if( elementData == NULL ) {
+        return;
+    }
+
+    storeBuffers( &data[0], elementData );
+}
+
+///
+// layOut(points,colors,normals,uv,elements,format,data,shortElements) -
+//     lay out the vertex and element data of a shape as they are uploaded,
+//     setting the layout, counts, sizes and bounds of this BufferSet but
+//     uploading nothing.
+//
+// @param points        - vertex locations, XYZW
+// @param colors        - vertex colors, RGBA (may be empty)
+// @param normals       - vertex normals, XYZ (may be empty)
+// @param uv            - vertex (u,v) coordinates (may be empty)
+// @param elements      - indices of the vertices of each triangle
+// @param format        - the layout of the vertex buffer
+// @param data          - receives the vertex data
+// @param shortElements - receives the elements, if they fit in 16 bits
+//
+// @return the element data, eSize bytes, or NULL for an empty shape
+///
+const void *BufferSet::layOut( Span<float> points, Span<float> colors,
+                               Span<float> normals, Span<float> uv,
+                               Span<GLuint> elements, int format,
+                               vector< GLubyte > &data,
+                               vector< GLushort > &shortElements ) {
     ///
     // vertex buffer structure
     //
@@ -105,64 +296,221 @@ void BufferSet::createBuffers( Canvas &C ) {
     // other fields may or may not be present; this depends on
     // how the shape was created
     //
+    // VERTEX_PLANAR:
+    //
     //             data        components   offset to beginning
     //          [ locations ]  XYZW         0
     //          [ colors    ]  RGBA         vSize
     //          [ normals   ]  XYZ          vSize+cSize
     //          [ t. coords ]  UV           vSize+cSize+nSize
+    //
+    // VERTEX_PACKED, one record of 'stride' bytes per vertex:
+    //
+    //             data        components   bytes  offset in the record
+    //          [ locations ]  XYZ_         8      vOffset = 0
+    //          [ colors    ]  RGBA         4      cOffset
+    //          [ normals   ]  XYZW         4      nOffset
+    //          [ t. coords ]  UV           4      tOffset
+    //
+    // where each offset is the sum of the sizes of the fields before it
     ///
 
-    // get the vertex count
-    numElements = C.numVertices();
+    // get the vertex and element counts
+    numVertices = points.size / 4;
+    numElements = elements.size;
 
-    // if there are no vertices, there's nothing for us to do
-    if( numElements < 1 ) {
-        return;
+    if( numVertices < 1 || numElements < 1 ) {
+        return NULL;
     }
 
-    // OK, we have vertices!
-    float *points = C.getVertices();
-    // #bytes = number of elements * floats/element * bytes/float
-    vSize = numElements * 4 * sizeof(float);
+    // the bounds, once, for culling the objects drawing the shape
+    findBounds( points.data );
+
+    // the element list first, as its size is needed to find room for it
+    const void *elementData = elements.data;
+
+    if( numVertices <= 65536 ) {
+        // every index fits in 16 bits, halving the element buffer
+        shortElements.assign( elements.data, elements.data + numElements );
+        elementData = &shortElements[0];
+
+        eType = GL_UNSIGNED_SHORT;
+        // #bytes = number of elements * bytes/element
+        eSize = numElements * sizeof(GLushort);
+    } else {
+        eType = GL_UNSIGNED_INT;
+        // #bytes = number of elements * bytes/element
+        eSize = numElements * sizeof(GLuint);
+    }
+
+    // next, the vertex data, containing vertices and "extra" data
+    // the streams are read in place, never copied
+    if( format == VERTEX_PACKED ) {
+        createPacked( points.data, colors.data, normals.data, uv.data, data );
+    } else {
+        createPlanar( points.data, colors.data, normals.data, uv.data, data );
+    }
+
+    return elementData;
+}
+
+///
+// storeBuffers(vertices,elements) - upload the vertex and element data of
+//     a shape, laid out as this BufferSet says.
+//
+// @param vertices - the vertex data, of the sizes set
+// @param elements - the element data, eSize bytes
+///
+void BufferSet::storeBuffers( const void *vertices, const void *elements ) {
+    // both go into a page of the arena laid out like the shape, whose
+    // vertex array object already records the attribute layout
+    arenaStore( *this, vertices, vSize + cSize + nSize + tSize, elements );
+
+    // finally, mark it as set up
+    bufferInit = true;
+}
+
+///
+// findBounds(points) - find the box and sphere bounding the vertices.
+//
+// @param points - vertex locations, XYZW
+///
+void BufferSet::findBounds( const float *points ) {
+    glm::vec3 lo( points[0], points[1], points[2] );
+    glm::vec3 hi = lo;
+
+    for( int i = 1; i < numVertices; i++ ) {
+        glm::vec3 p( points[4*i], points[4*i+1], points[4*i+2] );
+        lo = glm::min( lo, p );
+        hi = glm::max( hi, p );
+    }
+
+    center = ( lo + hi ) * 0.5f;
+    extent = ( hi - lo ) * 0.5f;
+
+    // around the center of the box, so both bound the same point; the
+    // sphere is tighter than the box for round shapes once rotated
+    float r2 = 0.0f;
+    for( int i = 0; i < numVertices; i++ ) {
+        glm::vec3 d = glm::vec3( points[4*i], points[4*i+1], points[4*i+2] ) -
+                      center;
+        r2 = max( r2, glm::dot( d, d ) );
+    }
+
+    radius = sqrtf( r2 );
+}
+
+///
+// setUpAttributes() - point the fixed attribute locations at the
+//     buffers, recording the layout in the bound vertex array object
+///
+void BufferSet::setUpAttributes( void ) {
+    // bind the buffers of the page
+    const ArenaPage &buffers = arenaPage( page );
+
+    glBindBuffer( GL_ARRAY_BUFFER, buffers.vbuffer );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, buffers.ebuffer );
+
+    // the layout of the vertex buffer; planar arrays have stride 0
+    bool packed = format == VERTEX_PACKED;
+
+    glEnableVertexAttribArray( ATTRIB_POSITION );
+    if( packed ) {
+        // normalized over the bounding box, w defaults to 1
+        glVertexAttribPointer( ATTRIB_POSITION, 3, GL_UNSIGNED_SHORT,
+                               GL_TRUE, stride, BUFFER_OFFSET( vOffset ) );
+    } else {
+        glVertexAttribPointer( ATTRIB_POSITION, 4, GL_FLOAT, GL_FALSE,
+                               stride, BUFFER_OFFSET( vOffset ) );
+    }
+
+    if( cSize ) {  // color data
+        glEnableVertexAttribArray( ATTRIB_COLOR );
+        glVertexAttribPointer( ATTRIB_COLOR, 4,
+                               packed ? GL_UNSIGNED_BYTE : GL_FLOAT,
+                               packed, stride, BUFFER_OFFSET( cOffset ) );
+    }
+
+    if( nSize ) {  // normal data
+        glEnableVertexAttribArray( ATTRIB_NORMAL );
+        if( packed ) {
+            glVertexAttribPointer( ATTRIB_NORMAL, 4, GL_INT_2_10_10_10_REV,
+                                   GL_TRUE, stride,
+                                   BUFFER_OFFSET( nOffset ) );
+        } else {
+            glVertexAttribPointer( ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE,
+                                   stride, BUFFER_OFFSET( nOffset ) );
+        }
+    }
+
+    if( tSize ) {  // texture coordinate data
+        glEnableVertexAttribArray( ATTRIB_TEXCOORD );
+        glVertexAttribPointer( ATTRIB_TEXCOORD, 2,
+                               packed ? GL_HALF_FLOAT : GL_FLOAT,
+                               GL_FALSE, stride, BUFFER_OFFSET( tOffset ) );
+    }
+}
+
+///
+// sameLayout(other) - can the vertex records of two shapes be read
+//     through the same attribute layout?
+//
+// @param other - the other shape
+//
+// @return true if their vertex records are laid out alike
+///
+bool BufferSet::sameLayout( const BufferSet &other ) const {
+    return format == other.format && stride == other.stride &&
+           ( cSize != 0 ) == ( other.cSize != 0 ) &&
+           ( nSize != 0 ) == ( other.nSize != 0 ) &&
+           ( tSize != 0 ) == ( other.tSize != 0 ) &&
+           vOffset == other.vOffset && cOffset == other.cOffset &&
+           nOffset == other.nOffset && tOffset == other.tOffset;
+}
+
+///
+// createPlanar(points,colors,normals,uv,data) - lay out VERTEX_PLANAR
+//     vertex data from the arrays of the Canvas.
+//
+// @param points  - vertex locations, XYZW
+// @param colors  - vertex colors, RGBA (or NULL)
+// @param normals - vertex normals, XYZ (or NULL)
+// @param uv      - vertex (u,v) coordinates (or NULL)
+// @param data    - receives the vertex data
+///
+void BufferSet::createPlanar( const float *points, const float *colors,
+                              const float *normals, const float *uv,
+                              vector< GLubyte > &data ) {
+    format = VERTEX_PLANAR;
+    stride = 0;
+
+    // #bytes = number of vertices * floats/vertex * bytes/float
+    vSize = numVertices * 4 * sizeof(float);
 
     // accumulate the total vertex buffer size
     GLsizeiptr vbufSize = vSize;
 
-    // get the color data (if there is any)
-    float *colors = C.getColors();
     if( colors != NULL ) {
-        cSize = numElements * 4 * sizeof(float);
+        cSize = numVertices * 4 * sizeof(float);
         vbufSize += cSize;
     }
 
-    // get the normal data (if there is any)
-    float *normals = C.getNormals();
     if( normals != NULL ) {
-        nSize = numElements * 3 * sizeof(float);
+        nSize = numVertices * 3 * sizeof(float);
         vbufSize += nSize;
     }
 
-    // get the (u,v) data (if there is any)
-    float *uv = C.getUV();
     if( uv != NULL ) {
-        tSize = numElements * 2 * sizeof(float);
+        tSize = numVertices * 2 * sizeof(float);
         vbufSize += tSize;
     }
 
-    // get the element data
-    GLuint *elements = C.getElements();
-    // #bytes = number of elements * bytes/element
-    eSize = numElements * sizeof(GLuint);
-
-    // first, create the connectivity data
-    ebuffer = makeBuffer( GL_ELEMENT_ARRAY_BUFFER, elements, eSize );
-
-    // next, the vertex buffer, containing vertices and "extra" data
-    // note that we use glBufferSubData() calls to do the copying
-    vbuffer = makeBuffer( GL_ARRAY_BUFFER, NULL, vbufSize );
+    // each section is copied in after the ones before it
+    data.resize( vbufSize );
 
     // copy in the location data
-    glBufferSubData( GL_ARRAY_BUFFER, 0, vSize, points );
+    vOffset = 0;
+    memcpy( &data[0], points, vSize );
 
     // offsets to subsequent sections are the sum of
     // the preceding section sizes (in bytes)
@@ -170,19 +518,22 @@ void BufferSet::createBuffers( Canvas &C ) {
 
     // add in the color data (if there is any)
     if( cSize > 0 ) {
-        glBufferSubData( GL_ARRAY_BUFFER, offset, cSize, colors );
+        cOffset = offset;
+        memcpy( &data[offset], colors, cSize );
         offset += cSize;
     }
 
     // add in the normal data (if there is any)
     if( nSize > 0 ) {
-        glBufferSubData( GL_ARRAY_BUFFER, offset, nSize, normals );
+        nOffset = offset;
+        memcpy( &data[offset], normals, nSize );
         offset += nSize;
     }
 
     // add in the (u,v) data (if there is any)
     if( tSize > 0 ) {
-        glBufferSubData( GL_ARRAY_BUFFER, offset, tSize, uv );
+        tOffset = offset;
+        memcpy( &data[offset], uv, tSize );
         offset += tSize;
     }
 
@@ -191,11 +542,103 @@ void BufferSet::createBuffers( Canvas &C ) {
         cerr << "*** selectBuffers: size mismatch, offset " <<
             offset << " vbufSize " << vbufSize << endl;
     }
+}
+
+///
+// createPacked(points,colors,normals,uv,data) - lay out VERTEX_PACKED
+//     vertex data from the arrays of the Canvas.
+//
+// @param points  - vertex locations, XYZW
+// @param colors  - vertex colors, RGBA (or NULL)
+// @param normals - vertex normals, XYZ (or NULL)
+// @param uv      - vertex (u,v) coordinates (or NULL)
+// @param data    - receives the vertex data
+///
+void BufferSet::createPacked( const float *points, const float *colors,
+                              const float *normals, const float *uv,
+                              vector< GLubyte > &data ) {
+    format = VERTEX_PACKED;
+
+    // the bounding box the locations are normalized over
+    glm::vec3 lo( points[0], points[1], points[2] );
+    glm::vec3 hi = lo;
+
+    for( int i = 1; i < numVertices; i++ ) {
+        glm::vec3 p( points[4*i], points[4*i+1], points[4*i+2] );
+        lo = glm::min( lo, p );
+        hi = glm::max( hi, p );
+    }
 
-    // NOTE:  'points', 'colors', etc. are dynamically allocated, but
-    // we don't free them here because they will be freed at the next
-    // call to clear() or the get*() functions
+    glm::vec3 extent = hi - lo;
 
-    // finally, mark it as set up
-    bufferInit = true;
+    for( int k = 0; k < 3; k++ ) {
+        if( extent[k] <= 0.0f ) {
+            // flat along this axis, any scale will do
+            extent[k] = 1.0f;
+        }
+    }
+
+    // location = lo + extent * stored location
+    decodeMat = glm::mat4( 1.0f );
+    for( int k = 0; k < 3; k++ ) {
+        decodeMat[k][k] = extent[k];
+        decodeMat[3][k] = lo[k];
+    }
+
+    // lay out the record, 4 unsigned shorts of location come first
+    vOffset = 0;
+    stride = 4 * sizeof(GLushort);
+    vSize = numVertices * 4 * sizeof(GLushort);
+
+    if( colors != NULL ) {
+        cOffset = stride;
+        stride += 4 * sizeof(GLubyte);
+        cSize = numVertices * 4 * sizeof(GLubyte);
+    }
+
+    if( normals != NULL ) {
+        nOffset = stride;
+        stride += sizeof(GLuint);
+        nSize = numVertices * sizeof(GLuint);
+    }
+
+    if( uv != NULL ) {
+        tOffset = stride;
+        stride += 2 * sizeof(GLushort);
+        tSize = numVertices * 2 * sizeof(GLushort);
+    }
+
+    data.assign( numVertices * stride, 0 );
+
+    for( int i = 0; i < numVertices; i++ ) {
+        GLubyte *record = &data[ i * stride ];
+
+        GLushort location[4] = { 0, 0, 0, 0 };
+        for( int k = 0; k < 3; k++ ) {
+            float t = ( points[4*i+k] - lo[k] ) / extent[k];
+            t = max( 0.0f, min( 1.0f, t ) );
+            location[k] = GLushort( t * 65535.0f + 0.5f );
+        }
+        memcpy( record + vOffset, location, sizeof(location) );
+
+        if( colors != NULL ) {
+            GLubyte color[4];
+            for( int k = 0; k < 4; k++ ) {
+                float c = max( 0.0f, min( 1.0f, colors[4*i+k] ) );
+                color[k] = GLubyte( c * 255.0f + 0.5f );
+            }
+            memcpy( record + cOffset, color, sizeof(color) );
+        }
+
+        if( normals != NULL ) {
+            GLuint normal = packNormal( normals + 3*i );
+            memcpy( record + nOffset, &normal, sizeof(normal) );
+        }
+
+        if( uv != NULL ) {
+            GLushort texCoord[2] = { packHalf( uv[2*i] ),
+                                     packHalf( uv[2*i+1] ) };
+            memcpy( record + tOffset, texCoord, sizeof(texCoord) );
+        }
+    }
 }
@@ -24,6 +24,23 @@ using namespace std;
 
 #include "Canvas.h"
 
+// Layouts of the vertex buffer
+//
+// VERTEX_PLANAR - one float array per attribute, one after the other
+// VERTEX_PACKED - one 16-byte record per vertex, with the location as
+//                 unsigned 16-bit values normalized over the bounding box
+//                 of the shape, the color as unsigned bytes, the normal as
+//                 GL_INT_2_10_10_10_REV and the (u,v) as half floats
+#define VERTEX_PLANAR 0
+#define VERTEX_PACKED 1
+
+///
+// Can the context fetch the attributes of VERTEX_PACKED?
+//
+// @return true if GL_INT_2_10_10_10_REV and half float attributes work
+///
+bool packedSupported( void );
+
 ///
 // All the relevant information needed to keep
 // track of vertex and element buffers
@@ -32,15 +49,48 @@ using namespace std;
 class BufferSet {
 
 public:
-    // buffer handles
-    GLuint vbuffer, ebuffer;
+    // the page of the buffer arena holding the shape, -1 if none; the
+    // page owns the buffers and the vertex array object reading them
+    int page;
+
+    // offsets of the vertex and element blocks in the page (bytes)
+    long vFirst, eFirst;
+
+    // index of the first vertex of the shape among the vertex records of
+    // the page, added to every element when drawing
+    GLint baseVertex;
 
     // total number of vertices
+    int numVertices;
+
+    // total number of elements
     int numElements;
 
+    // type of the elements, GL_UNSIGNED_SHORT when every vertex index
+    // fits in 16 bits, GL_UNSIGNED_INT otherwise
+    GLenum eType;
+
     // component sizes (bytes)
     long vSize, eSize, tSize, cSize, nSize;
 
+    // layout of the vertex buffer, VERTEX_PLANAR or VERTEX_PACKED
+    int format;
+
+    // bytes between consecutive vertices, 0 for tightly packed arrays
+    GLsizei stride;
+
+    // offsets of the components in the vertex buffer (bytes)
+    long vOffset, cOffset, nOffset, tOffset;
+
+    // maps the stored vertex locations back to model space, folded into
+    // the model matrix of the object; identity for VERTEX_PLANAR
+    glm::mat4 decodeMat;
+
+    // bounds of the shape in model space: the center and half size of its
+    // box, and the radius of the sphere around the same center
+    glm::vec3 center, extent;
+    float radius;
+
     // have these already been set up?
     bool bufferInit;
 
@@ -76,11 +126,123 @@ public:
 
     ///
     // createBuffers(buf,canvas) - create a set of buffers for the object
-    //     currently held in 'canvas'.
+    //     currently held in 'canvas'.  The Canvas keeps its shape.
+    //
+    // @param C      - the Canvas we'll use for drawing
+    // @param format - the layout of the vertex buffer
+    ///
+    void createBuffers( Canvas &C, int format = VERTEX_PACKED );
+
+    ///
+    // createBuffers(buf,streams) - create a set of buffers from the streams
+    //     taken out of a Canvas, releasing them once they are uploaded.
+    //
+    // @param S      - the streams of the shape
+    // @param format - the layout of the vertex buffer
+    ///
+    void createBuffers( CanvasStreams &S, int format = VERTEX_PACKED );
+
+    ///
+    // createBuffers(points,colors,normals,uv,elements) - create a set of
+    //     buffers from views of the streams of a shape.
+    //
+    // VERTEX_PACKED falls back to VERTEX_PLANAR if the context cannot
+    // fetch GL_INT_2_10_10_10_REV or half float attributes.
+    //
+    // @param points   - vertex locations, XYZW
+    // @param colors   - vertex colors, RGBA (may be empty)
+    // @param normals  - vertex normals, XYZ (may be empty)
+    // @param uv       - vertex (u,v) coordinates (may be empty)
+    // @param elements - indices of the vertices of each triangle
+    // @param format   - the layout of the vertex buffer
+    ///
+    void createBuffers( Span<float> points, Span<float> colors,
+                        Span<float> normals, Span<float> uv,
+                        Span<GLuint> elements, int format = VERTEX_PACKED );
+
+    ///
+    // layOut(points,colors,normals,uv,elements,format,data,shortElements) -
+    //     lay out the vertex and element data of a shape as they are
+    //     uploaded, setting the layout, counts, sizes and bounds of this
+    //     BufferSet but uploading nothing.
+    //
+    // @param points        - vertex locations, XYZW
+    // @param colors        - vertex colors, RGBA (may be empty)
+    // @param normals       - vertex normals, XYZ (may be empty)
+    // @param uv            - vertex (u,v) coordinates (may be empty)
+    // @param elements      - indices of the vertices of each triangle
+    // @param format        - the layout of the vertex buffer
+    // @param data          - receives the vertex data
+    // @param shortElements - receives the elements, if they fit in 16 bits
+    //
+    // @return the element data, eSize bytes, or NULL for an empty shape
+    ///
+    const void *layOut( Span<float> points, Span<float> colors,
+                        Span<float> normals, Span<float> uv,
+                        Span<GLuint> elements, int format,
+                        vector< GLubyte > &data,
+                        vector< GLushort > &shortElements );
+
+    ///
+    // storeBuffers(vertices,elements) - upload the vertex and element data
+    //     of a shape, laid out as this BufferSet says.
+    //
+    // @param vertices - the vertex data, of the sizes set
+    // @param elements - the element data, eSize bytes
+    ///
+    void storeBuffers( const void *vertices, const void *elements );
+
+    ///
+    // findBounds(points) - find the box and sphere bounding the vertices.
+    //
+    // @param points - vertex locations, XYZW
+    ///
+    void findBounds( const float *points );
+
+    ///
+    // setUpAttributes() - point the fixed attribute locations at the
+    //     buffers of the page, recording the layout in the bound vertex
+    //     array object
+    ///
+    void setUpAttributes( void );
+
+    ///
+    // sameLayout(other) - can the vertex records of two shapes be read
+    //     through the same attribute layout?
+    //
+    // @param other - the other shape
+    //
+    // @return true if their vertex records are laid out alike
+    ///
+    bool sameLayout( const BufferSet &other ) const;
+
+    ///
+    // createPlanar(points,colors,normals,uv,data) - lay out VERTEX_PLANAR
+    //     vertex data from the arrays of the Canvas.
+    //
+    // @param points  - vertex locations, XYZW
+    // @param colors  - vertex colors, RGBA (or NULL)
+    // @param normals - vertex normals, XYZ (or NULL)
+    // @param uv      - vertex (u,v) coordinates (or NULL)
+    // @param data    - receives the vertex data
+    ///
+    void createPlanar( const float *points, const float *colors,
+                       const float *normals, const float *uv,
+                       vector< GLubyte > &data );
+
+    ///
+    // createPacked(points,colors,normals,uv,data) - lay out VERTEX_PACKED
+    //     vertex data from the arrays of the Canvas.
     //
-    // @param C   - the Canvas we'll use for drawing
+    // @param points  - vertex locations, XYZW
+    // @param colors  - vertex colors, RGBA (or NULL)
+    // @param normals - vertex normals, XYZ (or NULL)
+    // @param uv      - vertex (u,v) coordinates (or NULL)
+    // @param data    - receives the vertex data
     ///
-    void createBuffers( Canvas &C );
+    void createPacked( const float *points, const float *colors,
+                       const float *normals, const float *uv,
+                       vector< GLubyte > &data );
 
 };
 
@@ -17,6 +17,12 @@
 // Canvas.h includes all the OpenGL/GLFW/etc. header files for us
 #include "Canvas.h"
 
+#if defined(__SSE__) || defined(_M_X64) || \
+    ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+#include <xmmintrin.h>
+#define CANVAS_SSE
+#endif
+
 ///
 // Constructor
 //
@@ -73,6 +79,7 @@ void Canvas::clear( void )
     normals.clear();
     uv.clear();
     colors.clear();
+    elements.clear();
     numElements = 0;
     currentColor[0] = 0.0f;
     currentColor[1] = 0.0f;
@@ -103,6 +110,14 @@ void Canvas::addTriangle( glm::vec3 p0, glm::vec3 p1, glm::vec3 p2 )
     points.push_back( p2.z );
     points.push_back( 1.0f );
 
+    // an indexed shape needs the new vertices in its element list
+    if( !elements.empty() ) {
+        GLuint first = points.size() / 4 - 3;
+        elements.push_back( first );
+        elements.push_back( first + 1 );
+        elements.push_back( first + 2 );
+    }
+
     numElements += 3;  // three vertices per triangle
 }
 
@@ -187,6 +202,14 @@ void Canvas::addTriangleWithNorms( glm::vec3 p0, glm::vec3 n0,
     normals.push_back( n2.y );
     normals.push_back( n2.z );
 
+    // an indexed shape needs the new vertices in its element list
+    if( !elements.empty() ) {
+        GLuint first = points.size() / 4 - 3;
+        elements.push_back( first );
+        elements.push_back( first + 1 );
+        elements.push_back( first + 2 );
+    }
+
     numElements += 3;  // three vertices per triangle
 }
 
@@ -217,6 +240,147 @@ void Canvas::addTriangleWithNormsUV( glm::vec3 p0, glm::vec3 n0, glm::vec3 uv0,
     uv.push_back( uv2.y );
 }
 
+///
+// computes the (unnormalized) face normal of each triangle of a shape,
+// four floats per vertex in, and the normal of each vertex out
+//
+// @param count number of triangles
+// @param points XYZW of the three vertices of each triangle
+// @param normals XYZ of the three vertices of each triangle
+///
+static void faceNormals( int count, const float *points, float *normals )
+{
+    int i = 0;
+
+#ifdef CANVAS_SSE
+    // one triangle per step, XYZ in the lanes; the last triangle is left
+    // to the scalar loop since each store writes one float past its normal
+    for( ; i < count - 1; i++ ) {
+        const float *p = points + i * 12;
+        float *n = normals + i * 9;
+
+        __m128 p0 = _mm_loadu_ps( p );
+        __m128 u = _mm_sub_ps( _mm_loadu_ps( p + 4 ), p0 );
+        __m128 v = _mm_sub_ps( _mm_loadu_ps( p + 8 ), p0 );
+
+        // u x v = u.yzx * v.zxy - u.zxy * v.yzx
+        __m128 uyzx = _mm_shuffle_ps( u, u, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+        __m128 uzxy = _mm_shuffle_ps( u, u, _MM_SHUFFLE( 3, 1, 0, 2 ) );
+        __m128 vyzx = _mm_shuffle_ps( v, v, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+        __m128 vzxy = _mm_shuffle_ps( v, v, _MM_SHUFFLE( 3, 1, 0, 2 ) );
+        __m128 nn = _mm_sub_ps( _mm_mul_ps( uyzx, vzxy ),
+                                _mm_mul_ps( uzxy, vyzx ) );
+
+        // each store is overwritten past its XYZ by the next one
+        _mm_storeu_ps( n, nn );
+        _mm_storeu_ps( n + 3, nn );
+        _mm_storeu_ps( n + 6, nn );
+    }
+#endif
+
+    for( ; i < count; i++ ) {
+        const float *p = points + i * 12;
+        float *n = normals + i * 9;
+
+        float ux = p[4] - p[0];
+        float uy = p[5] - p[1];
+        float uz = p[6] - p[2];
+
+        float vx = p[8] - p[0];
+        float vy = p[9] - p[1];
+        float vz = p[10] - p[2];
+
+        for( int k = 0; k < 9; k += 3 ) {
+            n[k] = (uy * vz) - (uz * vy);
+            n[k + 1] = (uz * vx) - (ux * vz);
+            n[k + 2] = (ux * vy) - (uy * vx);
+        }
+    }
+}
+
+///
+// reserves room in every stream for more triangles
+//
+// @param count number of triangles about to be added
+// @param withUV will the triangles carry (u,v) data
+///
+void Canvas::reserveTriangles( int count, bool withUV )
+{
+    points.reserve( points.size() + count * 12 );
+    normals.reserve( normals.size() + count * 9 );
+    if( withUV ) {
+        uv.reserve( uv.size() + count * 6 );
+    }
+    if( !elements.empty() ) {
+        elements.reserve( elements.size() + count * 3 );
+    }
+}
+
+///
+// adds triangles to the current shape from indexed attribute arrays
+//
+// @param count number of triangles to add
+// @param vertexData triangle vertices
+// @param vIndices indices into 'vertexData'
+// @param normalData vertex normal data (or NULL, to use face normals)
+// @param nIndices indices into 'normalData' (or NULL)
+// @param uvData vertex (u,v) data (or NULL)
+// @param tIndices indices into 'uvData' (or NULL)
+///
+void Canvas::addTriangles( int count,
+                           const glm::vec3 *vertexData, const GLuint *vIndices,
+                           const glm::vec3 *normalData, const GLuint *nIndices,
+                           const glm::vec3 *uvData, const GLuint *tIndices )
+{
+    if( count < 1 ) {
+        return;
+    }
+
+    int corners = count * 3;
+
+    // grow every stream once, then fill it in place
+    size_t first = points.size() / 4;
+    float *p = &*points.insert( points.end(), corners * 4, 1.0f );
+    float *n = &*normals.insert( normals.end(), corners * 3, 0.0f );
+
+    for( int i = 0; i < corners; i++ ) {
+        const glm::vec3 &v = vertexData[ vIndices[i] ];
+        p[i * 4] = v.x;
+        p[i * 4 + 1] = v.y;
+        p[i * 4 + 2] = v.z;
+    }
+
+    if( normalData != NULL ) {
+        for( int i = 0; i < corners; i++ ) {
+            const glm::vec3 &nv = normalData[ nIndices[i] ];
+            n[i * 3] = nv.x;
+            n[i * 3 + 1] = nv.y;
+            n[i * 3 + 2] = nv.z;
+        }
+    } else {
+        faceNormals( count, p, n );
+    }
+
+    if( uvData != NULL ) {
+        float *t = &*uv.insert( uv.end(), corners * 2, 0.0f );
+
+        for( int i = 0; i < corners; i++ ) {
+            const glm::vec3 &tv = uvData[ tIndices[i] ];
+            t[i * 2] = tv.x;  // note use of (x,y) vs. (u,v)
+            t[i * 2 + 1] = tv.y;
+        }
+    }
+
+    // an indexed shape needs the new vertices in its element list
+    if( !elements.empty() ) {
+        for( int i = 0; i < corners; i++ ) {
+            elements.push_back( first + i );
+        }
+    }
+
+    numElements += corners;
+}
+
 ///
 // change the current drawing color
 //
@@ -357,8 +521,15 @@ GLuint *Canvas::getElements( void )
     	    cerr << "element allocation failure" << endl;
 	    exit( 1 );
         }
-        for( int i = 0; i < n; i++ ) {
-            elemArray[i] = i;
+        if( elements.empty() ) {
+            // vertices are drawn in the order they were added
+            for( int i = 0; i < n; i++ ) {
+                elemArray[i] = i;
+            }
+        } else {
+            for( int i = 0; i < n; i++ ) {
+                elemArray[i] = elements[i];
+            }
         }
     }
 
@@ -395,10 +566,91 @@ float *Canvas::getColors( void )
 }
 
 
+///
+// views the array of vertices for the current shape
+///
+Span<float> Canvas::vertexSpan( void )
+{
+    return Span<float>( points );
+}
+
+///
+// views the array of normals for the current shape
+///
+Span<float> Canvas::normalSpan( void )
+{
+    return Span<float>( normals );
+}
+
+///
+// views the array of texture coordinates for the current shape
+///
+Span<float> Canvas::uvSpan( void )
+{
+    return Span<float>( uv );
+}
+
+///
+// views the array of colors for the current shape
+///
+Span<float> Canvas::colorSpan( void )
+{
+    return Span<float>( colors );
+}
+
+///
+// views the array of elements for the current shape
+///
+Span<GLuint> Canvas::elementSpan( void )
+{
+    if( elements.empty() ) {
+        // vertices are drawn in the order they were added
+        elements.resize( numElements );
+        for( int i = 0; i < numElements; i++ ) {
+            elements[i] = i;
+        }
+    }
+
+    return Span<GLuint>( elements );
+}
+
+///
+// hands the streams of the current shape over to the caller
+//
+// @param S receives the streams
+///
+void Canvas::takeStreams( CanvasStreams &S )
+{
+    // make sure the streams carry their element list
+    elementSpan();
+
+    S.points.swap( points );
+    S.normals.swap( normals );
+    S.uv.swap( uv );
+    S.colors.swap( colors );
+    S.elements.swap( elements );
+
+    // drop whatever the caller held before, and the copies
+    clear();
+}
+
 ///
 // returns number of vertices in current shape
 ///
 int Canvas::numVertices( void )
+{
+    if( elements.empty() ) {
+        return numElements;
+    }
+
+    // indexed shapes may share vertices between elements
+    return points.size() / 4;
+}
+
+///
+// returns number of elements in current shape
+///
+int Canvas::numIndices( void )
 {
     return numElements;
 }
@@ -28,6 +28,30 @@
 
 using namespace std;
 
+///
+// Read-only view of the values held in one stream of a Canvas, valid
+// until that stream next changes.  'data' is NULL for an empty stream.
+///
+template< typename T >
+struct Span {
+    const T *data;
+    size_t size;
+
+    Span( const vector< T > &v ) :
+        data( v.empty() ? NULL : &v[0] ), size( v.size() ) { }
+};
+
+///
+// The streams of a shape, taken out of a Canvas with takeStreams().
+///
+struct CanvasStreams {
+    vector<float> points;
+    vector<float> normals;
+    vector<float> uv;
+    vector<float> colors;
+    vector<GLuint> elements;
+};
+
 ///
 // Simple canvas class that allows for pixel-by-pixel rendering.
 ///
@@ -66,6 +90,10 @@ public:
     int numElements;
     GLuint *elemArray;
 
+    // indices into the vertex streams, empty if the vertices are drawn
+    // in the order they were added
+    vector<GLuint> elements;
+
     ///
     // current drawing color
     ///
@@ -143,6 +171,32 @@ public:
                                  glm::vec3 p1, glm::vec3 n1, glm::vec3 uv1,
                                  glm::vec3 p2, glm::vec3 n2, glm::vec3 uv2 );
 
+    ///
+    // reserves room in every stream for more triangles, so adding them
+    // does not grow the streams one triangle at a time
+    //
+    // @param count number of triangles about to be added
+    // @param withUV will the triangles carry (u,v) data
+    ///
+    void reserveTriangles( int count, bool withUV );
+
+    ///
+    // adds triangles to the current shape from indexed attribute arrays,
+    // with three indices per triangle into each array
+    //
+    // @param count number of triangles to add
+    // @param vertexData triangle vertices
+    // @param vIndices indices into 'vertexData'
+    // @param normalData vertex normal data (or NULL, to use face normals)
+    // @param nIndices indices into 'normalData' (or NULL)
+    // @param uvData vertex (u,v) data (or NULL)
+    // @param tIndices indices into 'uvData' (or NULL)
+    ///
+    void addTriangles( int count,
+                       const glm::vec3 *vertexData, const GLuint *vIndices,
+                       const glm::vec3 *normalData, const GLuint *nIndices,
+                       const glm::vec3 *uvData, const GLuint *tIndices );
+
     ///
     // Sets the current color
     //
@@ -185,11 +239,50 @@ public:
     ///
     float *getColors( void );
 
+    ///
+    // view the vertex data of this Canvas without copying it
+    ///
+    Span<float> vertexSpan( void );
+
+    ///
+    // view the normal data of this Canvas without copying it
+    ///
+    Span<float> normalSpan( void );
+
+    ///
+    // view the (u,v) data of this Canvas without copying it
+    ///
+    Span<float> uvSpan( void );
+
+    ///
+    // view the color data of this Canvas without copying it
+    ///
+    Span<float> colorSpan( void );
+
+    ///
+    // view the element data of this Canvas without copying it; a shape
+    // drawn in the order its vertices were added becomes indexed first
+    ///
+    Span<GLuint> elementSpan( void );
+
+    ///
+    // hand the streams of the current shape over to the caller, leaving
+    // this Canvas clear
+    //
+    // @param S receives the streams, always with an element list
+    ///
+    void takeStreams( CanvasStreams &S );
+
     ///
     // retrieve the vertex count from this Canvas
     ///
     int numVertices( void );
 
+    ///
+    // retrieve the element count from this Canvas
+    ///
+    int numIndices( void );
+
 };
 
 #endif
@@ -0,0 +1,204 @@
+//
+// Culling.cpp
+//
+// Frustum culling of the objects in the scene, testing their bounding
+// boxes against the planes of the view volume four objects at a time.
+//
+// Author:  Jietong Chen
+//
+
+#include <cfloat>
+#include <cmath>
+
+#include "Culling.h"
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+#include <xmmintrin.h>
+#define CULLING_SSE
+#endif
+
+///
+// Extract the planes of the view volume of a camera.
+//
+// Each plane is a sum or difference of the last row of the combined
+// matrix and one of the others, as clipping keeps -w <= x, y, z <= w.
+//
+// @param Projection - projection matrix of the camera
+// @param View       - viewing matrix of the camera
+//
+// @return the planes, in world space
+///
+Frustum extractFrustum( const mat4 &Projection, const mat4 &View ) {
+    mat4 Clip = Projection * View;
+    Frustum frustum;
+
+    // the rows of the matrix, which glm stores by column
+    vec4 row[4];
+    for( int r = 0; r < 4; r++ ) {
+        row[ r ] = vec4( Clip[ 0 ][ r ], Clip[ 1 ][ r ], Clip[ 2 ][ r ],
+                         Clip[ 3 ][ r ] );
+    }
+
+    for( int axis = 0; axis < 3; axis++ ) {
+        frustum.planes[ 2 * axis ] = row[ 3 ] + row[ axis ];
+        frustum.planes[ 2 * axis + 1 ] = row[ 3 ] - row[ axis ];
+    }
+
+    // unit normals, so the distances compare with the box sizes
+    for( int p = 0; p < 6; p++ ) {
+        frustum.planes[ p ] /= length( vec3( frustum.planes[ p ] ) );
+    }
+
+    return frustum;
+}
+
+///
+// Constructor
+///
+CullSet::CullSet() : count( 0 ) {
+}
+
+///
+// Bound the objects in world space, from the bounds of their shapes and
+// their model matrices; again after any of them moved.
+//
+// @param objects - the objects in the scene
+///
+void CullSet::updateBounds( vector< Object > &objects ) {
+    count = objects.size();
+
+    // whole steps, the padding never seen
+    size_t padded = ( count + CULL_LANES - 1 ) / CULL_LANES * CULL_LANES;
+
+    cx.assign( padded, 0.0f );
+    cy.assign( padded, 0.0f );
+    cz.assign( padded, 0.0f );
+    ex.assign( padded, 0.0f );
+    ey.assign( padded, 0.0f );
+    ez.assign( padded, 0.0f );
+
+    for( size_t i = 0; i < count; i++ ) {
+        Object &obj = objects[ i ];
+        vec3 center( 0.0f ), extent( FLT_MAX );
+
+        if( obj.bufferSet != NULL ) {
+            const BufferSet &mesh = *obj.bufferSet;
+            mat3 Linear( obj.Model );
+
+            center = vec3( obj.Model * vec4( mesh.center, 1.0f ) );
+
+            // the box of the rotated box, each axis reaching as far as
+            // the absolute values of the matrix carry the half sizes
+            mat3 Abs( abs( Linear[ 0 ] ), abs( Linear[ 1 ] ),
+                      abs( Linear[ 2 ] ) );
+            extent = Abs * mesh.extent;
+
+            // the sphere, scaled by the longest axis, where it is tighter
+            float scale = glm::max( length( Linear[ 0 ] ),
+                                    glm::max( length( Linear[ 1 ] ),
+                                              length( Linear[ 2 ] ) ) );
+            extent = glm::min( extent, vec3( mesh.radius * scale ) );
+        }
+
+        cx[ i ] = center.x;
+        cy[ i ] = center.y;
+        cz[ i ] = center.z;
+        ex[ i ] = extent.x;
+        ey[ i ] = extent.y;
+        ez[ i ] = extent.z;
+    }
+}
+
+///
+// Get the world space box of an object.
+//
+// @param i      - index of the object
+// @param center - receives the center of its box
+// @param extent - receives the half size of its box
+///
+void CullSet::getBounds( size_t i, vec3 &center, vec3 &extent ) const {
+    center = vec3( cx[ i ], cy[ i ], cz[ i ] );
+    extent = vec3( ex[ i ], ey[ i ], ez[ i ] );
+}
+
+///
+// Test every object against the view volume.
+//
+// A box is outside a plane when even its corner farthest along the
+// normal is behind it, so each plane costs a multiply-add per component.
+//
+// @param frustum - the planes of the view volume
+// @param visible - receives, for each object, whether it may be seen
+//
+// @return the number of objects that may be seen
+///
+int CullSet::cull( const Frustum &frustum, vector< char > &visible ) const {
+    visible.assign( count, 0 );
+    int numVisible = 0;
+
+    for( size_t i = 0; i < count; i += CULL_LANES ) {
+        int mask;
+
+#ifdef CULLING_SSE
+        __m128 x = _mm_loadu_ps( &cx[ i ] );
+        __m128 y = _mm_loadu_ps( &cy[ i ] );
+        __m128 z = _mm_loadu_ps( &cz[ i ] );
+        __m128 sx = _mm_loadu_ps( &ex[ i ] );
+        __m128 sy = _mm_loadu_ps( &ey[ i ] );
+        __m128 sz = _mm_loadu_ps( &ez[ i ] );
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 inside = _mm_cmpeq_ps( zero, zero );
+
+        for( int p = 0; p < 6; p++ ) {
+            const vec4 &plane = frustum.planes[ p ];
+            vec3 reach = abs( vec3( plane ) );
+
+            // signed distance of the centers, and reach of the boxes
+            __m128 d = _mm_add_ps(
+                _mm_add_ps( _mm_mul_ps( _mm_set1_ps( plane.x ), x ),
+                            _mm_mul_ps( _mm_set1_ps( plane.y ), y ) ),
+                _mm_add_ps( _mm_mul_ps( _mm_set1_ps( plane.z ), z ),
+                            _mm_set1_ps( plane.w ) ) );
+            __m128 r = _mm_add_ps(
+                _mm_add_ps( _mm_mul_ps( _mm_set1_ps( reach.x ), sx ),
+                            _mm_mul_ps( _mm_set1_ps( reach.y ), sy ) ),
+                _mm_mul_ps( _mm_set1_ps( reach.z ), sz ) );
+
+            inside = _mm_and_ps( inside,
+                                 _mm_cmpge_ps( _mm_add_ps( d, r ), zero ) );
+        }
+
+        mask = _mm_movemask_ps( inside );
+#else
+        mask = 0;
+
+        for( int k = 0; k < CULL_LANES; k++ ) {
+            size_t j = i + k;
+            bool in = true;
+
+            for( int p = 0; p < 6 && in; p++ ) {
+                const vec4 &plane = frustum.planes[ p ];
+                float d = plane.x * cx[ j ] + plane.y * cy[ j ] +
+                          plane.z * cz[ j ] + plane.w;
+                float r = fabsf( plane.x ) * ex[ j ] +
+                          fabsf( plane.y ) * ey[ j ] +
+                          fabsf( plane.z ) * ez[ j ];
+                in = d + r >= 0.0f;
+            }
+
+            mask |= int( in ) << k;
+        }
+#endif
+
+        for( int k = 0; k < CULL_LANES && i + k < count; k++ ) {
+            if( mask & ( 1 << k ) ) {
+                visible[ i + k ] = 1;
+                numVisible++;
+            }
+        }
+    }
+
+    return numVisible;
+}
@@ -0,0 +1,88 @@
+//
+// Culling.h
+//
+// Frustum culling of the objects in the scene, testing their bounding
+// boxes against the planes of the view volume four objects at a time.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _CULLING_H_
+#define _CULLING_H_
+
+#include <vector>
+
+#include "Object.h"
+
+// objects tested by one step of the culling kernel
+#define CULL_LANES 4
+
+///
+// The planes bounding the view volume, in world space.
+///
+struct Frustum {
+    // left, right, bottom, top, near and far; a point p is inside a plane
+    // when dot( xyz, p ) + w >= 0, and xyz has unit length
+    vec4 planes[6];
+};
+
+///
+// Extract the planes of the view volume of a camera.
+//
+// @param Projection - projection matrix of the camera
+// @param View       - viewing matrix of the camera
+//
+// @return the planes, in world space
+///
+Frustum extractFrustum( const mat4 &Projection, const mat4 &View );
+
+///
+// The world space bounds of the objects in the scene, as one array per
+// component so the kernel loads the same component of several objects at
+// once.
+///
+class CullSet {
+
+    // centers and half sizes of the boxes, padded to whole steps
+    vector< float > cx, cy, cz;
+    vector< float > ex, ey, ez;
+
+    // number of objects
+    size_t count;
+
+public:
+
+    ///
+    // Constructor
+    ///
+    CullSet();
+
+    ///
+    // Bound the objects in world space, from the bounds of their shapes
+    // and their model matrices; again after any of them moved.
+    //
+    // @param objects - the objects in the scene
+    ///
+    void updateBounds( vector< Object > &objects );
+
+    ///
+    // Get the world space box of an object.
+    //
+    // @param i      - index of the object
+    // @param center - receives the center of its box
+    // @param extent - receives the half size of its box
+    ///
+    void getBounds( size_t i, vec3 &center, vec3 &extent ) const;
+
+    ///
+    // Test every object against the view volume.
+    //
+    // @param frustum - the planes of the view volume
+    // @param visible - receives, for each object, whether it may be seen
+    //
+    // @return the number of objects that may be seen
+    ///
+    int cull( const Frustum &frustum, vector< char > &visible ) const;
+};
+
+#endif
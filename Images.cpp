@@ -0,0 +1,148 @@
+//
+// Images.cpp
+//
+// Images decoded into memory, and the processing SOIL applies to them
+// before they are uploaded, done on the CPU so it can run anywhere.
+//
+// Author:  Jietong Chen
+//
+
+#include <cstring>
+
+#include <SOIL.h>
+
+#include "Images.h"
+
+///
+// Decode an image file, flipped so the first row is the bottom one as
+// OpenGL takes it, and with its color scaled into [16,235] as the
+// SOIL_FLAG_INVERT_Y and SOIL_FLAG_NTSC_SAFE_RGB flags do.
+//
+// @param filename - the name of the image file
+// @param image    - receives the image
+//
+// @return true if the file was decoded
+///
+bool decodeImage( const char *filename, Image &image ) {
+    unsigned char *data = SOIL_load_image( filename, &image.width,
+                                           &image.height, &image.channels,
+                                           SOIL_LOAD_AUTO );
+
+    if( data == NULL ) {
+        return false;
+    }
+
+    image.pixels.assign( data, data + size_t( image.width ) * image.height *
+                                      image.channels );
+    SOIL_free_image_data( data );
+
+    invertImage( image );
+    ntscSafeImage( image );
+
+    return true;
+}
+
+///
+// Flip an image upside down.
+//
+// @param image - the image
+///
+void invertImage( Image &image ) {
+    size_t row = size_t( image.width ) * image.channels;
+    vector< unsigned char > swap( row );
+
+    for( int top = 0, bottom = image.height - 1; top < bottom;
+         top++, bottom-- ) {
+        unsigned char *a = &image.pixels[ top * row ];
+        unsigned char *b = &image.pixels[ bottom * row ];
+
+        memcpy( &swap[ 0 ], a, row );
+        memcpy( a, b, row );
+        memcpy( b, &swap[ 0 ], row );
+    }
+}
+
+///
+// Scale the color of an image into [16,235], leaving any alpha alone.
+//
+// @param image - the image
+///
+void ntscSafeImage( Image &image ) {
+    // the same table SOIL scales through
+    const float lo = 16.0f - 0.499f;
+    const float hi = 235.0f + 0.499f;
+    unsigned char scale[256];
+
+    for( int i = 0; i < 256; i++ ) {
+        scale[ i ] = (unsigned char) ( ( hi - lo ) * i / 255.0f + lo );
+    }
+
+    // the last channel of two or four is alpha
+    int color = image.channels - ( 1 - ( image.channels & 1 ) );
+    size_t size = image.pixels.size();
+
+    for( size_t i = 0; i < size; i += image.channels ) {
+        for( int c = 0; c < color; c++ ) {
+            image.pixels[ i + c ] = scale[ image.pixels[ i + c ] ];
+        }
+    }
+}
+
+///
+// Make the next mipmap level of an image, half as wide and high, each
+// pixel the rounded average of the 2x2 block over it.
+//
+// As SOIL does, an odd row or column at the end is dropped, and a side of
+// one pixel stays one pixel, averaging a 2x1 or 1x2 block.
+//
+// @param image - the level to halve, larger than 1x1
+// @param half  - receives the next level
+///
+void halveImage( const Image &image, Image &half ) {
+    int w = image.width, h = image.height, n = image.channels;
+
+    half.width = w / 2 > 0 ? w / 2 : 1;
+    half.height = h / 2 > 0 ? h / 2 : 1;
+    half.channels = n;
+    half.pixels.resize( size_t( half.width ) * half.height * n );
+
+    for( int y = 0; y < half.height; y++ ) {
+        int rows = 2 * ( y + 1 ) > h ? h - 2 * y : 2;
+
+        for( int x = 0; x < half.width; x++ ) {
+            int columns = 2 * ( x + 1 ) > w ? w - 2 * x : 2;
+            int area = rows * columns;
+
+            const unsigned char *block =
+                    &image.pixels[ ( size_t( 2 * y ) * w + 2 * x ) * n ];
+            unsigned char *out =
+                    &half.pixels[ ( size_t( y ) * half.width + x ) * n ];
+
+            for( int c = 0; c < n; c++ ) {
+                // rounded, the sum starts at half the area
+                int sum = area / 2;
+
+                for( int v = 0; v < rows; v++ ) {
+                    for( int u = 0; u < columns; u++ ) {
+                        sum += block[ ( size_t( v ) * w + u ) * n + c ];
+                    }
+                }
+
+                out[ c ] = (unsigned char) ( sum / area );
+            }
+        }
+    }
+}
+
+///
+// Make every mipmap level of an image down to 1x1, each from the one
+// before it.
+//
+// @param levels - holds the image; receives the smaller levels after it
+///
+void mipmapImage( vector< Image > &levels ) {
+    while( levels.back().width > 1 || levels.back().height > 1 ) {
+        levels.push_back( Image() );
+        halveImage( levels[ levels.size() - 2 ], levels.back() );
+    }
+}
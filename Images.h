@@ -0,0 +1,73 @@
+//
+// Images.h
+//
+// Images decoded into memory, and the processing SOIL applies to them
+// before they are uploaded, done on the CPU so it can run anywhere.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _IMAGES_H_
+#define _IMAGES_H_
+
+#include <vector>
+
+using namespace std;
+
+///
+// The pixels of an image, row by row from the top, with 1 to 4 bytes per
+// pixel.
+///
+struct Image {
+    int width, height;
+
+    // bytes per pixel: luminance, luminance and alpha, RGB or RGBA
+    int channels;
+
+    vector< unsigned char > pixels;
+};
+
+///
+// Decode an image file, flipped so the first row is the bottom one as
+// OpenGL takes it, and with its color scaled into [16,235] as the
+// SOIL_FLAG_INVERT_Y and SOIL_FLAG_NTSC_SAFE_RGB flags do.
+//
+// @param filename - the name of the image file
+// @param image    - receives the image
+//
+// @return true if the file was decoded
+///
+bool decodeImage( const char *filename, Image &image );
+
+///
+// Flip an image upside down.
+//
+// @param image - the image
+///
+void invertImage( Image &image );
+
+///
+// Scale the color of an image into [16,235], leaving any alpha alone.
+//
+// @param image - the image
+///
+void ntscSafeImage( Image &image );
+
+///
+// Make the next mipmap level of an image, half as wide and high, each
+// pixel the rounded average of the 2x2 block over it.
+//
+// @param image - the level to halve, larger than 1x1
+// @param half  - receives the next level
+///
+void halveImage( const Image &image, Image &half );
+
+///
+// Make every mipmap level of an image down to 1x1, each from the one
+// before it.
+//
+// @param levels - holds the image; receives the smaller levels after it
+///
+void mipmapImage( vector< Image > &levels );
+
+#endif
@@ -0,0 +1,314 @@
+//
+// IndirectDraw.cpp
+//
+// Groups of objects drawn with one glMultiDrawElementsIndirect call from
+// the buffers of a page of the buffer arena, their transformations and
+// materials read from a shader storage buffer.
+//
+// Author:  Jietong Chen
+//
+
+#include <glm/gtc/type_ptr.hpp>
+#include <cstring>
+
+#include "BufferArena.h"
+#include "IndirectDraw.h"
+#include "RenderState.h"
+#include "ShaderSetup.h"
+#include "Transforms.h"
+
+///
+// Constructor
+///
+IndirectGroup::IndirectGroup() :
+    program( 0 ), eType( GL_UNSIGNED_SHORT ), page( -1 ), vao( 0 ),
+    commands( 0 ),
+    generation( 0 ), draws( 0 ), drawIndex( 0 ) {
+}
+
+///
+// Build the draw commands from the ranges of the meshes of the members in
+// their page, and the per-draw data.
+//
+// @param objects - the objects in the scene
+///
+void IndirectGroup::createGroup( vector< Object > &objects ) {
+#ifndef __APPLE__
+    BufferSet *first = objects[ members[ 0 ] ].bufferSet;
+    GLuint typeSize = eType == GL_UNSIGNED_SHORT ? sizeof( GLushort ) :
+                                                   sizeof( GLuint );
+
+    // one command per member, its base instance naming its DrawData; the
+    // meshes already share the buffers of the page
+    commandList.resize( members.size() );
+    shown.assign( members.size(), 1 );
+    generation = arenaGeneration();
+    page = first->page;
+
+    vector< GLuint > indices( members.size() );
+
+    for( size_t i = 0; i < members.size(); i++ ) {
+        BufferSet *mesh = objects[ members[ i ] ].bufferSet;
+        DrawCommand &command = commandList[ i ];
+
+        command.count = GLuint( mesh->numElements );
+        command.instanceCount = 1;
+        command.firstIndex = GLuint( mesh->eFirst / typeSize );
+        command.baseVertex = mesh->baseVertex;
+        command.baseInstance = GLuint( i );
+
+        indices[ i ] = GLuint( i );
+    }
+
+    commands = first->makeBuffer( GL_COPY_WRITE_BUFFER, &commandList[ 0 ],
+                                  commandList.size() * sizeof( DrawCommand ) );
+    drawIndex = first->makeBuffer( GL_COPY_WRITE_BUFFER, &indices[ 0 ],
+                                   indices.size() * sizeof( GLuint ) );
+
+    // the layout of the page, and the index of the draw, which advances
+    // once per instance and so starts at the base instance of each draw
+    glGenVertexArrays( 1, &vao );
+    glBindVertexArray( vao );
+
+    first->setUpAttributes();
+
+    glBindBuffer( GL_ARRAY_BUFFER, drawIndex );
+    glEnableVertexAttribArray( ATTRIB_DRAW_INDEX );
+    glVertexAttribIPointer( ATTRIB_DRAW_INDEX, 1, GL_UNSIGNED_INT, 0,
+                            ( void * ) 0 );
+    glVertexAttribDivisor( ATTRIB_DRAW_INDEX, 1 );
+
+    glBindVertexArray( 0 );
+    invalidateState();
+
+    // connect the program to the storage block
+    GLuint block = glGetProgramResourceIndex( program,
+                                              GL_SHADER_STORAGE_BLOCK,
+                                              "Draws" );
+    if( block != GL_INVALID_INDEX ) {
+        glShaderStorageBlockBinding( program, block, DRAW_BLOCK_BINDING );
+    }
+
+    glGenBuffers( 1, &draws );
+    updateDraws( objects );
+#endif
+}
+
+///
+// Rewrite the per-draw data from the transforms and materials of the
+// members, after they changed.
+//
+// @param objects - the objects in the scene
+///
+void IndirectGroup::updateDraws( vector< Object > &objects ) {
+#ifndef __APPLE__
+    vector< DrawData > data( members.size() );
+
+    for( size_t i = 0; i < members.size(); i++ ) {
+        Object &obj = objects[ members[ i ] ];
+        DrawData &draw = data[ i ];
+
+        // world space, from the transform pass
+        const mat4 &Model = obj.transform->World;
+        const mat3 &Normal = obj.transform->Normal;
+
+        memcpy( draw.modelMat, value_ptr( Model ), sizeof( draw.modelMat ) );
+
+        memset( draw.normalMat, 0, sizeof( draw.normalMat ) );
+        for( int c = 0; c < 3; c++ ) {
+            memcpy( draw.normalMat + 4 * c, value_ptr( Normal[ c ] ),
+                    3 * sizeof( GLfloat ) );
+        }
+
+        draw.material = obj.materialIndex();
+        draw.pad[ 0 ] = draw.pad[ 1 ] = draw.pad[ 2 ] = 0;
+    }
+
+    glBindBuffer( GL_SHADER_STORAGE_BUFFER, draws );
+    glBufferData( GL_SHADER_STORAGE_BUFFER, data.size() * sizeof( DrawData ),
+                  &data[ 0 ], GL_STATIC_DRAW );
+#endif
+}
+
+///
+// Rebuild the draw commands if the meshes of the members moved within
+// their page since they were built.
+//
+// The vertex array object reads the buffers of the page the group was made
+// in, so a member whose mesh was stored again in another page cannot be
+// drawn by the group at all.
+//
+// @param objects - the objects in the scene
+//
+// @return false if the mesh of a member is no longer in the page or has
+//         another element type, and the groups must be made again
+///
+bool IndirectGroup::refreshCommands( vector< Object > &objects ) {
+#ifndef __APPLE__
+    if( generation == arenaGeneration() || members.empty() ) {
+        return true;
+    }
+
+    for( size_t i = 0; i < members.size(); i++ ) {
+        BufferSet *mesh = objects[ members[ i ] ].bufferSet;
+
+        if( mesh->page != page || mesh->eType != eType ) {
+            return false;
+        }
+    }
+
+    GLuint typeSize = eType == GL_UNSIGNED_SHORT ? sizeof( GLushort ) :
+                                                   sizeof( GLuint );
+
+    // the base instances stay; the ranges moved within the page, and a
+    // mesh made again may have another count
+    for( size_t i = 0; i < members.size(); i++ ) {
+        BufferSet *mesh = objects[ members[ i ] ].bufferSet;
+        DrawCommand &command = commandList[ i ];
+
+        command.count = GLuint( mesh->numElements );
+        command.firstIndex = GLuint( mesh->eFirst / typeSize );
+        command.baseVertex = mesh->baseVertex;
+    }
+
+    // every command at the front again, as after createGroup()
+    glBindBuffer( GL_COPY_WRITE_BUFFER, commands );
+    glBufferSubData( GL_COPY_WRITE_BUFFER, 0,
+                     commandList.size() * sizeof( DrawCommand ),
+                     &commandList[ 0 ] );
+
+    shown.assign( members.size(), 1 );
+    generation = arenaGeneration();
+#endif
+
+    return true;
+}
+
+///
+// Delete the buffers and vertex array object of the group.
+///
+void IndirectGroup::deleteGroup( void ) {
+#ifndef __APPLE__
+    glDeleteVertexArrays( 1, &vao );
+    glDeleteBuffers( 1, &commands );
+    glDeleteBuffers( 1, &draws );
+    glDeleteBuffers( 1, &drawIndex );
+    invalidateState();
+
+    vao = commands = draws = drawIndex = 0;
+#endif
+}
+
+///
+// Draw the members of the group that may be seen.
+//
+// @param visible - for each object, whether it may be seen
+///
+void IndirectGroup::drawGroup( const vector< char > &visible ) {
+#ifndef __APPLE__
+    vector< char > now( members.size() );
+    int count = 0;
+
+    for( size_t i = 0; i < members.size(); i++ ) {
+        now[ i ] = visible[ members[ i ] ];
+        count += now[ i ];
+    }
+
+    if( count == 0 ) {
+        return;
+    }
+
+    // move the commands of the members seen to the front, only when the
+    // members seen changed; their base instances still name their data
+    if( now != shown ) {
+        vector< DrawCommand > seen;
+
+        for( size_t i = 0; i < members.size(); i++ ) {
+            if( now[ i ] ) {
+                seen.push_back( commandList[ i ] );
+            }
+        }
+
+        glBindBuffer( GL_COPY_WRITE_BUFFER, commands );
+        glBufferSubData( GL_COPY_WRITE_BUFFER, 0,
+                         seen.size() * sizeof( DrawCommand ), &seen[ 0 ] );
+        shown = now;
+    }
+
+    useProgram( program );
+    bindVertexArray( vao );
+
+    glBindBufferBase( GL_SHADER_STORAGE_BUFFER, DRAW_BLOCK_BINDING, draws );
+    glBindBuffer( GL_DRAW_INDIRECT_BUFFER, commands );
+
+    // however many members, one call
+    glMultiDrawElementsIndirect( GL_TRIANGLES, eType, ( void * ) 0,
+                                 GLsizei( count ), 0 );
+#endif
+}
+
+///
+// Can the context draw indirect groups?
+//
+// @return true if glMultiDrawElementsIndirect and shader storage buffers
+//     are available (GL 4.3)
+///
+bool indirectSupported( void ) {
+#ifdef __APPLE__
+    return false;
+#else
+    return GLEW_VERSION_4_3;
+#endif
+}
+
+///
+// Group the opaque objects of a program whose meshes share a page of the
+// buffer arena, so each group is drawn with one call.
+//
+// @param objects    - the objects in the scene
+// @param program    - the program whose objects are grouped
+// @param indirect   - the indirect variant of that program
+// @param groups     - receives the groups, with their buffers; those it
+//                      held are deleted
+// @param indirectOf - receives, for each object, whether a group draws it
+///
+void makeIndirectGroups( vector< Object > &objects, GLuint program,
+                         GLuint indirect, vector< IndirectGroup > &groups,
+                         vector< bool > &indirectOf ) {
+    for( size_t g = 0; g < groups.size(); g++ ) {
+        groups[ g ].deleteGroup();
+    }
+    groups.clear();
+    indirectOf.assign( objects.size(), false );
+
+    for( size_t i = 0; i < objects.size(); i++ ) {
+        Object &obj = objects[ i ];
+
+        if( indirectOf[ i ] || obj.program != program ||
+            obj.pass != PASS_OPAQUE || obj.bufferSet == NULL ) {
+            continue;
+        }
+
+        IndirectGroup group;
+        group.program = indirect;
+        group.eType = obj.bufferSet->eType;
+
+        // one call reads one element type, from the buffers of one page
+        for( size_t j = i; j < objects.size(); j++ ) {
+            Object &other = objects[ j ];
+
+            if( indirectOf[ j ] || other.program != program ||
+                other.pass != PASS_OPAQUE || other.bufferSet == NULL ||
+                other.bufferSet->page != obj.bufferSet->page ||
+                other.bufferSet->eType != group.eType ) {
+                continue;
+            }
+
+            group.members.push_back( int( j ) );
+            indirectOf[ j ] = true;
+        }
+
+        group.createGroup( objects );
+        groups.push_back( group );
+    }
+}
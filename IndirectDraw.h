@@ -0,0 +1,163 @@
+//
+// IndirectDraw.h
+//
+// Groups of objects drawn with one glMultiDrawElementsIndirect call from
+// the buffers of a page of the buffer arena, their transformations and
+// materials read from a shader storage buffer.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _INDIRECTDRAW_H_
+#define _INDIRECTDRAW_H_
+
+#include <vector>
+
+#include "Object.h"
+#include "UniformBlocks.h"
+
+// binding point of the storage block holding the DrawData records
+#define DRAW_BLOCK_BINDING 0
+
+// preprocessor lines turning a shader into its indirect variant, which
+// needs GLSL 4.30 for shader storage blocks
+#define INDIRECT_DEFINES "#version 430\n#define INDIRECT\n" BLOCK_DEFINES
+
+///
+// One draw of glMultiDrawElementsIndirect, as laid out by GL.
+///
+struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    // names the DrawData record of the draw, through the iDrawIndex
+    // attribute advancing once per instance
+    GLuint baseInstance;
+};
+
+///
+// Per-draw data of a group, one record per object, in std430 layout.
+///
+struct DrawData {
+    // model matrix, including the decoding of packed vertex locations
+    GLfloat modelMat[16];
+    // inverse transpose of the model matrix, in world space; std430 pads
+    // each column to four floats
+    GLfloat normalMat[12];
+    // index into the material table
+    GLint material;
+    GLint pad[3];
+};
+
+///
+// Objects sharing a program and a page of the buffer arena, drawn with one
+// call.
+///
+class IndirectGroup {
+
+public:
+
+    // the indirect variant of the program of the objects
+    GLuint program;
+
+    // indices of the objects in the group, in drawing order
+    vector< int > members;
+
+    // type of the elements of every member
+    GLenum eType;
+
+    // the page of the buffer arena holding the meshes of every member
+    int page;
+
+    // vertex array object reading the page of the members and the index
+    // of each draw
+    GLuint vao;
+
+    // buffer of DrawCommand, one per member, those drawn first
+    GLuint commands;
+
+    // the commands of every member, in member order
+    vector< DrawCommand > commandList;
+
+    // the members whose commands are at the front of the buffer
+    vector< char > shown;
+
+    // the arena generation the commands were built in
+    int generation;
+
+    // shader storage buffer of DrawData, one record per member
+    GLuint draws;
+
+    // buffer of 0, 1, 2, ... read by the iDrawIndex attribute
+    GLuint drawIndex;
+
+    ///
+    // Constructor
+    ///
+    IndirectGroup();
+
+    ///
+    // Build the draw commands from the ranges of the meshes of the
+    // members in their page, and the per-draw data.
+    //
+    // @param objects - the objects in the scene
+    ///
+    void createGroup( vector< Object > &objects );
+
+    ///
+    // Rewrite the per-draw data from the transforms and materials of the
+    // members, after they changed.  The transform pass must have run.
+    //
+    // @param objects - the objects in the scene
+    ///
+    void updateDraws( vector< Object > &objects );
+
+    ///
+    // Rebuild the draw commands if the meshes of the members moved within
+    // their page since they were built.
+    //
+    // @param objects - the objects in the scene
+    //
+    // @return false if the mesh of a member is no longer in the page or
+    //         has another element type, and the groups must be made again
+    ///
+    bool refreshCommands( vector< Object > &objects );
+
+    ///
+    // Delete the buffers and vertex array object of the group.
+    ///
+    void deleteGroup( void );
+
+    ///
+    // Draw the members of the group that may be seen.
+    //
+    // @param visible - for each object, whether it may be seen
+    ///
+    void drawGroup( const vector< char > &visible );
+};
+
+///
+// Can the context draw indirect groups?
+//
+// @return true if glMultiDrawElementsIndirect and shader storage buffers
+//     are available (GL 4.3)
+///
+bool indirectSupported( void );
+
+///
+// Group the opaque objects of a program whose meshes share a page of the
+// buffer arena, so each group is drawn with one call.
+//
+// @param objects    - the objects in the scene
+// @param program    - the program whose objects are grouped
+// @param indirect   - the indirect variant of that program
+// @param groups     - receives the groups, with their buffers; those it
+//                      held are deleted
+// @param indirectOf - receives, for each object, whether a group draws it
+///
+void makeIndirectGroups( vector< Object > &objects, GLuint program,
+                         GLuint indirect, vector< IndirectGroup > &groups,
+                         vector< bool > &indirectOf );
+
+#endif
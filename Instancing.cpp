@@ -0,0 +1,199 @@
+//
+// Instancing.cpp
+//
+// Batches of objects sharing a shape, drawn with one instanced call.
+//
+// Author:  Jietong Chen
+//
+
+#include <glm/gtc/type_ptr.hpp>
+#include <cstddef>
+#include <cstring>
+
+#include "Instancing.h"
+#include "ShaderSetup.h"
+#include "Transforms.h"
+
+// How to calculate an offset into the vertex buffer
+#define BUFFER_OFFSET( i ) ((char *)NULL + (i))
+
+///
+// Constructor
+///
+InstanceBatch::InstanceBatch() : program( 0 ), ibuffer( 0 ), vao( 0 ) {
+}
+
+///
+// Build the instance buffer and the vertex array object from the shape,
+// transforms and materials of the members.
+//
+// @param objects - the objects in the scene
+///
+void InstanceBatch::createInstances( vector< Object > &objects ) {
+    instances.resize( members.size() );
+    shown.assign( members.size(), 1 );
+
+    for( size_t i = 0; i < members.size(); i++ ) {
+        Object &obj = objects[ members[ i ] ];
+        InstanceData &instance = instances[ i ];
+
+        // world space, from the transform pass
+        const mat4 &Model = obj.transform->World;
+        const mat3 &Normal = obj.transform->Normal;
+
+        memcpy( instance.modelMat, value_ptr( Model ),
+                sizeof( instance.modelMat ) );
+        memcpy( instance.normalMat, value_ptr( Normal ),
+                sizeof( instance.normalMat ) );
+
+        instance.material = GLfloat( obj.materialIndex() );
+    }
+
+    if( ibuffer == 0 ) {
+        glGenBuffers( 1, &ibuffer );
+    }
+
+    glBindBuffer( GL_ARRAY_BUFFER, ibuffer );
+    glBufferData( GL_ARRAY_BUFFER, instances.size() * sizeof( InstanceData ),
+                  &instances[ 0 ], GL_STATIC_DRAW );
+
+    if( vao != 0 ) {
+        return;
+    }
+
+    // the layout of the shape, then the per-copy attributes, which
+    // advance once per copy rather than per vertex
+    glGenVertexArrays( 1, &vao );
+    glBindVertexArray( vao );
+
+    objects[ members[ 0 ] ].bufferSet->setUpAttributes();
+
+#ifndef __APPLE__
+    GLsizei stride = sizeof( InstanceData );
+
+    glBindBuffer( GL_ARRAY_BUFFER, ibuffer );
+
+    // a matrix attribute takes one location per column
+    for( int c = 0; c < 4; c++ ) {
+        GLuint column = ATTRIB_INSTANCE_MODEL + c;
+        glEnableVertexAttribArray( column );
+        glVertexAttribPointer( column, 4, GL_FLOAT, GL_FALSE, stride,
+                BUFFER_OFFSET( offsetof( InstanceData, modelMat ) +
+                               c * 4 * sizeof( GLfloat ) ) );
+        glVertexAttribDivisor( column, 1 );
+    }
+
+    for( int c = 0; c < 3; c++ ) {
+        GLuint column = ATTRIB_INSTANCE_NORMAL + c;
+        glEnableVertexAttribArray( column );
+        glVertexAttribPointer( column, 3, GL_FLOAT, GL_FALSE, stride,
+                BUFFER_OFFSET( offsetof( InstanceData, normalMat ) +
+                               c * 3 * sizeof( GLfloat ) ) );
+        glVertexAttribDivisor( column, 1 );
+    }
+
+    glEnableVertexAttribArray( ATTRIB_INSTANCE_MATERIAL );
+    glVertexAttribPointer( ATTRIB_INSTANCE_MATERIAL, 1, GL_FLOAT, GL_FALSE,
+                           stride, BUFFER_OFFSET( offsetof( InstanceData,
+                                                            material ) ) );
+    glVertexAttribDivisor( ATTRIB_INSTANCE_MATERIAL, 1 );
+#endif
+
+    glBindVertexArray( 0 );
+}
+
+///
+// Draw the members of the batch that may be seen.
+//
+// @param objects - the objects in the scene
+// @param visible - for each object, whether it may be seen
+///
+void InstanceBatch::drawBatch( vector< Object > &objects,
+                               const vector< char > &visible ) {
+    vector< char > now( members.size() );
+    int count = 0;
+
+    for( size_t i = 0; i < members.size(); i++ ) {
+        now[ i ] = visible[ members[ i ] ];
+        count += now[ i ];
+    }
+
+    if( count == 0 ) {
+        return;
+    }
+
+    // move the records of the copies seen to the front, only when the
+    // copies seen changed
+    if( now != shown ) {
+        vector< InstanceData > seen;
+
+        for( size_t i = 0; i < members.size(); i++ ) {
+            if( now[ i ] ) {
+                seen.push_back( instances[ i ] );
+            }
+        }
+
+        glBindBuffer( GL_ARRAY_BUFFER, ibuffer );
+        glBufferSubData( GL_ARRAY_BUFFER, 0,
+                         seen.size() * sizeof( InstanceData ), &seen[ 0 ] );
+        shown = now;
+    }
+
+    // the first member stands for the shape and texture of the others
+    objects[ members[ 0 ] ].drawInstanced( program, vao, count );
+}
+
+///
+// Group the objects sharing a shape, program, texture and render pass
+// into batches.
+//
+// @param objects   - the objects in the scene
+// @param instanced - the instanced variant of each program
+// @param batches   - receives the batches, with their instance buffers
+// @param batchOf   - receives the batch of each object, or -1
+///
+void makeBatches( vector< Object > &objects,
+                  const map< GLuint, GLuint > &instanced,
+                  vector< InstanceBatch > &batches, vector< int > &batchOf ) {
+    batches.clear();
+    batchOf.assign( objects.size(), -1 );
+
+    for( size_t i = 0; i < objects.size(); i++ ) {
+        Object &obj = objects[ i ];
+        map< GLuint, GLuint >::const_iterator variant =
+            instanced.find( obj.program );
+
+        if( batchOf[ i ] >= 0 || variant == instanced.end() ||
+            obj.bufferSet == NULL ) {
+            continue;
+        }
+
+        InstanceBatch batch;
+        batch.program = variant->second;
+        batch.members.push_back( int( i ) );
+
+        for( size_t j = i + 1; j < objects.size(); j++ ) {
+            Object &other = objects[ j ];
+
+            if( batchOf[ j ] >= 0 || other.bufferSet != obj.bufferSet ||
+                other.program != obj.program ||
+                other.texture != obj.texture || other.pass != obj.pass ) {
+                continue;
+            }
+
+            batch.members.push_back( int( j ) );
+        }
+
+        // a lone object gains nothing from instancing
+        if( batch.members.size() < 2 ) {
+            continue;
+        }
+
+        for( size_t k = 0; k < batch.members.size(); k++ ) {
+            batchOf[ batch.members[ k ] ] = int( batches.size() );
+        }
+
+        batch.createInstances( objects );
+        batches.push_back( batch );
+    }
+}
@@ -0,0 +1,98 @@
+//
+// Instancing.h
+//
+// Batches of objects sharing a shape, drawn with one instanced call.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _INSTANCING_H_
+#define _INSTANCING_H_
+
+#include <map>
+#include <vector>
+
+#include "Object.h"
+#include "UniformBlocks.h"
+
+// preprocessor lines turning a shader into its instanced variant
+#define INSTANCED_DEFINES "#define INSTANCED\n" BLOCK_DEFINES
+
+///
+// Per-instance data of a batch, one record per object, read by the
+// iModelMat, iNormalMat and iMaterial attributes.
+///
+struct InstanceData {
+    // model matrix, including the decoding of packed vertex locations
+    GLfloat modelMat[16];
+    // inverse transpose of the model matrix, in world space
+    GLfloat normalMat[9];
+    // index into the material table
+    GLfloat material;
+};
+
+///
+// Objects drawing the same shape with the same program and texture.
+///
+class InstanceBatch {
+
+public:
+
+    // the instanced variant of the program of the objects
+    GLuint program;
+
+    // indices of the objects in the batch, in drawing order
+    vector< int > members;
+
+    // buffer of InstanceData, one record per member, those drawn first
+    GLuint ibuffer;
+
+    // the records of every member, in member order
+    vector< InstanceData > instances;
+
+    // the members whose records are at the front of the buffer
+    vector< char > shown;
+
+    // vertex array object reading the shape and the instance buffer
+    GLuint vao;
+
+    ///
+    // Constructor
+    ///
+    InstanceBatch();
+
+    ///
+    // Build the instance buffer and the vertex array object from the shape,
+    // transforms and materials of the members; again after they moved.
+    // The transform pass must have run.
+    //
+    // @param objects - the objects in the scene
+    ///
+    void createInstances( vector< Object > &objects );
+
+    ///
+    // Draw the members of the batch that may be seen.
+    //
+    // @param objects - the objects in the scene
+    // @param visible - for each object, whether it may be seen
+    ///
+    void drawBatch( vector< Object > &objects,
+                    const vector< char > &visible );
+};
+
+///
+// Group the objects sharing a shape, program, texture and render pass
+// into batches.
+//
+// @param objects   - the objects in the scene
+// @param instanced - the instanced variant of each program; objects whose
+//                    program has none are drawn one by one
+// @param batches   - receives the batches, with their instance buffers
+// @param batchOf   - receives the batch of each object, or -1 for objects
+//                    drawn one by one
+///
+void makeBatches( vector< Object > &objects,
+                  const map< GLuint, GLuint > &instanced,
+                  vector< InstanceBatch > &batches, vector< int > &batchOf );
+
+#endif
@@ -9,30 +9,32 @@
 //
 //  Simple class for setting up Phong illumination/shading.
 //
-//  This code can be compiled as either C or C++.
-//
+
+#include <cstring>
 
 #include "Lighting.h"
 
 ///
 // Set up the lighting properties of the scene.
 //
-// @param program - The ID of an OpenGL (GLSL) shader program to which
-//    parameter values are to be sent
+// @param View  - viewing matrix of the current camera
+// @param frame - the per-frame uniforms to write the lights into
 ///
-void setUpLight( GLuint program ) {
+void setUpLight( const glm::mat4 &View, FrameBlock &frame ) {
     // set up the ambient light property
     GLfloat ambientLightColor[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
 
-    glUniform4fv( glGetUniformLocation( program, "aLightColor" ), 1,
-                  ambientLightColor );
+    memcpy( frame.aLightColor, ambientLightColor,
+            sizeof( frame.aLightColor ) );
 
-    // set up the point light properties
-    GLfloat pointLightPosition[4] = { -30.0f, 60.0f, 20.0f, 1.0f };
+    // set up the point light properties, moving the light into camera
+    // space here rather than once per vertex
+    glm::vec4 pointLightPosition =
+        View * glm::vec4( -30.0f, 60.0f, 20.0f, 1.0f );
     GLfloat pointLightColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-    glUniform4fv( glGetUniformLocation( program, "pLightPosition" ), 1,
-                  pointLightPosition );
-    glUniform4fv( glGetUniformLocation( program, "pLightColor" ), 1,
-                  pointLightColor );
+    memcpy( frame.pLightPosition, &pointLightPosition[ 0 ],
+            sizeof( frame.pLightPosition ) );
+    memcpy( frame.pLightColor, pointLightColor,
+            sizeof( frame.pLightColor ) );
 }
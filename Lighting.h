@@ -22,13 +22,16 @@
 #endif
 
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "UniformBlocks.h"
 
 ///
 // Set up the lighting properties of the scene.
 //
-// @param program - The ID of an OpenGL (GLSL) shader program to which
-//    parameter values are to be sent
+// @param View  - viewing matrix of the current camera
+// @param frame - the per-frame uniforms to write the lights into
 ///
-void setUpLight( GLuint program );
+void setUpLight( const glm::mat4 &View, FrameBlock &frame );
 
 #endif
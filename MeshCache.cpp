@@ -0,0 +1,288 @@
+//
+// MeshCache.cpp
+//
+// Binary cache of the vertex and element streams built from a model file.
+//
+// Author:  Jietong Chen
+//
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+
+#include "MeshCache.h"
+
+using namespace std;
+
+// "TCMC", the first bytes of every cache file
+static const unsigned int CACHE_MAGIC = 0x434d4354;
+
+// bump whenever the layout or the processing of the streams changes
+static const unsigned int CACHE_VERSION = 3;
+
+///
+// Identifies the model file, and the build of it, a cache was made from.
+///
+struct CacheKey {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int flags;
+    unsigned int pathLength;
+    unsigned long long size;
+    long long mtime;
+    unsigned long long hash;
+};
+
+///
+// Header of a cache file, followed by the path of the model file and then
+// the points, normals, (u,v) and element streams exactly as the Canvas
+// holds them.
+///
+struct CacheHeader {
+    CacheKey key;
+    unsigned int numElements;
+    unsigned int numPoints;
+    unsigned int numNormals;
+    unsigned int numUV;
+    unsigned int numIndices;
+};
+
+///
+// Get the name of the cache file of a model file.
+//
+// @param filename - the name of the model file
+//
+// @return the name of the cache file
+///
+static string cacheName( const char *filename ) {
+    return string( filename ) + ".cache";
+}
+
+///
+// Build the key of a model file from its size, modification time and a
+// 64-bit FNV-1a hash of its contents, taken a word at a time.
+//
+// @param filename - the name of the model file
+// @param flags    - the processing applied to the streams after reading
+// @param key      - receives the key
+//
+// @return true if the model file could be read
+///
+static bool makeKey( const char *filename, unsigned int flags,
+                     CacheKey &key ) {
+    struct stat info;
+
+    if( stat( filename, &info ) != 0 ) {
+        return false;
+    }
+
+    FILE *fp = fopen( filename, "rb" );
+
+    if( fp == NULL ) {
+        return false;
+    }
+
+    unsigned long long hash = 14695981039346656037ULL;
+    unsigned char block[ 1 << 16 ];
+    size_t count;
+
+    while( ( count = fread( block, 1, sizeof( block ), fp ) ) > 0 ) {
+        size_t i = 0;
+
+        // eight bytes per step, then the tail of the block byte by byte
+        for( ; i + 8 <= count; i += 8 ) {
+            unsigned long long word;
+            memcpy( &word, block + i, 8 );
+            hash = ( hash ^ word ) * 1099511628211ULL;
+        }
+
+        for( ; i < count; i++ ) {
+            hash = ( hash ^ block[ i ] ) * 1099511628211ULL;
+        }
+    }
+
+    fclose( fp );
+
+    memset( &key, 0, sizeof( key ) );
+    key.magic = CACHE_MAGIC;
+    key.version = CACHE_VERSION;
+    key.flags = flags;
+    key.pathLength = (unsigned int) strlen( filename );
+    key.size = (unsigned long long) info.st_size;
+    key.mtime = (long long) info.st_mtime;
+    key.hash = hash;
+
+    return true;
+}
+
+///
+// Read one stream of the cache, appending it to a Canvas stream.
+//
+// @param fp     - the cache file
+// @param count  - number of values in the stream
+// @param stream - the Canvas stream to append to
+//
+// @return true if the whole stream was read
+///
+template< typename T >
+static bool readStream( FILE *fp, unsigned int count, vector< T > &stream ) {
+    size_t at = stream.size();
+    stream.resize( at + count );
+
+    if( count > 0 && fread( &stream[ at ], sizeof( T ), count, fp )
+                     != count ) {
+        stream.resize( at );
+        return false;
+    }
+
+    return true;
+}
+
+///
+// Read the cached vertex streams of a model file into the Canvas.
+//
+// @param filename - the name of the model file
+// @param flags    - the processing applied to the streams after reading
+// @param C        - the Canvas to use
+//
+// @return true if the cache was valid and has been read
+///
+bool readMeshCache( const char *filename, unsigned int flags, Canvas &C ) {
+    FILE *fp = fopen( cacheName( filename ).c_str(), "rb" );
+
+    if( fp == NULL ) {
+        return false;
+    }
+
+    fseek( fp, 0, SEEK_END );
+    unsigned long long length = (unsigned long long) ftell( fp );
+    rewind( fp );
+
+    CacheHeader header;
+    CacheKey key;
+    string path;
+
+    bool valid = fread( &header, sizeof( header ), 1, fp ) == 1 &&
+                 makeKey( filename, flags, key ) &&
+                 memcmp( &header.key, &key, sizeof( key ) ) == 0;
+
+    // the streams must fill the rest of the file exactly, before anything
+    // is made that large
+    valid = valid && header.numPoints % 4 == 0 &&
+            sizeof( header ) + (unsigned long long) key.pathLength +
+            sizeof( float ) * ( (unsigned long long) header.numPoints +
+                                header.numNormals + header.numUV ) +
+            sizeof( GLuint ) * (unsigned long long) header.numIndices ==
+            length;
+
+    if( valid ) {
+        // the cache must also have been built from the same path
+        path.resize( key.pathLength );
+        valid = fread( &path[ 0 ], 1, key.pathLength, fp ) ==
+                key.pathLength && path == filename;
+    }
+
+    size_t points = C.points.size();
+    size_t normals = C.normals.size();
+    size_t uv = C.uv.size();
+    size_t elements = C.elements.size();
+
+    // an indexed cache can only be read into an empty Canvas, since its
+    // elements start from vertex 0
+    if( valid && header.numIndices > 0 && points > 0 ) {
+        valid = false;
+    }
+
+    if( valid ) {
+        valid = readStream( fp, header.numPoints, C.points ) &&
+                readStream( fp, header.numNormals, C.normals ) &&
+                readStream( fp, header.numUV, C.uv ) &&
+                readStream( fp, header.numIndices, C.elements );
+
+        // every element must name a cached vertex
+        for( size_t i = elements; valid && i < C.elements.size(); i++ ) {
+            valid = C.elements[ i ] < header.numPoints / 4;
+        }
+
+        if( valid ) {
+            C.numElements += header.numElements;
+        } else {
+            // truncated or damaged cache, leave the Canvas as it was
+            C.points.resize( points );
+            C.normals.resize( normals );
+            C.uv.resize( uv );
+            C.elements.resize( elements );
+        }
+    }
+
+    fclose( fp );
+
+    return valid;
+}
+
+///
+// Write the vertex streams held in the Canvas to the cache of a model file.
+//
+// @param filename - the name of the model file
+// @param flags    - the processing applied to the streams after reading
+// @param C        - the Canvas holding the streams
+///
+void writeMeshCache( const char *filename, unsigned int flags, Canvas &C ) {
+    CacheHeader header;
+
+    memset( &header, 0, sizeof( header ) );
+
+    if( !makeKey( filename, flags, header.key ) ) {
+        return;
+    }
+
+    header.numElements = C.numElements;
+    header.numPoints = (unsigned int) C.points.size();
+    header.numNormals = (unsigned int) C.normals.size();
+    header.numUV = (unsigned int) C.uv.size();
+    header.numIndices = (unsigned int) C.elements.size();
+
+    // written aside and renamed over the old cache once complete, so a
+    // crash never leaves a partial cache under the name
+    string name = cacheName( filename );
+    string temporary = name + ".tmp";
+    FILE *fp = fopen( temporary.c_str(), "wb" );
+
+    if( fp == NULL ) {
+        cerr << "Cannot write mesh cache " << name << endl;
+        return;
+    }
+
+    bool written =
+            fwrite( &header, sizeof( header ), 1, fp ) == 1 &&
+            fwrite( filename, 1, header.key.pathLength, fp ) ==
+            header.key.pathLength &&
+            ( C.points.empty() ||
+              fwrite( &C.points[ 0 ], sizeof( float ), C.points.size(), fp ) ==
+              C.points.size() ) &&
+            ( C.normals.empty() ||
+              fwrite( &C.normals[ 0 ], sizeof( float ), C.normals.size(),
+                      fp ) == C.normals.size() ) &&
+            ( C.uv.empty() ||
+              fwrite( &C.uv[ 0 ], sizeof( float ), C.uv.size(), fp ) ==
+              C.uv.size() ) &&
+            ( C.elements.empty() ||
+              fwrite( &C.elements[ 0 ], sizeof( GLuint ), C.elements.size(),
+                      fp ) == C.elements.size() );
+
+    written = fclose( fp ) == 0 && written;
+
+#if defined(_WIN32) || defined(_WIN64)
+    // rename() does not replace an existing file here
+    if( written ) {
+        remove( name.c_str() );
+    }
+#endif
+
+    if( !written || rename( temporary.c_str(), name.c_str() ) != 0 ) {
+        cerr << "Cannot write mesh cache " << name << endl;
+        remove( temporary.c_str() );
+    }
+}
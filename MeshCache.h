@@ -0,0 +1,38 @@
+//
+// MeshCache.h
+//
+// Binary cache of the vertex and element streams built from a model file.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _MESHCACHE_H_
+#define _MESHCACHE_H_
+
+#include "Canvas.h"
+
+///
+// Read the cached vertex streams of a model file into the Canvas.
+//
+// The cache lives next to the model file, and is used only if it was
+// built from a file with the same path, size, modification time and
+// contents, and with the same processing flags.
+//
+// @param filename - the name of the model file
+// @param flags    - the processing applied to the streams after reading
+// @param C        - the Canvas to use
+//
+// @return true if the cache was valid and has been read
+///
+bool readMeshCache( const char *filename, unsigned int flags, Canvas &C );
+
+///
+// Write the vertex streams held in the Canvas to the cache of a model file.
+//
+// @param filename - the name of the model file
+// @param flags    - the processing applied to the streams after reading
+// @param C        - the Canvas holding the streams
+///
+void writeMeshCache( const char *filename, unsigned int flags, Canvas &C );
+
+#endif
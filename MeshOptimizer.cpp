@@ -0,0 +1,631 @@
+//
+// MeshOptimizer.cpp
+//
+// Processing passes that turn the triangle soup held in a Canvas into an
+// indexed mesh suited to the GPU.
+//
+// Author:  Jietong Chen
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MeshOptimizer.h"
+
+// size of the LRU cache simulated while ordering triangles
+static const int VCACHE_SIZE = 32;
+
+///
+// One attribute stream of the Canvas and its number of components.
+///
+struct Stream {
+    vector< float > *data;
+    int components;
+};
+
+///
+// Find the attribute streams which are present for every vertex.
+//
+// @param C       - the Canvas to use
+// @param streams - receives up to four streams
+//
+// @return the number of streams found
+///
+static int collectStreams( Canvas &C, Stream *streams ) {
+    int numVertices = C.numVertices();
+    int numStreams = 0;
+
+    Stream candidates[ 4 ] = {
+            { &C.points, 4 },
+            { &C.colors, 4 },
+            { &C.normals, 3 },
+            { &C.uv, 2 }
+    };
+
+    for( int s = 0; s < 4; s++ ) {
+        size_t size = size_t( numVertices ) * candidates[ s ].components;
+
+        if( numVertices > 0 && candidates[ s ].data->size() == size ) {
+            streams[ numStreams++ ] = candidates[ s ];
+        }
+    }
+
+    return numStreams;
+}
+
+///
+// Get the vertex index of an element of the shape.
+//
+// @param C - the Canvas to use
+// @param i - which element
+//
+// @return the index of the vertex the element refers to
+///
+static inline GLuint vertexOf( Canvas &C, int i ) {
+    return C.elements.empty() ? GLuint( i ) : C.elements[ i ];
+}
+
+///
+// Hash all the attributes of one vertex.
+//
+// @param streams    - the attribute streams present in the shape
+// @param numStreams - how many streams there are
+// @param v          - which vertex
+//
+// @return the hash of the bit patterns of the attributes
+///
+static inline unsigned int hashVertex( const Stream *streams, int numStreams,
+                                       GLuint v ) {
+    unsigned int hash = 2166136261u;
+
+    for( int s = 0; s < numStreams; s++ ) {
+        const float *a = &( *streams[ s ].data )[ v * streams[ s ].components ];
+
+        for( int c = 0; c < streams[ s ].components; c++ ) {
+            unsigned int bits;
+            memcpy( &bits, &a[ c ], sizeof( bits ) );
+            hash = ( hash ^ bits ) * 16777619u;
+            hash ^= hash >> 15;
+        }
+    }
+
+    return hash;
+}
+
+///
+// Compare all the attributes of two vertices.
+//
+// @param streams    - the attribute streams present in the shape
+// @param numStreams - how many streams there are
+// @param a          - the first vertex
+// @param b          - the second vertex
+//
+// @return true if the two vertices are bitwise identical
+///
+static inline bool sameVertex( const Stream *streams, int numStreams,
+                               GLuint a, GLuint b ) {
+    for( int s = 0; s < numStreams; s++ ) {
+        int n = streams[ s ].components;
+        const float *data = &( *streams[ s ].data )[ 0 ];
+
+        if( memcmp( data + a * n, data + b * n, n * sizeof( float ) ) != 0 ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+///
+// Merge the vertices of the shape whose position, color, normal and (u,v)
+// are all identical, and index the remaining vertices with the element
+// list of the Canvas.
+//
+// @param C - the Canvas to use
+///
+void weldVertices( Canvas &C ) {
+    int numElements = C.numIndices();
+    int numVertices = C.numVertices();
+
+    if( numElements < 1 ) {
+        return;
+    }
+
+    // the attribute streams which are present for every vertex
+    Stream streams[ 4 ];
+    int numStreams = collectStreams( C, streams );
+
+    // open-addressed table of the welded vertices, twice the vertex count
+    // rounded up to a power of two keeps the probe sequences short
+    size_t tableSize = 1;
+    while( tableSize < size_t( numVertices ) * 2 ) {
+        tableSize <<= 1;
+    }
+
+    const GLuint EMPTY = 0xffffffffu;
+    vector< GLuint > table( tableSize, EMPTY );
+
+    // the welded vertex each original vertex maps to, and the original
+    // vertex each welded vertex was taken from
+    vector< GLuint > remap( numVertices, EMPTY );
+    vector< GLuint > source;
+    source.reserve( numVertices );
+
+    for( int v = 0; v < numVertices; v++ ) {
+        size_t slot = hashVertex( streams, numStreams, v ) & ( tableSize - 1 );
+
+        while( table[ slot ] != EMPTY &&
+               !sameVertex( streams, numStreams,
+                            source[ table[ slot ] ], GLuint( v ) ) ) {
+            slot = ( slot + 1 ) & ( tableSize - 1 );
+        }
+
+        if( table[ slot ] == EMPTY ) {
+            table[ slot ] = GLuint( source.size() );
+            source.push_back( GLuint( v ) );
+        }
+
+        remap[ v ] = table[ slot ];
+    }
+
+    // rewrite the element list against the welded vertices
+    vector< GLuint > elements( numElements );
+    for( int i = 0; i < numElements; i++ ) {
+        elements[ i ] = remap[ vertexOf( C, i ) ];
+    }
+    C.elements.swap( elements );
+
+    // compact every stream down to the welded vertices; source is
+    // increasing, so each stream can be compacted in place
+    for( int s = 0; s < numStreams; s++ ) {
+        vector< float > &data = *streams[ s ].data;
+        int n = streams[ s ].components;
+
+        for( size_t w = 0; w < source.size(); w++ ) {
+            memmove( &data[ w * n ], &data[ source[ w ] * n ],
+                     n * sizeof( float ) );
+        }
+
+        data.resize( source.size() * n );
+    }
+}
+
+///
+// Score a vertex by how much drawing one of its triangles next would help,
+// after Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+//
+// @param cachePosition - position of the vertex in the LRU cache, -1 if
+//                        the vertex is not in it
+// @param remaining     - number of triangles of the vertex not yet drawn
+//
+// @return the score of the vertex
+///
+static float vertexScore( int cachePosition, int remaining ) {
+    if( remaining == 0 ) {
+        // no triangle left to draw, so no reason to pick it
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+
+    if( cachePosition >= 0 ) {
+        if( cachePosition < 3 ) {
+            // used by the last triangle, deliberately scored lower so the
+            // strip doesn't simply turn back on itself
+            score = 0.75f;
+        } else {
+            float scale = 1.0f / ( VCACHE_SIZE - 3 );
+            score = powf( 1.0f - ( cachePosition - 3 ) * scale, 1.5f );
+        }
+    }
+
+    // favour vertices with few triangles left, to finish them off
+    score += 2.0f * powf( float( remaining ), -0.5f );
+
+    return score;
+}
+
+///
+// Reorder the triangles of an indexed shape so consecutive triangles reuse
+// the vertices still held in the post-transform cache.
+//
+// @param C - the Canvas to use
+///
+void optimizeVertexCache( Canvas &C ) {
+    int numElements = int( C.elements.size() );
+    int numVertices = C.numVertices();
+    int numTriangles = numElements / 3;
+
+    if( numTriangles < 2 ) {
+        return;
+    }
+
+    // triangles of each vertex; the first remaining[v] entries of a
+    // vertex's range are the ones not yet drawn
+    vector< int > offsets( numVertices + 1, 0 );
+    vector< int > remaining( numVertices, 0 );
+
+    for( int i = 0; i < numElements; i++ ) {
+        remaining[ C.elements[ i ] ]++;
+    }
+
+    for( int v = 0; v < numVertices; v++ ) {
+        offsets[ v + 1 ] = offsets[ v ] + remaining[ v ];
+    }
+
+    vector< int > adjacency( numElements );
+    vector< int > fill( offsets.begin(), offsets.end() - 1 );
+
+    for( int i = 0; i < numElements; i++ ) {
+        adjacency[ fill[ C.elements[ i ] ]++ ] = i / 3;
+    }
+
+    // scores of the vertices and triangles
+    vector< int > cachePosition( numVertices, -1 );
+    vector< float > score( numVertices );
+    vector< float > triangleScore( numTriangles, 0.0f );
+    vector< bool > drawn( numTriangles, false );
+
+    for( int v = 0; v < numVertices; v++ ) {
+        score[ v ] = vertexScore( -1, remaining[ v ] );
+    }
+
+    for( int i = 0; i < numElements; i++ ) {
+        triangleScore[ i / 3 ] += score[ C.elements[ i ] ];
+    }
+
+    // the simulated LRU cache, with room for the three vertices pushed
+    // out by each new triangle
+    vector< int > cache, nextCache;
+    cache.reserve( VCACHE_SIZE + 3 );
+    nextCache.reserve( VCACHE_SIZE + 3 );
+
+    vector< GLuint > elements;
+    elements.reserve( numElements );
+
+    int best = -1;
+    // where the search for a fresh start resumes when the cache runs dry
+    int cursor = 0;
+
+    for( int t = 0; t < numTriangles; t++ ) {
+        if( best < 0 ) {
+            // no triangle touches the cache, start from the best remaining
+            float bestScore = -1.0f;
+
+            while( drawn[ cursor ] ) {
+                cursor++;
+            }
+
+            for( int i = cursor; i < numTriangles; i++ ) {
+                if( !drawn[ i ] && triangleScore[ i ] > bestScore ) {
+                    bestScore = triangleScore[ i ];
+                    best = i;
+                }
+            }
+        }
+
+        // draw the triangle
+        drawn[ best ] = true;
+        nextCache.clear();
+
+        for( int c = 0; c < 3; c++ ) {
+            GLuint v = C.elements[ best * 3 + c ];
+            elements.push_back( v );
+            nextCache.push_back( int( v ) );
+
+            // move the triangle out of the remaining part of the range
+            int *first = &adjacency[ offsets[ v ] ];
+            int last = --remaining[ v ];
+            for( int k = 0; k <= last; k++ ) {
+                if( first[ k ] == best ) {
+                    first[ k ] = first[ last ];
+                    first[ last ] = best;
+                    break;
+                }
+            }
+        }
+
+        // the rest of the cache moves back behind the new triangle
+        for( size_t c = 0; c < cache.size(); c++ ) {
+            int v = cache[ c ];
+            if( v != nextCache[ 0 ] && v != nextCache[ 1 ] &&
+                v != nextCache[ 2 ] ) {
+                nextCache.push_back( v );
+            }
+        }
+
+        // rescore the cached vertices, and the ones just pushed out
+        for( size_t c = 0; c < nextCache.size(); c++ ) {
+            int v = nextCache[ c ];
+            cachePosition[ v ] = c < size_t( VCACHE_SIZE ) ? int( c ) : -1;
+
+            float newScore = vertexScore( cachePosition[ v ], remaining[ v ] );
+            float delta = newScore - score[ v ];
+            score[ v ] = newScore;
+
+            for( int k = 0; k < remaining[ v ]; k++ ) {
+                triangleScore[ adjacency[ offsets[ v ] + k ] ] += delta;
+            }
+        }
+
+        if( nextCache.size() > size_t( VCACHE_SIZE ) ) {
+            nextCache.resize( VCACHE_SIZE );
+        }
+        cache.swap( nextCache );
+
+        // the next triangle is the best one touching the cache
+        best = -1;
+        float bestScore = -1.0f;
+
+        for( size_t c = 0; c < cache.size(); c++ ) {
+            int v = cache[ c ];
+
+            for( int k = 0; k < remaining[ v ]; k++ ) {
+                int i = adjacency[ offsets[ v ] + k ];
+                if( triangleScore[ i ] > bestScore ) {
+                    bestScore = triangleScore[ i ];
+                    best = i;
+                }
+            }
+        }
+    }
+
+    C.elements.swap( elements );
+}
+
+///
+// Renumber the vertices of an indexed shape in the order the triangles
+// first use them, so vertex fetch walks the buffer front to back.
+// Vertices no triangle uses are dropped.
+//
+// @param C - the Canvas to use
+///
+void optimizeVertexFetch( Canvas &C ) {
+    int numElements = int( C.elements.size() );
+    int numVertices = C.numVertices();
+
+    if( numElements < 1 ) {
+        return;
+    }
+
+    const GLuint UNUSED = 0xffffffffu;
+    vector< GLuint > remap( numVertices, UNUSED );
+    vector< GLuint > source;
+    source.reserve( numVertices );
+
+    for( int i = 0; i < numElements; i++ ) {
+        GLuint &v = C.elements[ i ];
+
+        if( remap[ v ] == UNUSED ) {
+            remap[ v ] = GLuint( source.size() );
+            source.push_back( v );
+        }
+
+        v = remap[ v ];
+    }
+
+    // gather every stream into the new vertex order
+    Stream streams[ 4 ];
+    int numStreams = collectStreams( C, streams );
+
+    for( int s = 0; s < numStreams; s++ ) {
+        vector< float > &data = *streams[ s ].data;
+        int n = streams[ s ].components;
+        vector< float > ordered( source.size() * n );
+
+        for( size_t w = 0; w < source.size(); w++ ) {
+            memcpy( &ordered[ w * n ], &data[ source[ w ] * n ],
+                    n * sizeof( float ) );
+        }
+
+        data.swap( ordered );
+    }
+}
+
+///
+// Measure how well an indexed shape uses a FIFO post-transform cache.
+//
+// @param C         - the Canvas to use
+// @param cacheSize - number of vertices the simulated cache holds
+// @param acmr      - receives the average cache miss ratio, the number of
+//                    vertices transformed per triangle
+// @param atvr      - receives the average transformed vertex ratio, the
+//                    number of vertices transformed per vertex
+///
+void analyzeVertexCache( Canvas &C, int cacheSize, float &acmr,
+                         float &atvr ) {
+    int numElements = C.numIndices();
+    int numVertices = C.numVertices();
+
+    acmr = atvr = 0.0f;
+
+    if( numElements < 3 || numVertices < 1 ) {
+        return;
+    }
+
+    // the time each vertex entered the cache, it is still in the cache
+    // if fewer than cacheSize misses happened since
+    vector< int > entered( numVertices, -cacheSize - 1 );
+    int misses = 0;
+
+    for( int i = 0; i < numElements; i++ ) {
+        GLuint v = vertexOf( C, i );
+
+        if( misses - entered[ v ] > cacheSize ) {
+            entered[ v ] = misses;
+            misses++;
+        }
+    }
+
+    acmr = float( misses ) / float( numElements / 3 );
+    atvr = float( misses ) / float( numVertices );
+}
+
+///
+// Feed the three vertices of a triangle through a simulated FIFO cache.
+//
+// @param C         - the Canvas to use
+// @param t         - which triangle
+// @param cacheSize - number of vertices the cache holds
+// @param entered   - the time each vertex entered the cache
+// @param time      - the current time, advanced by every miss
+//
+// @return the number of vertices of the triangle that missed the cache
+///
+static inline int cacheTriangle( Canvas &C, int t, int cacheSize,
+                                 vector< int > &entered, int &time ) {
+    int misses = 0;
+
+    for( int c = 0; c < 3; c++ ) {
+        GLuint v = C.elements[ t * 3 + c ];
+
+        if( time - entered[ v ] > cacheSize ) {
+            entered[ v ] = time++;
+            misses++;
+        }
+    }
+
+    return misses;
+}
+
+///
+// Reorder the triangles of an indexed shape so the surfaces which face
+// away from the center of the shape are drawn first and occlude the rest,
+// after Sander, Nehab and Barczak's "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw".  Should follow optimizeVertexCache(),
+// whose order is kept inside each cluster of triangles.
+//
+// @param C         - the Canvas to use
+// @param cacheSize - number of vertices in the FIFO cache the clusters are
+//                    measured against
+// @param threshold - how much worse than the vertex cache order each
+//                    cluster's cache miss ratio may become, 1.05 allows 5%
+///
+void optimizeOverdraw( Canvas &C, int cacheSize, float threshold ) {
+    int numVertices = C.numVertices();
+    int numTriangles = int( C.elements.size() ) / 3;
+
+    if( numTriangles < 2 ) {
+        return;
+    }
+
+    vector< int > entered( numVertices, -cacheSize - 1 );
+    int time = 0;
+
+    // hard boundaries, where a triangle misses on all three vertices and
+    // so starts a new patch of the surface
+    vector< int > hard;
+    for( int t = 0; t < numTriangles; t++ ) {
+        if( cacheTriangle( C, t, cacheSize, entered, time ) == 3 ||
+            t == 0 ) {
+            hard.push_back( t );
+        }
+    }
+    hard.push_back( numTriangles );
+
+    // soft boundaries, splitting each patch into the smallest clusters
+    // which still reach the patch's cache miss ratio within the threshold
+    vector< int > clusters;
+
+    for( size_t h = 0; h + 1 < hard.size(); h++ ) {
+        int start = hard[ h ];
+        int end = hard[ h + 1 ];
+
+        // a flushed cache for every measurement
+        time += cacheSize + 1;
+        int misses = 0;
+        for( int t = start; t < end; t++ ) {
+            misses += cacheTriangle( C, t, cacheSize, entered, time );
+        }
+
+        float limit = threshold * float( misses ) / float( end - start );
+
+        clusters.push_back( start );
+
+        time += cacheSize + 1;
+        int runningMisses = 0;
+        int runningTriangles = 0;
+
+        for( int t = start; t < end; t++ ) {
+            runningMisses += cacheTriangle( C, t, cacheSize, entered, time );
+            runningTriangles++;
+
+            if( float( runningMisses ) / float( runningTriangles ) <= limit ) {
+                // good enough, start a new cluster with the next triangle
+                clusters.push_back( t + 1 );
+                time += cacheSize + 1;
+                runningMisses = 0;
+                runningTriangles = 0;
+            }
+        }
+
+        // the leftover cluster is usually a few badly cached triangles, so
+        // merge it into the last complete one
+        if( clusters.back() != start ) {
+            clusters.pop_back();
+        }
+    }
+    clusters.push_back( numTriangles );
+
+    int numClusters = int( clusters.size() ) - 1;
+
+    // the centroid of the whole shape
+    glm::vec3 center( 0.0f );
+    for( int v = 0; v < numVertices; v++ ) {
+        center += glm::vec3( C.points[ v * 4 ], C.points[ v * 4 + 1 ],
+                             C.points[ v * 4 + 2 ] );
+    }
+    center /= float( numVertices );
+
+    // sort key of each cluster, how far its area-weighted centroid lies
+    // out along its area-weighted normal
+    vector< pair< float, int > > order( numClusters );
+
+    for( int k = 0; k < numClusters; k++ ) {
+        glm::vec3 centroid( 0.0f );
+        glm::vec3 normal( 0.0f );
+        float area = 0.0f;
+
+        for( int t = clusters[ k ]; t < clusters[ k + 1 ]; t++ ) {
+            glm::vec3 p[ 3 ];
+            for( int c = 0; c < 3; c++ ) {
+                GLuint v = C.elements[ t * 3 + c ];
+                p[ c ] = glm::vec3( C.points[ v * 4 ], C.points[ v * 4 + 1 ],
+                                    C.points[ v * 4 + 2 ] );
+            }
+
+            // twice the area, in the direction of the face normal
+            glm::vec3 n = glm::cross( p[ 1 ] - p[ 0 ], p[ 2 ] - p[ 0 ] );
+            float a = glm::length( n );
+
+            centroid += ( p[ 0 ] + p[ 1 ] + p[ 2 ] ) * ( a / 3.0f );
+            normal += n;
+            area += a;
+        }
+
+        float key = 0.0f;
+        float length = glm::length( normal );
+
+        if( area > 0.0f && length > 0.0f ) {
+            key = glm::dot( centroid / area - center, normal / length );
+        }
+
+        // negated, so the outermost clusters sort first
+        order[ k ] = make_pair( -key, k );
+    }
+
+    stable_sort( order.begin(), order.end() );
+
+    vector< GLuint > elements;
+    elements.reserve( C.elements.size() );
+
+    for( int k = 0; k < numClusters; k++ ) {
+        int cluster = order[ k ].second;
+        elements.insert( elements.end(),
+                         C.elements.begin() + clusters[ cluster ] * 3,
+                         C.elements.begin() + clusters[ cluster + 1 ] * 3 );
+    }
+
+    C.elements.swap( elements );
+}
@@ -0,0 +1,68 @@
+//
+// MeshOptimizer.h
+//
+// Processing passes that turn the triangle soup held in a Canvas into an
+// indexed mesh suited to the GPU.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _MESHOPTIMIZER_H_
+#define _MESHOPTIMIZER_H_
+
+#include "Canvas.h"
+
+///
+// Merge the vertices of the shape whose position, color, normal and (u,v)
+// are all identical, and index the remaining vertices with the element
+// list of the Canvas.
+//
+// @param C - the Canvas to use
+///
+void weldVertices( Canvas &C );
+
+///
+// Reorder the triangles of an indexed shape so consecutive triangles reuse
+// the vertices still held in the post-transform cache.
+//
+// @param C - the Canvas to use
+///
+void optimizeVertexCache( Canvas &C );
+
+///
+// Renumber the vertices of an indexed shape in the order the triangles
+// first use them, so vertex fetch walks the buffer front to back.
+// Vertices no triangle uses are dropped.
+//
+// @param C - the Canvas to use
+///
+void optimizeVertexFetch( Canvas &C );
+
+///
+// Reorder the triangles of an indexed shape so the surfaces which face
+// away from the center of the shape are drawn first and occlude the rest.
+// Should follow optimizeVertexCache(), whose order is kept inside each
+// cluster of triangles.
+//
+// @param C         - the Canvas to use
+// @param cacheSize - number of vertices in the FIFO cache the clusters are
+//                    measured against
+// @param threshold - how much worse than the vertex cache order each
+//                    cluster's cache miss ratio may become, 1.05 allows 5%
+///
+void optimizeOverdraw( Canvas &C, int cacheSize, float threshold );
+
+///
+// Measure how well an indexed shape uses a FIFO post-transform cache.
+//
+// @param C         - the Canvas to use
+// @param cacheSize - number of vertices the simulated cache holds
+// @param acmr      - receives the average cache miss ratio, the number of
+//                    vertices transformed per triangle
+// @param atvr      - receives the average transformed vertex ratio, the
+//                    number of vertices transformed per vertex
+///
+void analyzeVertexCache( Canvas &C, int cacheSize, float &acmr,
+                         float &atvr );
+
+#endif
@@ -0,0 +1,264 @@
+//
+// MeshRegistry.cpp
+//
+// Reference-counted buffers of the shapes in the scene, so objects drawing
+// the same shape share one upload of it.
+//
+// Author:  Jietong Chen
+//
+
+#include <algorithm>
+#include <map>
+
+#include "AssetPack.h"
+#include "BufferArena.h"
+#include "MeshRegistry.h"
+#include "Shapes.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+///
+// A shape uploaded to the GPU, and the number of references to it.
+///
+struct MeshEntry {
+    BufferSet *buffers;
+    int refs;
+};
+
+///
+// Get the registry of uploaded shapes, keyed by shape.
+//
+// Never destroyed, since objects released during static destruction may
+// still reach it.
+//
+// @return the registry
+///
+static map< int, MeshEntry > &registry() {
+    static map< int, MeshEntry > *meshes = new map< int, MeshEntry >();
+
+    return *meshes;
+}
+
+///
+// Find the entry of uploaded buffers.
+//
+// @param mesh - the buffers to look for
+//
+// @return the entry, or the end of the registry
+///
+static map< int, MeshEntry >::iterator findMesh( BufferSet *mesh ) {
+    map< int, MeshEntry > &meshes = registry();
+    map< int, MeshEntry >::iterator it = meshes.begin();
+
+    while( it != meshes.end() && it->second.buffers != mesh ) {
+        ++it;
+    }
+
+    return it;
+}
+
+///
+// Get the buffers of a shape, shared by every object drawing it.
+//
+// @param shape - which shape to get
+// @param C     - the Canvas to make the shape in, left clear
+//
+// @return the buffers, with one more reference held for the caller
+///
+BufferSet *acquireMesh( int shape, Canvas &C ) {
+    map< int, MeshEntry > &meshes = registry();
+    map< int, MeshEntry >::iterator it = meshes.find( shape );
+
+    if( it != meshes.end() ) {
+        it->second.refs++;
+        return it->second.buffers;
+    }
+
+    MeshEntry entry;
+    entry.buffers = new BufferSet();
+    entry.refs = 1;
+
+    // a cooked shape is uploaded as it is, with nothing to make
+    if( !loadPackedMesh( shape, *entry.buffers ) ) {
+        C.clear();
+        makeShape( shape, C );
+
+        // the buffers own the shape from here on, so the Canvas lets go of it
+        CanvasStreams streams;
+        C.takeStreams( streams );
+
+        entry.buffers->createBuffers( streams );
+    }
+
+    meshes[ shape ] = entry;
+
+    return entry.buffers;
+}
+
+///
+// Make the shapes not uploaded yet, on the thread pool, and upload
+// them, so acquireMesh() finds them made.  Until then they are held with
+// no reference.
+//
+// The shapes in the asset pack are uploaded from it first; only the rest
+// are made, on the shared pool; the buffers are made here, on the thread
+// owning the GL context.
+//
+// @param shapes - the shapes to make
+///
+void preloadMeshes( const vector< int > &shapes ) {
+    map< int, MeshEntry > &meshes = registry();
+    vector< int > missing;
+
+    for( size_t i = 0; i < shapes.size(); i++ ) {
+        if( meshes.find( shapes[ i ] ) != meshes.end() ||
+            find( missing.begin(), missing.end(), shapes[ i ] ) !=
+            missing.end() ) {
+            continue;
+        }
+
+        BufferSet *buffers = new BufferSet();
+
+        if( loadPackedMesh( shapes[ i ], *buffers ) ) {
+            MeshEntry entry;
+            entry.buffers = buffers;
+            entry.refs = 0;
+
+            meshes[ shapes[ i ] ] = entry;
+        } else {
+            delete buffers;
+            missing.push_back( shapes[ i ] );
+        }
+    }
+
+    if( missing.empty() ) {
+        return;
+    }
+
+    vector< CanvasStreams > streams( missing.size() );
+
+    JobGroup makes( ThreadPool::shared() );
+
+    for( size_t i = 0; i < missing.size(); i++ ) {
+        makes.submit( [ &, i ]() {
+            Canvas C( 1, 1 );
+            makeShape( missing[ i ], C );
+            C.takeStreams( streams[ i ] );
+        } );
+    }
+
+    makes.wait();
+
+    for( size_t i = 0; i < missing.size(); i++ ) {
+        MeshEntry entry;
+        entry.buffers = new BufferSet();
+        entry.buffers->createBuffers( streams[ i ] );
+        entry.refs = 0;
+
+        meshes[ missing[ i ] ] = entry;
+    }
+}
+
+///
+// Make the buffers of a shape again, as it is processed now, in place, so
+// every object and batch drawing it keeps the same BufferSet.
+//
+// The shape comes back at other ranges of the arena, possibly in another
+// page, so what was recorded from the old ones must be made again.
+//
+// @param shape - which shape to make again
+//
+// @return the buffers, or NULL if the shape is not uploaded
+///
+BufferSet *remakeMesh( int shape ) {
+    map< int, MeshEntry > &meshes = registry();
+    map< int, MeshEntry >::iterator it = meshes.find( shape );
+
+    if( it == meshes.end() ) {
+        return NULL;
+    }
+
+    BufferSet *mesh = it->second.buffers;
+
+    if( mesh->bufferInit ) {
+        arenaRelease( *mesh );
+    }
+    mesh->initBuffer();
+
+    // the pack holds the shape only if it was cooked processed the same way
+    if( !loadPackedMesh( shape, *mesh ) ) {
+        Canvas C( 1, 1 );
+        makeShape( shape, C );
+
+        CanvasStreams streams;
+        C.takeStreams( streams );
+
+        mesh->createBuffers( streams );
+    }
+
+    return mesh;
+}
+
+///
+// Hold one more reference to the buffers of a shape.
+//
+// @param mesh - buffers returned by acquireMesh(), or NULL
+///
+void retainMesh( BufferSet *mesh ) {
+    if( mesh == NULL ) {
+        return;
+    }
+
+    map< int, MeshEntry >::iterator it = findMesh( mesh );
+
+    if( it != registry().end() ) {
+        it->second.refs++;
+    }
+}
+
+///
+// Drop one reference to the buffers of a shape.
+//
+// @param mesh - buffers returned by acquireMesh(), or NULL
+///
+void releaseMesh( BufferSet *mesh ) {
+    if( mesh == NULL ) {
+        return;
+    }
+
+    map< int, MeshEntry >::iterator it = findMesh( mesh );
+
+    if( it == registry().end() || --it->second.refs > 0 ) {
+        return;
+    }
+
+    // the page keeps its buffers while other shapes are in it
+    if( mesh->bufferInit ) {
+        arenaRelease( *mesh );
+    }
+
+    delete mesh;
+    registry().erase( it );
+}
+
+///
+// Get the number of shapes held by the registry, and the bytes of buffer
+// memory they use.
+//
+// @param numMeshes - receives the number of shapes
+// @param numBytes  - receives the total size of their buffers
+///
+void meshUsage( int &numMeshes, long &numBytes ) {
+    map< int, MeshEntry > &meshes = registry();
+
+    numMeshes = int( meshes.size() );
+    numBytes = 0;
+
+    for( map< int, MeshEntry >::iterator it = meshes.begin();
+         it != meshes.end(); ++it ) {
+        BufferSet *mesh = it->second.buffers;
+        numBytes += mesh->vSize + mesh->cSize + mesh->nSize + mesh->tSize +
+                    mesh->eSize;
+    }
+}
@@ -0,0 +1,72 @@
+//
+// MeshRegistry.h
+//
+// Reference-counted buffers of the shapes in the scene, so objects drawing
+// the same shape share one upload of it.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _MESHREGISTRY_H_
+#define _MESHREGISTRY_H_
+
+#include <vector>
+
+#include "Buffers.h"
+#include "Canvas.h"
+
+///
+// Get the buffers of a shape, shared by every object drawing it. The shape
+// is made and uploaded only the first time it is asked for.
+//
+// @param shape - which shape to get
+// @param C     - the Canvas to make the shape in, left clear
+//
+// @return the buffers, with one more reference held for the caller
+///
+BufferSet *acquireMesh( int shape, Canvas &C );
+
+///
+// Make the shapes not uploaded yet, on the thread pool, and upload
+// them, so acquireMesh() finds them made.  Until then they are held with
+// no reference.
+//
+// @param shapes - the shapes to make
+///
+void preloadMeshes( const vector< int > &shapes );
+
+///
+// Make the buffers of a shape again, as it is processed now, in place, so
+// every object and batch drawing it keeps the same BufferSet.
+//
+// @param shape - which shape to make again
+//
+// @return the buffers, or NULL if the shape is not uploaded
+///
+BufferSet *remakeMesh( int shape );
+
+///
+// Hold one more reference to the buffers of a shape.
+//
+// @param mesh - buffers returned by acquireMesh(), or NULL
+///
+void retainMesh( BufferSet *mesh );
+
+///
+// Drop one reference to the buffers of a shape, deleting them with the
+// last one.
+//
+// @param mesh - buffers returned by acquireMesh(), or NULL
+///
+void releaseMesh( BufferSet *mesh );
+
+///
+// Get the number of shapes held by the registry, and the bytes of buffer
+// memory they use.
+//
+// @param numMeshes - receives the number of shapes
+// @param numBytes  - receives the total size of their buffers
+///
+void meshUsage( int &numMeshes, long &numBytes );
+
+#endif
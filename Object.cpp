@@ -3,20 +3,24 @@
 //
 
 #include <glm/gtc/type_ptr.hpp>
-#include <glm/gtc/matrix_inverse.hpp>
 
 #include "Object.h"
-#include "Camera.h"
-#include "Lighting.h"
+#include "BufferArena.h"
+#include "MeshRegistry.h"
+#include "ProgramInfo.h"
+#include "RenderState.h"
 #include "Textures.h"
+#include "Transforms.h"
+#include "UniformBlocks.h"
 
-// How to calculate an offset into the vertex buffer
+// How to calculate an offset into the element buffer
 #define BUFFER_OFFSET( i ) ((char *)NULL + (i))
 
 ///
 // Default constructor
 ///
-Object::Object() {
+Object::Object() : slot( -1 ), name( "" ), bufferSet( NULL ),
+    pass( PASS_OPAQUE ), moved( true ), transform( NULL ) {
 }
 
 ///
@@ -24,20 +28,74 @@ Object::Object() {
 //
 // @param program - the ID of an OpenGL (GLSL) shader program to which
 //     parameter values are to be sent
-// @param C       - the Canvas to use
+// @param shape   - which shape the object draws
+// @param C       - the Canvas to make the shape in, if it has not been
+//     uploaded yet
 ///
-Object::Object( GLuint program, Canvas &C ) {
-    this->bufferSet.createBuffers( C );
+Object::Object( GLuint program, int shape, Canvas &C ) :
+    slot( -1 ), name( "" ) {
+    this->bufferSet = acquireMesh( shape, C );
+    this->pass = PASS_OPAQUE;
     this->program = program;
     this->texture = 0;
     this->Model = mat4( 1.0f );
+    this->moved = true;
+    this->transform = NULL;
+}
+
+///
+// Copy constructor, sharing the buffers of the other object
+//
+// @param other - the object to copy
+///
+Object::Object( const Object &other ) :
+    slot( other.slot ), slotMaterial( other.slotMaterial ),
+    name( other.name ), bufferSet( other.bufferSet ),
+    material( other.material ), pass( other.pass ), program( other.program ),
+    texture( other.texture ), Model( other.Model ), moved( other.moved ),
+    transform( other.transform ) {
+    retainMesh( bufferSet );
+}
+
+///
+// Assignment operator, sharing the buffers of the other object
+//
+// @param other - the object to copy
+//
+// @return this object
+///
+Object &Object::operator=( const Object &other ) {
+    // retain first, in case both already share the buffers
+    retainMesh( other.bufferSet );
+    releaseMesh( bufferSet );
+
+    slot = other.slot;
+    slotMaterial = other.slotMaterial;
+    name = other.name;
+    bufferSet = other.bufferSet;
+    material = other.material;
+    pass = other.pass;
+    program = other.program;
+    texture = other.texture;
+    Model = other.Model;
+    moved = other.moved;
+    transform = other.transform;
+
+    return *this;
+}
+
+///
+// Destructor
+///
+Object::~Object() {
+    releaseMesh( bufferSet );
 }
 
 ///
 // Draw the object.
 ///
 void Object::drawObject() {
-    glUseProgram( program );
+    useProgram( program );
 
     // set up the buffer
     setUpBuffer();
@@ -45,8 +103,6 @@ void Object::drawObject() {
     setUpMatrix();
     // set up the surface material
     setUpMaterial();
-    // set up the lighting properties
-    setUpLight( program );
 
     // the object has texture
     if( texture != 0 ) {
@@ -54,104 +110,103 @@ void Object::drawObject() {
         setUpTexture( texture );
     }
 
-    // draw it
-    glDrawElements( GL_TRIANGLES, bufferSet.numElements,
-                    GL_UNSIGNED_INT, ( void * ) 0 );
+    // draw it, from its ranges of the page
+    if( bufferSet->baseVertex != 0 ) {
+        glDrawElementsBaseVertex( GL_TRIANGLES, bufferSet->numElements,
+                                  bufferSet->eType,
+                                  BUFFER_OFFSET( bufferSet->eFirst ),
+                                  bufferSet->baseVertex );
+    } else {
+        glDrawElements( GL_TRIANGLES, bufferSet->numElements,
+                        bufferSet->eType,
+                        BUFFER_OFFSET( bufferSet->eFirst ) );
+    }
 }
 
 ///
-// Set up the buffer.
+// Draw several copies of the shape of the object in one call, each with
+// its own transformation and material.
+//
+// @param prog  - the instanced variant of the program of the object
+// @param vao   - vertex array object reading the shape of the object and
+//                one InstanceData record per copy
+// @param count - number of copies
 ///
-void Object::setUpBuffer() {
-    // bind the buffers
-    glBindBuffer( GL_ARRAY_BUFFER, bufferSet.vbuffer );
-    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, bufferSet.ebuffer );
-
-    // set up the vertex attribute variables
-    GLint vPosition = glGetAttribLocation( program, "vPosition" );
-    glEnableVertexAttribArray( vPosition );
-    glVertexAttribPointer( vPosition, 4, GL_FLOAT, GL_FALSE, 0,
-                           BUFFER_OFFSET( 0 ) );
-    int offset = bufferSet.vSize;
-
-    if( bufferSet.cSize ) {  // color data
-        GLint vColor = glGetAttribLocation( program, "vColor" );
-        glEnableVertexAttribArray( vColor );
-        glVertexAttribPointer( vColor, 4, GL_FLOAT, GL_FALSE, 0,
-                               BUFFER_OFFSET( offset ) );
-        offset += bufferSet.cSize;
-    }
+void Object::drawInstanced( GLuint prog, GLuint vao, int count ) {
+    useProgram( prog );
 
-    if( bufferSet.nSize ) {  // normal data
-        GLint vNormal = glGetAttribLocation( program, "vNormal" );
-        glEnableVertexAttribArray( vNormal );
-        glVertexAttribPointer( vNormal, 3, GL_FLOAT, GL_FALSE, 0,
-                               BUFFER_OFFSET( offset ) );
-        offset += bufferSet.nSize;
+    // set up the shape and the per-copy attributes; the camera, lights
+    // and materials are in the uniform blocks
+    bindVertexArray( vao );
+
+    if( texture != 0 ) {
+        setUpTexture( texture );
     }
 
-    if( bufferSet.tSize ) {  // texture coordinate data
-        GLint vTexCoord = glGetAttribLocation( program, "vTexCoord" );
-        glEnableVertexAttribArray( vTexCoord );
-        glVertexAttribPointer( vTexCoord, 2, GL_FLOAT, GL_FALSE, 0,
-                               BUFFER_OFFSET( offset ) );
-        offset += bufferSet.tSize;
+#ifndef __APPLE__
+    // draw them
+    if( bufferSet->baseVertex != 0 ) {
+        glDrawElementsInstancedBaseVertex( GL_TRIANGLES,
+                                           bufferSet->numElements,
+                                           bufferSet->eType,
+                                           BUFFER_OFFSET( bufferSet->eFirst ),
+                                           count, bufferSet->baseVertex );
+    } else {
+        glDrawElementsInstanced( GL_TRIANGLES, bufferSet->numElements,
+                                 bufferSet->eType,
+                                 BUFFER_OFFSET( bufferSet->eFirst ), count );
     }
+#endif
 }
 
 ///
-// Set up the model, view, projection matrix.
+// Get the slot of the material of the object in the material table.
+//
+// @return the index into the Materials block
 ///
-void Object::setUpMatrix() {
-    extern Camera camera[3];
-    extern int currentCamera;
-
-    // the viewing matrix of current camera
-    mat4 View = camera[ currentCamera ].getViewMat();
-
-    // the projection matrix of current camera
-    mat4 Projection = camera[ currentCamera ].getProjectionMat();
-
-    // the normal matrix
-    mat3 Normal = mat3( inverseTranspose( View * Model ) );
-
-    // set up the model matrix
-    glUniformMatrix4fv( glGetUniformLocation( program, "modelMat" ),
-                        1, GL_FALSE, value_ptr( Model ) );
+int Object::materialIndex() {
+    // only look the material up again once it has changed
+    if( slot < 0 || !sameMaterial( slotMaterial, material ) ) {
+        slot = materialSlot( material );
+        slotMaterial = material;
+    }
 
-    // set up the viewing matrix
-    glUniformMatrix4fv( glGetUniformLocation( program, "viewMat" ),
-                        1, GL_FALSE, value_ptr( View ) );
+    return slot;
+}
 
-    // set up the projection matrix
-    glUniformMatrix4fv( glGetUniformLocation( program, "projectionMat" ),
-                        1, GL_FALSE, value_ptr( Projection ) );
+///
+// Set up the buffer.
+///
+void Object::setUpBuffer() {
+    // the attribute layout was recorded when the page was made, and is
+    // shared by every shape of the page
+    bindVertexArray( arenaPage( bufferSet->page ).vao );
+}
 
-    // set up the normal matrix
-    glUniformMatrix3fv( glGetUniformLocation( program, "normalMat" ),
-                        1, GL_FALSE, value_ptr( Normal ) );
+///
+// Set up the model and normal matrix.
+///
+void Object::setUpMatrix() {
+    // the matrices of the transform pass, with the camera of the frame
+    // already multiplied in
+    const ProgramInfo &info = programInfo( program );
+
+    // set up the model view and model view projection matrices
+    glUniformMatrix4fv( info.modelViewMat, 1, GL_FALSE,
+                        value_ptr( transform->ModelView ) );
+    glUniformMatrix4fv( info.mvpMat, 1, GL_FALSE,
+                        value_ptr( transform->MVP ) );
+
+    // set up the normal matrix, in camera space
+    glUniformMatrix3fv( info.normalMat, 1, GL_FALSE,
+                        value_ptr( transform->NormalView ) );
 }
 
 ///
 // Set up the material properties.
 ///
 void Object::setUpMaterial() {
-    glUniform4fv( glGetUniformLocation( program, "material.ambient" ), 1,
-                  value_ptr( material.ambientColor ) );
-    glUniform4fv( glGetUniformLocation( program, "material.diffuse" ), 1,
-                  value_ptr( material.diffuseColor ) );
-    glUniform4fv( glGetUniformLocation( program, "material.specular" ), 1,
-                  value_ptr( material.specularColor ) );
-
-    glUniform1f( glGetUniformLocation( program, "material.ka" ),
-                 material.ka );
-    glUniform1f( glGetUniformLocation( program, "material.kd" ),
-                 material.kd );
-    glUniform1f( glGetUniformLocation( program, "material.ks" ),
-                 material.ks );
-
-    glUniform1f( glGetUniformLocation( program, "material.shininess" ),
-                 material.shininess );
+    glUniform1i( programInfo( program ).materialSlot, materialIndex() );
 }
 
 ///
@@ -159,6 +214,7 @@ void Object::setUpMaterial() {
 ///
 void Object::reset() {
     Model = mat4( 1.0f );
+    moved = true;
 }
 
 ///
@@ -176,6 +232,7 @@ void Object::scale( GLfloat scaleX, GLfloat scaleY, GLfloat scaleZ ) {
     Scale[ 2 ][ 2 ] = scaleZ;
 
     Model = Scale * Model;
+    moved = true;
 }
 
 ///
@@ -194,6 +251,7 @@ void Object::translate( GLfloat translateX, GLfloat translateY,
     Translate[ 3 ][ 2 ] = translateZ;
 
     Model = Translate * Model;
+    moved = true;
 }
 
 ///
@@ -215,6 +273,7 @@ void Object::rotateX( GLfloat rX ) {
     RotateX[ 2 ][ 2 ] = cos;
 
     Model = RotateX * Model;
+    moved = true;
 }
 
 ///
@@ -236,6 +295,7 @@ void Object::rotateY( GLfloat rY ) {
     RotateY[ 2 ][ 2 ] = cos;
 
     Model = RotateY * Model;
+    moved = true;
 }
 
 ///
@@ -257,4 +317,5 @@ void Object::rotateZ( GLfloat rZ ) {
     RotateZ[ 1 ][ 1 ] = cos;
 
     Model = RotateZ * Model;
+    moved = true;
 }
@@ -13,6 +13,8 @@
 #include "Buffers.h"
 #include "Material.h"
 
+struct ObjectTransform;
+
 // Macros for object and shading selection
 #define OBJ_APPLE    0
 #define OBJ_COOKIES1 1
@@ -27,6 +29,11 @@
 #define OBJ_TABLE    10
 #define OBJ_TEAPOT   11
 
+// Macros for the render passes, drawn in this order
+#define PASS_OPAQUE      0    // solid objects
+#define PASS_CUTOUT      1    // alpha tested, with blended edges
+#define PASS_TRANSPARENT 2    // blended, drawn back to front
+
 ///
 // A simple object class with all properties needed to rendering an object.
 ///
@@ -40,7 +47,7 @@ private:
     void setUpBuffer();
 
     ///
-    // Set up the model, view, projection matrix.
+    // Set up the model and normal matrix.
     ///
     void setUpMatrix();
 
@@ -49,14 +56,26 @@ private:
     ///
     void setUpMaterial();
 
+    // slot of the material in the material table, -1 until it is drawn
+    int slot;
+
+    // the material the slot was found for
+    Material slotMaterial;
+
 public:
 
-    // buffer of
-    BufferSet bufferSet;
+    // the name of the object, for reporting
+    const char *name;
+
+    // buffers of the shape, shared with the other objects drawing it
+    BufferSet *bufferSet;
 
     // material properties
     Material material;
 
+    // the render pass drawing the object
+    int pass;
+
     // the ID of an OpenGL (GLSL) shader program
     GLuint program;
 
@@ -66,6 +85,14 @@ public:
     // Model transformation matrix
     mat4 Model;
 
+    // whether Model changed since the transform pass last read it; the
+    // transformations below set it, as must any other change of Model
+    bool moved;
+
+    // the matrices the transform pass computed for the object, NULL until
+    // it first ran
+    const ObjectTransform *transform;
+
     ///
     // Default constructor
     ///
@@ -76,15 +103,56 @@ public:
     //
     // @param program - the ID of an OpenGL (GLSL) shader program to which
     //     parameter values are to be sent
-    // @param C       - the Canvas to use
+    // @param shape   - which shape the object draws
+    // @param C       - the Canvas to make the shape in, if it has not been
+    //     uploaded yet
+    ///
+    Object( GLuint program, int shape, Canvas &C );
+
+    ///
+    // Copy constructor, sharing the buffers of the other object
+    //
+    // @param other - the object to copy
+    ///
+    Object( const Object &other );
+
     ///
-    Object( GLuint program, Canvas &C );
+    // Assignment operator, sharing the buffers of the other object
+    //
+    // @param other - the object to copy
+    //
+    // @return this object
+    ///
+    Object &operator=( const Object &other );
+
+    ///
+    // Destructor
+    ///
+    ~Object();
 
     ///
     // Draw the object.
     ///
     void drawObject();
 
+    ///
+    // Draw several copies of the shape of the object in one call, each
+    // with its own transformation and material.
+    //
+    // @param prog  - the instanced variant of the program of the object
+    // @param vao   - vertex array object reading the shape of the object
+    //                and one InstanceData record per copy
+    // @param count - number of copies
+    ///
+    void drawInstanced( GLuint prog, GLuint vao, int count );
+
+    ///
+    // Get the slot of the material of the object in the material table.
+    //
+    // @return the index into the Materials block
+    ///
+    int materialIndex();
+
     ///
     // Reset the model transformation of the object.
     ///
@@ -0,0 +1,430 @@
+//
+// Occlusion.cpp
+//
+// Software occlusion culling: the large opaque objects are rasterized into
+// a small depth buffer on the CPU, and the objects whose boxes lie behind
+// it are not drawn.
+//
+// Author:  Jietong Chen
+//
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "AssetPack.h"
+#include "Occlusion.h"
+#include "Shapes.h"
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+#include <xmmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+///
+// Constructor
+///
+OcclusionCuller::OcclusionCuller() : ViewProj( 1.0f ) {
+    // the levels down to a single row or column
+    int w = OCCLUSION_WIDTH, h = OCCLUSION_HEIGHT;
+
+    while( true ) {
+        levels.push_back( vector< float >( w * h, 1.0f ) );
+
+        if( w == 1 || h == 1 ) {
+            break;
+        }
+
+        w /= 2;
+        h /= 2;
+    }
+}
+
+///
+// Add the triangles of an object to the occluders.
+//
+// @param obj   - the object, opaque and placed
+// @param i     - index of the object
+// @param shape - which shape the object draws
+// @param C     - the Canvas to make the shape in, left clear
+///
+void OcclusionCuller::addOccluder( const Object &obj, int i, int shape,
+                                   Canvas &C ) {
+    occluderObject.push_back( i );
+    occluderModel.push_back( obj.Model );
+    occluderFirst.push_back( corners.size() );
+
+    // the cooked triangles need no shape made
+    size_t numCorners;
+    const float *cooked = packedCorners( shape, numCorners );
+
+    if( cooked != NULL ) {
+        for( size_t k = 0; k < numCorners; k++ ) {
+            const float *p = cooked + 3 * k;
+            corners.push_back( vec3( p[0], p[1], p[2] ) );
+            triangles.push_back( vec3( obj.Model * vec4( p[0], p[1], p[2],
+                                                         1.0f ) ) );
+        }
+
+        return;
+    }
+
+    C.clear();
+    makeShape( shape, C );
+
+    Span<float> points = C.vertexSpan();
+    Span<GLuint> elements = C.elementSpan();
+
+    for( size_t e = 0; e + 2 < elements.size; e += 3 ) {
+        for( int k = 0; k < 3; k++ ) {
+            const float *p = points.data + 4 * elements.data[ e + k ];
+            corners.push_back( vec3( p[0], p[1], p[2] ) );
+            triangles.push_back( vec3( obj.Model * vec4( p[0], p[1], p[2],
+                                                         1.0f ) ) );
+        }
+    }
+
+    C.clear();
+}
+
+///
+// Place again the triangles of the occluders whose objects moved.
+//
+// @param objects - the objects in the scene
+//
+// @return the number of occluders placed again
+///
+int OcclusionCuller::follow( const vector< Object > &objects ) {
+    int numPlaced = 0;
+
+    for( size_t o = 0; o < occluderObject.size(); o++ ) {
+        const mat4 &Model = objects[ occluderObject[ o ] ].Model;
+
+        if( Model == occluderModel[ o ] ) {
+            continue;
+        }
+
+        size_t last = o + 1 < occluderFirst.size() ? occluderFirst[ o + 1 ] :
+                      corners.size();
+
+        for( size_t k = occluderFirst[ o ]; k < last; k++ ) {
+            triangles[ k ] = vec3( Model * vec4( corners[ k ], 1.0f ) );
+        }
+
+        occluderModel[ o ] = Model;
+        numPlaced++;
+    }
+
+    return numPlaced;
+}
+
+///
+// Get the number of occluder triangles.
+//
+// @return the number of triangles
+///
+size_t OcclusionCuller::numTriangles( void ) const {
+    return triangles.size() / 3;
+}
+
+///
+// Draw a triangle into level 0.
+//
+// Pixels are covered when their centers are inside all three edges, and
+// the depth is a plane over the pixels, as device z is linear on screen.
+//
+// @param a - the first corner, as pixel x and y and device z
+// @param b - the second corner
+// @param c - the third corner
+///
+void OcclusionCuller::drawTriangle( vec3 a, vec3 b, vec3 c ) {
+    float area = ( b.x - a.x ) * ( c.y - a.y ) - ( b.y - a.y ) * ( c.x - a.x );
+
+    // back faces are culled, as they are when drawn; a camera inside an
+    // occluder sees out of it
+    if( area < 1e-6f ) {
+        return;
+    }
+
+    // the pixels of the bounding box, from a multiple of four
+    int x0 = std::max( 0, int( floorf( std::min( a.x,
+                                                 std::min( b.x, c.x ) ) ) ) )
+             & ~3;
+    int x1 = std::min( OCCLUSION_WIDTH - 1,
+                       int( ceilf( std::max( a.x, std::max( b.x, c.x ) ) ) ) );
+    int y0 = std::max( 0, int( floorf( std::min( a.y,
+                                                 std::min( b.y, c.y ) ) ) ) );
+    int y1 = std::min( OCCLUSION_HEIGHT - 1,
+                       int( ceilf( std::max( a.y, std::max( b.y, c.y ) ) ) ) );
+
+    if( x0 > x1 || y0 > y1 ) {
+        return;
+    }
+
+    // edge functions e = ex * x + ey * y + e0, positive inside; the edge
+    // across from a corner, over the area, is the weight of that corner
+    const vec3 *from[3] = { &b, &c, &a };
+    const vec3 *to[3] = { &c, &a, &b };
+    float ex[3], ey[3], e0[3];
+
+    for( int k = 0; k < 3; k++ ) {
+        ex[ k ] = from[ k ]->y - to[ k ]->y;
+        ey[ k ] = to[ k ]->x - from[ k ]->x;
+        e0[ k ] = -( ex[ k ] * from[ k ]->x + ey[ k ] * from[ k ]->y );
+    }
+
+    float zx = ( ex[0] * a.z + ex[1] * b.z + ex[2] * c.z ) / area;
+    float zy = ( ey[0] * a.z + ey[1] * b.z + ey[2] * c.z ) / area;
+    float z0 = ( e0[0] * a.z + e0[1] * b.z + e0[2] * c.z ) / area;
+
+    vector< float > &depth = levels[ 0 ];
+
+    for( int y = y0; y <= y1; y++ ) {
+        float py = float( y ) + 0.5f;
+        float *row = &depth[ y * OCCLUSION_WIDTH ];
+
+#ifdef OCCLUSION_SSE
+        __m128 zero = _mm_setzero_ps();
+        __m128 step = _mm_set_ps( 3.5f, 2.5f, 1.5f, 0.5f );
+        __m128 eRow[3], eStep[3];
+
+        for( int k = 0; k < 3; k++ ) {
+            eRow[ k ] = _mm_set1_ps( ey[ k ] * py + e0[ k ] );
+            eStep[ k ] = _mm_set1_ps( ex[ k ] );
+        }
+
+        __m128 zRow = _mm_set1_ps( zy * py + z0 );
+        __m128 zStep = _mm_set1_ps( zx );
+
+        for( int x = x0; x <= x1; x += 4 ) {
+            __m128 px = _mm_add_ps( _mm_set1_ps( float( x ) ), step );
+
+            __m128 inside = _mm_cmpge_ps(
+                _mm_add_ps( _mm_mul_ps( eStep[0], px ), eRow[0] ), zero );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps(
+                _mm_add_ps( _mm_mul_ps( eStep[1], px ), eRow[1] ), zero ) );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps(
+                _mm_add_ps( _mm_mul_ps( eStep[2], px ), eRow[2] ), zero ) );
+
+            if( _mm_movemask_ps( inside ) == 0 ) {
+                continue;
+            }
+
+            __m128 z = _mm_add_ps( _mm_mul_ps( zStep, px ), zRow );
+            __m128 old = _mm_loadu_ps( row + x );
+            __m128 nearer = _mm_min_ps( old, z );
+
+            _mm_storeu_ps( row + x, _mm_or_ps( _mm_and_ps( inside, nearer ),
+                                               _mm_andnot_ps( inside,
+                                                              old ) ) );
+        }
+#else
+        for( int x = x0; x <= x1; x++ ) {
+            float px = float( x ) + 0.5f;
+
+            if( ex[0] * px + ey[0] * py + e0[0] >= 0.0f &&
+                ex[1] * px + ey[1] * py + e0[1] >= 0.0f &&
+                ex[2] * px + ey[2] * py + e0[2] >= 0.0f ) {
+                row[ x ] = std::min( row[ x ], zx * px + zy * py + z0 );
+            }
+        }
+#endif
+    }
+}
+
+///
+// Clip a triangle to the view volume and draw what is left.
+//
+// Besides the near plane, the sides are clipped too, since corners far off
+// the screen make the edge functions lose the pixels to rounding.
+//
+// @param clip - the corners, in clip space
+///
+void OcclusionCuller::clipTriangle( const vec4 *clip ) {
+    // near, left, right, bottom and top; a point p is inside a plane when
+    // dot( plane, p ) >= 0
+    static const vec4 planes[5] = {
+        vec4( 0.0f, 0.0f, 1.0f, 1.0f ),
+        vec4( 1.0f, 0.0f, 0.0f, 1.0f ), vec4( -1.0f, 0.0f, 0.0f, 1.0f ),
+        vec4( 0.0f, 1.0f, 0.0f, 1.0f ), vec4( 0.0f, -1.0f, 0.0f, 1.0f )
+    };
+
+    // each plane cuts off at most one corner and adds two
+    vec4 polygon[8], kept[8];
+    int numCorners = 3;
+
+    for( int k = 0; k < 3; k++ ) {
+        polygon[ k ] = clip[ k ];
+    }
+
+    for( int i = 0; i < 5 && numCorners >= 3; i++ ) {
+        int numKept = 0;
+
+        for( int k = 0; k < numCorners; k++ ) {
+            const vec4 &p = polygon[ k ];
+            const vec4 &q = polygon[ ( k + 1 ) % numCorners ];
+            float dp = dot( planes[ i ], p ), dq = dot( planes[ i ], q );
+
+            if( dp >= 0.0f ) {
+                kept[ numKept++ ] = p;
+            }
+
+            if( ( dp >= 0.0f ) != ( dq >= 0.0f ) ) {
+                kept[ numKept++ ] = p + ( q - p ) * ( dp / ( dp - dq ) );
+            }
+        }
+
+        copy( kept, kept + numKept, polygon );
+        numCorners = numKept;
+    }
+
+    if( numCorners < 3 ) {
+        return;
+    }
+
+    // to pixels, y up as in device coordinates
+    vec3 screen[8];
+    for( int k = 0; k < numCorners; k++ ) {
+        vec3 ndc = vec3( polygon[ k ] ) / polygon[ k ].w;
+        screen[ k ] = vec3( ( ndc.x * 0.5f + 0.5f ) * OCCLUSION_WIDTH,
+                            ( ndc.y * 0.5f + 0.5f ) * OCCLUSION_HEIGHT,
+                            ndc.z );
+    }
+
+    // a fan from the first corner
+    for( int k = 1; k + 1 < numCorners; k++ ) {
+        drawTriangle( screen[0], screen[ k ], screen[ k + 1 ] );
+    }
+}
+
+///
+// Draw the occluders as seen by a camera, and build the hierarchy.
+//
+// @param Projection - projection matrix of the camera
+// @param View       - viewing matrix of the camera
+///
+void OcclusionCuller::render( const mat4 &Projection, const mat4 &View ) {
+    ViewProj = Projection * View;
+
+    fill( levels[ 0 ].begin(), levels[ 0 ].end(), 1.0f );
+
+    for( size_t t = 0; t + 2 < triangles.size(); t += 3 ) {
+        vec4 clip[3];
+
+        for( int k = 0; k < 3; k++ ) {
+            clip[ k ] = ViewProj * vec4( triangles[ t + k ], 1.0f );
+        }
+
+        clipTriangle( clip );
+    }
+
+    // each texel of a level is as far as the farthest below it, so a box
+    // nearer than none of them is hidden over all of them
+    int w = OCCLUSION_WIDTH, h = OCCLUSION_HEIGHT;
+
+    for( size_t l = 1; l < levels.size(); l++ ) {
+        const vector< float > &fine = levels[ l - 1 ];
+        vector< float > &coarse = levels[ l ];
+        int fw = w;
+
+        w /= 2;
+        h /= 2;
+
+        for( int y = 0; y < h; y++ ) {
+            for( int x = 0; x < w; x++ ) {
+                const float *p = &fine[ 2 * y * fw + 2 * x ];
+                coarse[ y * w + x ] = std::max( std::max( p[0], p[1] ),
+                                                std::max( p[fw], p[fw + 1] ) );
+            }
+        }
+    }
+}
+
+///
+// Hide the visible objects whose boxes are behind the occluders.
+//
+// @param bounds  - the world space boxes of the objects
+// @param visible - for each object, whether it may be seen; cleared for
+//                  the objects found hidden
+//
+// @return the number of objects found hidden
+///
+int OcclusionCuller::cull( const CullSet &bounds,
+                           vector< char > &visible ) const {
+    int hidden = 0;
+
+    for( size_t i = 0; i < visible.size(); i++ ) {
+        vec3 center, extent;
+        bounds.getBounds( i, center, extent );
+
+        if( !visible[ i ] || extent.x >= FLT_MAX ) {
+            continue;
+        }
+
+        // the screen rectangle and nearest depth of the corners; a box
+        // reaching past the near plane is always seen
+        vec2 lo( FLT_MAX ), hi( -FLT_MAX );
+        float nearest = FLT_MAX;
+        bool crossing = false;
+
+        for( int k = 0; k < 8 && !crossing; k++ ) {
+            vec3 corner = center + extent * vec3( k & 1 ? 1.0f : -1.0f,
+                                                  k & 2 ? 1.0f : -1.0f,
+                                                  k & 4 ? 1.0f : -1.0f );
+            vec4 clip = ViewProj * vec4( corner, 1.0f );
+
+            if( clip.z + clip.w < 0.0f || clip.w <= 0.0f ) {
+                crossing = true;
+                break;
+            }
+
+            vec3 ndc = vec3( clip ) / clip.w;
+            lo = glm::min( lo, vec2( ndc ) );
+            hi = glm::max( hi, vec2( ndc ) );
+            nearest = std::min( nearest, ndc.z );
+        }
+
+        if( crossing ) {
+            continue;
+        }
+
+        int x0 = std::max( 0, int( floorf( ( lo.x * 0.5f + 0.5f ) *
+                                           OCCLUSION_WIDTH ) ) );
+        int x1 = std::min( OCCLUSION_WIDTH - 1,
+                           int( floorf( ( hi.x * 0.5f + 0.5f ) *
+                                        OCCLUSION_WIDTH ) ) );
+        int y0 = std::max( 0, int( floorf( ( lo.y * 0.5f + 0.5f ) *
+                                           OCCLUSION_HEIGHT ) ) );
+        int y1 = std::min( OCCLUSION_HEIGHT - 1,
+                           int( floorf( ( hi.y * 0.5f + 0.5f ) *
+                                        OCCLUSION_HEIGHT ) ) );
+
+        if( x0 > x1 || y0 > y1 ) {
+            continue;
+        }
+
+        // the level where the rectangle spans a few texels
+        size_t l = 0;
+        while( l + 1 < levels.size() &&
+               std::max( x1 - x0, y1 - y0 ) >> l > 2 ) {
+            l++;
+        }
+
+        int w = OCCLUSION_WIDTH >> l;
+        bool behind = true;
+
+        for( int y = y0 >> l; y <= y1 >> l && behind; y++ ) {
+            for( int x = x0 >> l; x <= x1 >> l && behind; x++ ) {
+                behind = nearest > levels[ l ][ y * w + x ];
+            }
+        }
+
+        if( behind ) {
+            visible[ i ] = 0;
+            hidden++;
+        }
+    }
+
+    return hidden;
+}
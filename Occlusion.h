@@ -0,0 +1,121 @@
+//
+// Occlusion.h
+//
+// Software occlusion culling: the large opaque objects are rasterized into
+// a small depth buffer on the CPU, and the objects whose boxes lie behind
+// it are not drawn.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _OCCLUSION_H_
+#define _OCCLUSION_H_
+
+#include <vector>
+
+#include "Culling.h"
+#include "Object.h"
+
+// size of the occluder depth buffer, in pixels; the width is a multiple of
+// the four pixels rasterized at a time
+#define OCCLUSION_WIDTH  256
+#define OCCLUSION_HEIGHT 128
+
+///
+// The occluders of the scene, and the depth buffer they were last drawn
+// into with its hierarchy of farthest depths.
+///
+class OcclusionCuller {
+
+    // world space triangles of the occluders, three corners each
+    vector< vec3 > triangles;
+
+    // the same triangles in object space, to place them again
+    vector< vec3 > corners;
+
+    // for each occluder, its object, the model matrix its triangles were
+    // placed with, and its first corner
+    vector< int > occluderObject;
+    vector< mat4 > occluderModel;
+    vector< size_t > occluderFirst;
+
+    // level 0 holds the nearest depth drawn at each pixel, each level
+    // after it the farthest depth of 2x2 texels of the one before; depths
+    // are normalized device z, 1 where nothing was drawn
+    vector< vector< float > > levels;
+
+    // projection times viewing matrix of the last render
+    mat4 ViewProj;
+
+    ///
+    // Draw a triangle into level 0.
+    //
+    // @param a - the first corner, as pixel x and y and device z
+    // @param b - the second corner
+    // @param c - the third corner
+    ///
+    void drawTriangle( vec3 a, vec3 b, vec3 c );
+
+    ///
+    // Clip a triangle to the view volume and draw what is left.
+    //
+    // @param clip - the corners, in clip space
+    ///
+    void clipTriangle( const vec4 *clip );
+
+public:
+
+    ///
+    // Constructor
+    ///
+    OcclusionCuller();
+
+    ///
+    // Add the triangles of an object to the occluders; they are kept in
+    // world space, and placed again only when the object moves.
+    //
+    // @param obj   - the object, opaque and placed
+    // @param i     - index of the object
+    // @param shape - which shape the object draws
+    // @param C     - the Canvas to make the shape in, left clear
+    ///
+    void addOccluder( const Object &obj, int i, int shape, Canvas &C );
+
+    ///
+    // Place again the triangles of the occluders whose objects moved.
+    //
+    // @param objects - the objects in the scene
+    //
+    // @return the number of occluders placed again
+    ///
+    int follow( const vector< Object > &objects );
+
+    ///
+    // Get the number of occluder triangles.
+    //
+    // @return the number of triangles
+    ///
+    size_t numTriangles( void ) const;
+
+    ///
+    // Draw the occluders as seen by a camera, and build the hierarchy;
+    // runs on a worker thread, between frames for the next one.
+    //
+    // @param Projection - projection matrix of the camera
+    // @param View       - viewing matrix of the camera
+    ///
+    void render( const mat4 &Projection, const mat4 &View );
+
+    ///
+    // Hide the visible objects whose boxes are behind the occluders.
+    //
+    // @param bounds  - the world space boxes of the objects
+    // @param visible - for each object, whether it may be seen; cleared
+    //                  for the objects found hidden
+    //
+    // @return the number of objects found hidden
+    ///
+    int cull( const CullSet &bounds, vector< char > &visible ) const;
+};
+
+#endif
@@ -0,0 +1,281 @@
+//
+// OcclusionQuery.cpp
+//
+// Occlusion queries on the GPU: the bounding box of each object is drawn
+// without writing color or depth, and the samples passing the depth test
+// decide whether the object itself is drawn.
+//
+// Author:  Jietong Chen
+//
+
+#include <cfloat>
+#include <iostream>
+
+#include "OcclusionQuery.h"
+#include "RenderState.h"
+#include "ShaderSetup.h"
+
+///
+// Can the queries be made? GL_ANY_SAMPLES_PASSED needs GL 3.3, and
+// conditional render GL 3.0.
+//
+// @return true if they can
+///
+bool queriesSupported( void ) {
+#ifdef __APPLE__
+    return false;
+#else
+    return GLEW_VERSION_3_3 || ( GLEW_VERSION_3_0 &&
+                                 GLEW_ARB_occlusion_query2 );
+#endif
+}
+
+///
+// Constructor
+///
+OcclusionQueries::OcclusionQueries() :
+    program( 0 ), boxCenter( -1 ), boxExtent( -1 ), vao( 0 ), vbuffer( 0 ),
+    ebuffer( 0 ) {
+}
+
+///
+// Create the box and one query per object.
+//
+// @param boxProgram - the program drawing the boxes
+// @param numObjects - number of objects in the scene
+///
+void OcclusionQueries::create( GLuint boxProgram, size_t numObjects ) {
+#ifndef __APPLE__
+    static const GLfloat corners[] = {
+        -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,
+        -1.0f,  1.0f, -1.0f,   1.0f,  1.0f, -1.0f,
+        -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,
+        -1.0f,  1.0f,  1.0f,   1.0f,  1.0f,  1.0f
+    };
+
+    // two triangles per face; both sides are drawn, so the turn of the
+    // triangles does not matter
+    static const GLubyte faces[] = {
+        0, 1, 3,  0, 3, 2,    // back
+        4, 5, 7,  4, 7, 6,    // front
+        0, 2, 6,  0, 6, 4,    // left
+        1, 3, 7,  1, 7, 5,    // right
+        0, 1, 5,  0, 5, 4,    // bottom
+        2, 3, 7,  2, 7, 6     // top
+    };
+
+    program = boxProgram;
+    boxCenter = glGetUniformLocation( program, "boxCenter" );
+    boxExtent = glGetUniformLocation( program, "boxExtent" );
+
+    glGenVertexArrays( 1, &vao );
+    glBindVertexArray( vao );
+
+    glGenBuffers( 1, &vbuffer );
+    glBindBuffer( GL_ARRAY_BUFFER, vbuffer );
+    glBufferData( GL_ARRAY_BUFFER, sizeof( corners ), corners,
+                  GL_STATIC_DRAW );
+
+    glGenBuffers( 1, &ebuffer );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ebuffer );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof( faces ), faces,
+                  GL_STATIC_DRAW );
+
+    glEnableVertexAttribArray( ATTRIB_POSITION );
+    glVertexAttribPointer( ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0,
+                           ( void * ) 0 );
+
+    glBindVertexArray( 0 );
+    invalidateState();
+
+    queries.resize( numObjects );
+    glGenQueries( GLsizei( numObjects ), &queries[ 0 ] );
+
+    pending.assign( numObjects, 0 );
+    hidden.assign( numObjects, 0 );
+    stats.assign( numObjects, QueryStats() );
+#endif
+}
+
+///
+// Read the results that are available, without waiting for the others.
+///
+void OcclusionQueries::collect( void ) {
+#ifndef __APPLE__
+    for( size_t i = 0; i < queries.size(); i++ ) {
+        if( !pending[ i ] ) {
+            continue;
+        }
+
+        GLuint available = 0;
+        glGetQueryObjectuiv( queries[ i ], GL_QUERY_RESULT_AVAILABLE,
+                             &available );
+
+        if( !available ) {
+            continue;
+        }
+
+        GLuint passed = 0;
+        glGetQueryObjectuiv( queries[ i ], GL_QUERY_RESULT, &passed );
+
+        pending[ i ] = 0;
+        hidden[ i ] = passed == 0;
+
+        stats[ i ].results++;
+        stats[ i ].hidden += hidden[ i ];
+    }
+#endif
+}
+
+///
+// Hide the visible objects whose last result found them hidden.
+//
+// @param visible - for each object, whether it may be seen; cleared for
+//                  the objects found hidden
+// @param only    - the objects the results apply to, or NULL for all
+//
+// @return the number of objects hidden
+///
+int OcclusionQueries::hide( vector< char > &visible,
+                            const vector< bool > *only ) const {
+    int numHidden = 0;
+
+    for( size_t i = 0; i < visible.size() && i < hidden.size(); i++ ) {
+        if( visible[ i ] && hidden[ i ] && ( only == NULL ||
+                                             ( *only )[ i ] ) ) {
+            visible[ i ] = 0;
+            numHidden++;
+        }
+    }
+
+    return numHidden;
+}
+
+///
+// Set up the state for drawing boxes: no color or depth writes, and both
+// sides, as the camera may be behind a face.
+///
+void OcclusionQueries::beginBoxes( void ) {
+    useProgram( program );
+    bindVertexArray( vao );
+
+    glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+    glDepthMask( GL_FALSE );
+    glDisable( GL_CULL_FACE );
+}
+
+///
+// Restore the state the objects are drawn with.
+///
+void OcclusionQueries::endBoxes( void ) {
+    glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+    glDepthMask( GL_TRUE );
+    glEnable( GL_CULL_FACE );
+}
+
+///
+// Draw the box of an object inside its query, between beginBoxes() and
+// endBoxes().
+//
+// The box of an object encloses its surface, so the box passes a sample
+// wherever the object would; a camera within reach of the near plane
+// could lose the front of the box to clipping, and the object is taken
+// as seen.
+//
+// @param bounds - the world space boxes of the objects
+// @param i      - index of the object
+// @param eye    - camera location in world space
+// @param znear  - distance of the near clipping plane
+//
+// @return true if the query was made
+///
+bool OcclusionQueries::query( const CullSet &bounds, size_t i,
+                              const vec3 &eye, float znear ) {
+#ifndef __APPLE__
+    if( pending[ i ] ) {
+        return false;
+    }
+
+    vec3 center, extent;
+    bounds.getBounds( i, center, extent );
+
+    // the corners of the near plane lie within twice its distance
+    vec3 reach = extent + vec3( 2.0f * znear );
+    vec3 offset = abs( eye - center );
+
+    if( extent.x >= FLT_MAX || ( offset.x <= reach.x &&
+                                 offset.y <= reach.y &&
+                                 offset.z <= reach.z ) ) {
+        hidden[ i ] = 0;
+        return false;
+    }
+
+    glUniform3f( boxCenter, center.x, center.y, center.z );
+    glUniform3f( boxExtent, extent.x, extent.y, extent.z );
+
+    glBeginQuery( GL_ANY_SAMPLES_PASSED, queries[ i ] );
+    glDrawElements( GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, ( void * ) 0 );
+    glEndQuery( GL_ANY_SAMPLES_PASSED );
+
+    pending[ i ] = 1;
+    return true;
+#else
+    return false;
+#endif
+}
+
+///
+// Draw only if the query just made for an object passed samples.
+//
+// The GPU waits for the result, the CPU does not.
+//
+// @param i - index of the object
+///
+void OcclusionQueries::beginConditional( size_t i ) {
+#ifndef __APPLE__
+    glBeginConditionalRender( queries[ i ], GL_QUERY_WAIT );
+#endif
+}
+
+///
+// Draw unconditionally again.
+///
+void OcclusionQueries::endConditional( void ) {
+#ifndef __APPLE__
+    glEndConditionalRender();
+#endif
+}
+
+///
+// Print the results read for each object, to tell which ones the queries
+// pay off for.
+//
+// @param objects - the objects in the scene
+///
+void OcclusionQueries::report( const vector< Object > &objects ) const {
+    int results = 0, numHidden = 0;
+
+    for( size_t i = 0; i < stats.size(); i++ ) {
+        if( stats[ i ].results == 0 ) {
+            continue;
+        }
+
+        results += stats[ i ].results;
+        numHidden += stats[ i ].hidden;
+
+        cout << objects[ i ].name << ": hidden by " << stats[ i ].hidden <<
+             " of " << stats[ i ].results << " queries" << endl;
+    }
+
+    cout << "total: hidden by " << numHidden << " of " << results <<
+         " queries" << endl;
+}
+
+///
+// Forget the results read so far, when the queries change use.
+///
+void OcclusionQueries::reset( void ) {
+    pending.assign( pending.size(), 0 );
+    hidden.assign( hidden.size(), 0 );
+    stats.assign( stats.size(), QueryStats() );
+}
@@ -0,0 +1,151 @@
+//
+// OcclusionQuery.h
+//
+// Occlusion queries on the GPU: the bounding box of each object is drawn
+// without writing color or depth, and the samples passing the depth test
+// decide whether the object itself is drawn.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _OCCLUSIONQUERY_H_
+#define _OCCLUSIONQUERY_H_
+
+#include <vector>
+
+#include "Culling.h"
+#include "Object.h"
+
+// how the results of the queries are used
+#define QUERY_OFF         0    // no queries
+#define QUERY_CONDITIONAL 1    // drawn under conditional render
+#define QUERY_PREVIOUS    2    // skipped on the result of an earlier frame
+
+///
+// Can the queries be made? GL_ANY_SAMPLES_PASSED needs GL 3.3, and
+// conditional render GL 3.0.
+//
+// @return true if they can
+///
+bool queriesSupported( void );
+
+///
+// Results read for one object.
+///
+struct QueryStats {
+    // queries whose result was read
+    int results;
+    // of those, the ones no sample of the box passed
+    int hidden;
+};
+
+///
+// One query per object, the box drawn for it, and what the results said.
+///
+class OcclusionQueries {
+
+    // program drawing the boxes, and its uniforms
+    GLuint program;
+    GLint boxCenter, boxExtent;
+
+    // the unit box, from -1 to 1 on each axis
+    GLuint vao, vbuffer, ebuffer;
+
+    // query of each object
+    vector< GLuint > queries;
+
+    // whether a query of each object is yet to be read
+    vector< char > pending;
+
+    // whether the last result read for each object found it hidden
+    vector< char > hidden;
+
+    // results read for each object
+    vector< QueryStats > stats;
+
+public:
+
+    ///
+    // Constructor
+    ///
+    OcclusionQueries();
+
+    ///
+    // Create the box and one query per object.
+    //
+    // @param boxProgram - the program drawing the boxes
+    // @param numObjects - number of objects in the scene
+    ///
+    void create( GLuint boxProgram, size_t numObjects );
+
+    ///
+    // Read the results that are available, without waiting for the
+    // others.
+    ///
+    void collect( void );
+
+    ///
+    // Hide the visible objects whose last result found them hidden.
+    //
+    // @param visible - for each object, whether it may be seen; cleared
+    //                  for the objects found hidden
+    // @param only    - the objects the results apply to, or NULL for all
+    //
+    // @return the number of objects hidden
+    ///
+    int hide( vector< char > &visible, const vector< bool > *only ) const;
+
+    ///
+    // Set up the state for drawing boxes: no color or depth writes, and
+    // both sides, as the camera may be behind a face.
+    ///
+    void beginBoxes( void );
+
+    ///
+    // Restore the state the objects are drawn with.
+    ///
+    void endBoxes( void );
+
+    ///
+    // Draw the box of an object inside its query, between beginBoxes()
+    // and endBoxes().  No query is made while the last one is unread, or
+    // when the camera is so close to the box that the near plane may cut
+    // it.
+    //
+    // @param bounds - the world space boxes of the objects
+    // @param i      - index of the object
+    // @param eye    - camera location in world space
+    // @param znear  - distance of the near clipping plane
+    //
+    // @return true if the query was made
+    ///
+    bool query( const CullSet &bounds, size_t i, const vec3 &eye,
+                float znear );
+
+    ///
+    // Draw only if the query just made for an object passed samples.
+    //
+    // @param i - index of the object
+    ///
+    void beginConditional( size_t i );
+
+    ///
+    // Draw unconditionally again.
+    ///
+    void endConditional( void );
+
+    ///
+    // Print the results read for each object, to tell which ones the
+    // queries pay off for.
+    //
+    // @param objects - the objects in the scene
+    ///
+    void report( const vector< Object > &objects ) const;
+
+    ///
+    // Forget the results read so far, when the queries change use.
+    ///
+    void reset( void );
+};
+
+#endif
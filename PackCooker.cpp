@@ -0,0 +1,409 @@
+//
+// PackCooker.cpp
+//
+// Offline cooker of the asset pack: makes every shape and lays it out as
+// it is uploaded, decodes every image in texture/ with all of its mipmap
+// levels, and copies the text of the shaders, writing them all into one
+// file with a table of contents.  Run it from the directory the program
+// runs in.  Each entry records the size and modification time of the file
+// it was cooked from, and is passed over at run time once the file
+// changes, until the pack is cooked again.
+//
+// Usage:  PackCooker [pack]   (assets.pack by default)
+//
+// Author:  Jietong Chen
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "AssetPack.h"
+#include "Buffers.h"
+#include "Canvas.h"
+#include "Images.h"
+#include "Shapes.h"
+
+using namespace std;
+
+///
+// One entry of the pack being cooked, its data laid out with offsets
+// from the start of the entry until it is placed.
+///
+struct CookedEntry {
+    string name;
+    unsigned int kind;
+    unsigned int flags;
+    vector< unsigned char > data;
+
+    // the key of the file it was cooked from
+    unsigned long long sourceSize;
+    long long sourceTime;
+};
+
+///
+// Start an entry of the pack, keyed by the file it is cooked from.
+//
+// @param entry  - the entry
+// @param name   - the name of the entry
+// @param kind   - the kind of the entry
+// @param source - the file it is cooked from, NULL if made in code
+// @param flags  - the processing applied to it
+///
+static void startEntry( CookedEntry &entry, const string &name,
+                        unsigned int kind, const char *source,
+                        unsigned int flags ) {
+    entry.name = name;
+    entry.kind = kind;
+    entry.flags = flags;
+    entry.sourceSize = 0;
+    entry.sourceTime = 0;
+
+    struct stat info;
+
+    if( source != NULL && stat( source, &info ) == 0 ) {
+        entry.sourceSize = (unsigned long long) info.st_size;
+        entry.sourceTime = (long long) info.st_mtime;
+    }
+}
+
+///
+// Append bytes to the data of an entry, after padding it to a multiple of
+// 16 bytes.
+//
+// @param data  - the data of the entry
+// @param bytes - the bytes to append
+// @param size  - how many
+//
+// @return where the bytes start in the data
+///
+static unsigned long long append( vector< unsigned char > &data,
+                                  const void *bytes, size_t size ) {
+    data.resize( ( data.size() + 15 ) & ~size_t( 15 ), 0 );
+
+    size_t at = data.size();
+    data.resize( at + size );
+
+    if( size > 0 ) {
+        memcpy( &data[ at ], bytes, size );
+    }
+
+    return at;
+}
+
+///
+// Get the names of the files in a directory ending with a suffix, sorted.
+//
+// @param dir    - the directory
+// @param suffix - the ending of the names
+//
+// @return the names, with the directory in front unless it is "."
+///
+static vector< string > listFiles( const string &dir, const string &suffix ) {
+    vector< string > names;
+    DIR *d = opendir( dir.c_str() );
+
+    if( d == NULL ) {
+        return names;
+    }
+
+    struct dirent *e;
+
+    while( ( e = readdir( d ) ) != NULL ) {
+        string name( e->d_name );
+
+        if( name.size() > suffix.size() &&
+            name.compare( name.size() - suffix.size(), suffix.size(),
+                          suffix ) == 0 ) {
+            names.push_back( dir == "." ? name : dir + "/" + name );
+        }
+    }
+
+    closedir( d );
+    sort( names.begin(), names.end() );
+
+    return names;
+}
+
+///
+// Cook a shape: its buffers in VERTEX_PACKED, and its triangles for the
+// occlusion culling.
+//
+// @param shape   - which shape to cook
+// @param entries - receives the entries
+///
+static void cookShape( int shape, vector< CookedEntry > &entries ) {
+    Canvas C( 1, 1 );
+    makeShape( shape, C );
+
+    BufferSet mesh;
+    vector< GLubyte > vertices;
+    vector< GLushort > shortElements;
+
+    Span<float> points = C.vertexSpan();
+    Span<GLuint> elements = C.elementSpan();
+
+    const void *elementData = mesh.layOut( points, C.colorSpan(),
+                                           C.normalSpan(), C.uvSpan(),
+                                           elements, VERTEX_PACKED,
+                                           vertices, shortElements );
+
+    if( elementData == NULL ) {
+        cerr << "Shape " << shapeName( shape ) << " is empty, skipped"
+             << endl;
+        return;
+    }
+
+    PackMesh m;
+    memset( &m, 0, sizeof( m ) );
+    m.format = mesh.format;
+    m.stride = mesh.stride;
+    m.numVertices = mesh.numVertices;
+    m.numElements = mesh.numElements;
+    m.eType = mesh.eType;
+    m.vSize = mesh.vSize;
+    m.cSize = mesh.cSize;
+    m.nSize = mesh.nSize;
+    m.tSize = mesh.tSize;
+    m.eSize = mesh.eSize;
+    m.vOffset = mesh.vOffset;
+    m.cOffset = mesh.cOffset;
+    m.nOffset = mesh.nOffset;
+    m.tOffset = mesh.tOffset;
+
+    memcpy( m.decodeMat, &mesh.decodeMat[0][0], sizeof( m.decodeMat ) );
+    for( int k = 0; k < 3; k++ ) {
+        m.center[ k ] = mesh.center[ k ];
+        m.extent[ k ] = mesh.extent[ k ];
+    }
+    m.radius = mesh.radius;
+
+    CookedEntry entry;
+    startEntry( entry, string( "mesh/" ) + shapeName( shape ), PACK_MESH,
+                shapeFile( shape ), shapeFlags( shape ) );
+
+    append( entry.data, &m, sizeof( m ) );
+    m.vertexData = append( entry.data, &vertices[0], vertices.size() );
+    m.elementData = append( entry.data, elementData, size_t( mesh.eSize ) );
+    memcpy( &entry.data[0], &m, sizeof( m ) );
+
+    entries.push_back( entry );
+
+    // the corners of every triangle, as the occluders take them
+    CookedEntry corners;
+    startEntry( corners, string( "corners/" ) + shapeName( shape ),
+                PACK_CORNERS, shapeFile( shape ), shapeFlags( shape ) );
+
+    for( size_t e = 0; e + 2 < elements.size; e += 3 ) {
+        for( int k = 0; k < 3; k++ ) {
+            const float *p = points.data + 4 * elements.data[ e + k ];
+            corners.data.insert( corners.data.end(),
+                                 (const unsigned char *) p,
+                                 (const unsigned char *) ( p + 3 ) );
+        }
+    }
+
+    entries.push_back( corners );
+}
+
+///
+// Cook an image: decoded as loadTexture() has SOIL load it, with every
+// mipmap level down to 1x1.
+//
+// @param filename - the name of the image file
+// @param entries  - receives the entry
+///
+static void cookTexture( const string &filename,
+                         vector< CookedEntry > &entries ) {
+    vector< Image > levels( 1 );
+
+    if( !decodeImage( filename.c_str(), levels[0] ) ) {
+        cerr << "Cannot decode " << filename << ", skipped" << endl;
+        return;
+    }
+
+    mipmapImage( levels );
+
+    if( levels.size() > PACK_MAX_LEVELS ) {
+        cerr << filename << " has too many mipmap levels, skipped" << endl;
+        return;
+    }
+
+    PackTexture t;
+    memset( &t, 0, sizeof( t ) );
+    t.width = levels[0].width;
+    t.height = levels[0].height;
+    t.channels = levels[0].channels;
+    t.numLevels = int( levels.size() );
+
+    CookedEntry entry;
+    startEntry( entry, filename, PACK_TEXTURE, filename.c_str(), 0 );
+
+    append( entry.data, &t, sizeof( t ) );
+
+    for( int level = 0; level < t.numLevels; level++ ) {
+        t.levelData[ level ] = append( entry.data, &levels[ level ].pixels[0],
+                                       levels[ level ].pixels.size() );
+    }
+
+    memcpy( &entry.data[0], &t, sizeof( t ) );
+
+    entries.push_back( entry );
+}
+
+///
+// Cook a text file, copied as it is.
+//
+// @param filename - the name of the file
+// @param entries  - receives the entry
+///
+static void cookText( const string &filename,
+                      vector< CookedEntry > &entries ) {
+    FILE *fp = fopen( filename.c_str(), "rb" );
+
+    if( fp == NULL ) {
+        perror( filename.c_str() );
+        return;
+    }
+
+    CookedEntry entry;
+    startEntry( entry, filename, PACK_TEXT, filename.c_str(), 0 );
+
+    unsigned char block[ 4096 ];
+    size_t count;
+
+    while( ( count = fread( block, 1, sizeof( block ), fp ) ) > 0 ) {
+        entry.data.insert( entry.data.end(), block, block + count );
+    }
+
+    fclose( fp );
+
+    entries.push_back( entry );
+}
+
+///
+// Order entries by name, as the table of contents is searched.
+///
+static bool byName( const CookedEntry &a, const CookedEntry &b ) {
+    return a.name < b.name;
+}
+
+///
+// Pad a file with zeros up to a multiple of PACK_ALIGN.
+//
+// @param fp     - the file
+// @param offset - where the file ends now; receives where it ends after
+///
+static void pad( FILE *fp, unsigned long long &offset ) {
+    static const unsigned char zeros[ PACK_ALIGN ] = { 0 };
+    size_t count = size_t( ( PACK_ALIGN - offset % PACK_ALIGN ) % PACK_ALIGN );
+
+    fwrite( zeros, 1, count, fp );
+    offset += count;
+}
+
+int main( int argc, char **argv ) {
+    const char *filename = argc > 1 ? argv[1] : "assets.pack";
+    vector< CookedEntry > entries;
+
+    for( int shape = 0; shapeName( shape ) != NULL; shape++ ) {
+        cookShape( shape, entries );
+    }
+
+    vector< string > files = listFiles( "texture", ".png" );
+    for( size_t i = 0; i < files.size(); i++ ) {
+        cookTexture( files[ i ], entries );
+    }
+
+    files = listFiles( ".", ".vert" );
+    vector< string > frag = listFiles( ".", ".frag" );
+    files.insert( files.end(), frag.begin(), frag.end() );
+    for( size_t i = 0; i < files.size(); i++ ) {
+        cookText( files[ i ], entries );
+    }
+
+    sort( entries.begin(), entries.end(), byName );
+
+    // the table of contents, with the data of each entry aligned after it
+    PackHeader header;
+    memset( &header, 0, sizeof( header ) );
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.numEntries = (unsigned int) entries.size();
+
+    vector< PackEntry > toc( entries.size() );
+    unsigned long long offset = sizeof( header ) +
+                                entries.size() * sizeof( PackEntry );
+
+    for( size_t i = 0; i < entries.size(); i++ ) {
+        if( entries[ i ].name.size() >= sizeof( toc[ i ].name ) ) {
+            cerr << "Name " << entries[ i ].name << " is too long" << endl;
+            exit( 1 );
+        }
+
+        offset = ( offset + PACK_ALIGN - 1 ) / PACK_ALIGN * PACK_ALIGN;
+
+        memset( &toc[ i ], 0, sizeof( toc[ i ] ) );
+        strcpy( toc[ i ].name, entries[ i ].name.c_str() );
+        toc[ i ].kind = entries[ i ].kind;
+        toc[ i ].flags = entries[ i ].flags;
+        toc[ i ].sourceSize = entries[ i ].sourceSize;
+        toc[ i ].sourceTime = entries[ i ].sourceTime;
+        toc[ i ].offset = offset;
+        toc[ i ].size = entries[ i ].data.size();
+
+        // the offsets within meshes and textures become offsets in the pack
+        vector< unsigned char > &data = entries[ i ].data;
+
+        if( entries[ i ].kind == PACK_MESH ) {
+            PackMesh *m = (PackMesh *) &data[0];
+            m->vertexData += offset;
+            m->elementData += offset;
+        } else if( entries[ i ].kind == PACK_TEXTURE ) {
+            PackTexture *t = (PackTexture *) &data[0];
+            for( int level = 0; level < t->numLevels; level++ ) {
+                t->levelData[ level ] += offset;
+            }
+        }
+
+        offset += data.size();
+    }
+
+    FILE *fp = fopen( filename, "wb" );
+
+    if( fp == NULL ) {
+        perror( filename );
+        exit( 1 );
+    }
+
+    fwrite( &header, sizeof( header ), 1, fp );
+    fwrite( &toc[0], sizeof( PackEntry ), toc.size(), fp );
+    offset = sizeof( header ) + toc.size() * sizeof( PackEntry );
+
+    for( size_t i = 0; i < entries.size(); i++ ) {
+        pad( fp, offset );
+        if( !entries[ i ].data.empty() ) {
+            fwrite( &entries[ i ].data[0], 1, entries[ i ].data.size(), fp );
+        }
+        offset += entries[ i ].data.size();
+
+        cout << entries[ i ].name << ": " << entries[ i ].data.size()
+             << " bytes" << endl;
+    }
+
+    if( fclose( fp ) != 0 ) {
+        perror( filename );
+        exit( 1 );
+    }
+
+    cout << "Cooked " << entries.size() << " entries into " << filename
+         << ", " << offset << " bytes" << endl;
+
+    return 0;
+}
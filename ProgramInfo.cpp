@@ -0,0 +1,105 @@
+//
+// ProgramInfo.cpp
+//
+// Locations of the uniforms of each shader program, looked up once so
+// drawing never resolves them by name.
+//
+// Author:  Jietong Chen
+//
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ProgramInfo.h"
+
+using namespace std;
+
+///
+// Get the locations of every program reflected so far.
+//
+// @return the locations, keyed by program
+///
+static map< GLuint, ProgramInfo > &programs() {
+    static map< GLuint, ProgramInfo > infos;
+
+    return infos;
+}
+
+///
+// Find a name among the active uniforms of a program.
+//
+// @param locations - the locations of the active uniforms
+// @param name      - the name to find
+//
+// @return its location, or -1 if the program does not use it
+///
+static GLint locate( const map< string, GLint > &locations,
+                     const string &name ) {
+    map< string, GLint >::const_iterator it = locations.find( name );
+
+    return it == locations.end() ? -1 : it->second;
+}
+
+///
+// Look up the locations of a program from its active uniforms.
+//
+// @param program - the ID of a linked shader program
+//
+// @return the locations of the program
+///
+const ProgramInfo &reflectProgram( GLuint program ) {
+    map< string, GLint > uniforms;
+    GLint count, length;
+
+    // every active uniform outside the uniform blocks
+    glGetProgramiv( program, GL_ACTIVE_UNIFORMS, &count );
+    glGetProgramiv( program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length );
+
+    vector< GLchar > name( length + 1 );
+
+    for( GLint i = 0; i < count; i++ ) {
+        GLsizei used;
+        GLint size;
+        GLenum type;
+
+        glGetActiveUniform( program, i, GLsizei( name.size() ), &used,
+                            &size, &type, &name[ 0 ] );
+
+        string key( &name[ 0 ], used );
+
+        // arrays of basic types are listed as "name[0]"
+        if( key.size() > 3 && key.compare( key.size() - 3, 3, "[0]" ) == 0 ) {
+            key.erase( key.size() - 3 );
+        }
+
+        uniforms[ key ] = glGetUniformLocation( program, &name[ 0 ] );
+    }
+
+    ProgramInfo &info = programs()[ program ];
+
+    info.modelViewMat = locate( uniforms, "modelViewMat" );
+    info.mvpMat = locate( uniforms, "mvpMat" );
+    info.normalMat = locate( uniforms, "normalMat" );
+
+    info.materialSlot = locate( uniforms, "materialSlot" );
+
+    return info;
+}
+
+///
+// Get the locations of a program, looking them up the first time.
+//
+// @param program - the ID of a linked shader program
+//
+// @return the locations of the program
+///
+const ProgramInfo &programInfo( GLuint program ) {
+    map< GLuint, ProgramInfo >::iterator it = programs().find( program );
+
+    if( it != programs().end() ) {
+        return it->second;
+    }
+
+    return reflectProgram( program );
+}
@@ -0,0 +1,56 @@
+//
+// ProgramInfo.h
+//
+// Locations of the uniforms of each shader program, looked up once so
+// drawing never resolves them by name.  The attributes are bound to fixed
+// locations when a program is linked, see ShaderSetup.h.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _PROGRAMINFO_H_
+#define _PROGRAMINFO_H_
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+#ifndef __APPLE__
+#include <GL/glew.h>
+#endif
+
+#include <GLFW/glfw3.h>
+
+///
+// Locations of every uniform the drawing code sets for each object, -1
+// for those the program does not use.  The camera, lights and materials
+// live in the uniform blocks, see UniformBlocks.h.
+///
+struct ProgramInfo {
+    // transformations, in camera space
+    GLint modelViewMat, mvpMat, normalMat;
+
+    // index into the material table
+    GLint materialSlot;
+};
+
+///
+// Look up the locations of a program from its active uniforms. Call once
+// the program is linked.
+//
+// @param program - the ID of a linked shader program
+//
+// @return the locations of the program
+///
+const ProgramInfo &reflectProgram( GLuint program );
+
+///
+// Get the locations of a program, looking them up the first time.
+//
+// @param program - the ID of a linked shader program
+//
+// @return the locations of the program
+///
+const ProgramInfo &programInfo( GLuint program );
+
+#endif
@@ -0,0 +1,165 @@
+//
+// RenderQueue.cpp
+//
+// The draws of a frame, sorted by 64-bit keys so draws sharing a program,
+// texture and material follow each other.
+//
+// Author:  Jietong Chen
+//
+
+#include <cstdlib>
+#include <iostream>
+
+#include "RenderQueue.h"
+
+///
+// Sort keys in ascending order, one byte per pass from the least
+// significant.
+//
+// @param keys    - the keys to sort
+// @param scratch - room for the keys of a pass
+///
+static void radixSort( vector< uint64_t > &keys,
+                       vector< uint64_t > &scratch ) {
+    scratch.resize( keys.size() );
+
+    for( int shift = 0; shift < 64 && !keys.empty(); shift += 8 ) {
+        size_t count[ 256 ] = { 0 };
+
+        for( size_t i = 0; i < keys.size(); i++ ) {
+            count[ ( keys[ i ] >> shift ) & 0xff ]++;
+        }
+
+        // a byte every key shares leaves the order as it is
+        if( count[ ( keys[ 0 ] >> shift ) & 0xff ] == keys.size() ) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for( int b = 0; b < 256; b++ ) {
+            size_t n = count[ b ];
+            count[ b ] = offset;
+            offset += n;
+        }
+
+        for( size_t i = 0; i < keys.size(); i++ ) {
+            scratch[ count[ ( keys[ i ] >> shift ) & 0xff ]++ ] = keys[ i ];
+        }
+
+        keys.swap( scratch );
+    }
+}
+
+///
+// Get the rank of a program or texture, giving it the next free rank the
+// first time.
+//
+// @param ranks - the ranks given so far
+// @param id    - the program or texture
+//
+// @return its rank, at most 255
+///
+int RenderQueue::rank( map< GLuint, int > &ranks, GLuint id ) {
+    map< GLuint, int >::iterator it = ranks.find( id );
+
+    if( it != ranks.end() ) {
+        return it->second;
+    }
+
+    // past 255 the draws still come out right, only less well sorted
+    int r = int( ranks.size() ) < 255 ? int( ranks.size() ) : 255;
+    ranks[ id ] = r;
+
+    return r;
+}
+
+///
+// Build and sort the keys of a frame, one per draw.
+//
+// @param objects - the objects in the scene
+// @param batches - the instanced batches
+// @param batchOf - the batch of each object, or -1; NULL to draw every
+//                  object on its own
+// @param skip    - the objects drawn some other way or not at all, or
+//                  NULL; for a batch, the flag of its first member
+// @param View    - viewing matrix of the current camera
+// @param zfar    - distance of the far clipping plane
+///
+void RenderQueue::build( vector< Object > &objects,
+                         const vector< InstanceBatch > &batches,
+                         const vector< int > *batchOf,
+                         const vector< bool > *skip, const mat4 &View,
+                         float zfar ) {
+    const uint64_t depthMax = ( uint64_t( 1 ) << KEY_DEPTH_BITS ) - 1;
+    const int depthShift = KEY_INDEX_BITS;
+    const int stateShift = KEY_INDEX_BITS + KEY_DEPTH_BITS;
+
+    if( objects.size() > ( size_t( 1 ) << KEY_INDEX_BITS ) ) {
+        cerr << "Error - more than " << ( 1 << KEY_INDEX_BITS ) <<
+             " objects to sort" << endl;
+        exit( 1 );
+    }
+
+    keys.clear();
+
+    for( size_t i = 0; i < objects.size(); i++ ) {
+        Object &obj = objects[ i ];
+        int b = batchOf != NULL ? ( *batchOf )[ i ] : -1;
+
+        // a batch is drawn once, by its first member
+        if( b >= 0 && batches[ b ].members[ 0 ] != int( i ) ) {
+            continue;
+        }
+
+        if( skip != NULL && ( *skip )[ i ] ) {
+            continue;
+        }
+
+        // the copies of a batch look their materials up themselves
+        GLuint program = b >= 0 ? batches[ b ].program : obj.program;
+        int material = b >= 0 ? 0 : obj.materialIndex();
+
+        uint64_t state = uint64_t( rank( programRank, program ) ) << 16 |
+                         uint64_t( rank( textureRank, obj.texture ) ) << 8 |
+                         uint64_t( material & 0xff );
+
+        // the distance of the origin of the object from the camera
+        vec4 origin = View * obj.Model[ 3 ];
+        float distance = glm::clamp( -origin.z / zfar, 0.0f, 1.0f );
+        uint64_t depth = uint64_t( distance * float( depthMax ) );
+
+        uint64_t key = uint64_t( obj.pass ) << ( 64 - KEY_PASS_BITS );
+
+        if( obj.pass == PASS_TRANSPARENT ) {
+            // back to front, so what is behind is blended first
+            key |= ( depthMax - depth ) << stateShift |
+                   state << depthShift;
+        } else {
+            key |= state << stateShift | depth << depthShift;
+        }
+
+        keys.push_back( key | uint64_t( i ) );
+    }
+
+    radixSort( keys, scratch );
+}
+
+///
+// Get the number of draws in the queue.
+//
+// @return the number of draws
+///
+size_t RenderQueue::size( void ) const {
+    return keys.size();
+}
+
+///
+// Get the object of a draw; for a batch, its first member.
+//
+// @param i - the position of the draw in key order
+//
+// @return the index of the object
+///
+int RenderQueue::item( size_t i ) const {
+    return int( keys[ i ] & ( ( uint64_t( 1 ) << KEY_INDEX_BITS ) - 1 ) );
+}
@@ -0,0 +1,88 @@
+//
+// RenderQueue.h
+//
+// The draws of a frame, sorted by 64-bit keys so draws sharing a program,
+// texture and material follow each other.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _RENDERQUEUE_H_
+#define _RENDERQUEUE_H_
+
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+#include "Instancing.h"
+
+// widths of the fields of a sort key, from the most significant; opaque
+// draws sort by state then front to back, transparent ones back to front
+// then by state, and the low bits hold the object drawn
+#define KEY_PASS_BITS  2
+#define KEY_STATE_BITS 24    // program, texture and material, 8 bits each
+#define KEY_DEPTH_BITS 24
+#define KEY_INDEX_BITS 14
+
+///
+// Draws of one frame in the order they are submitted.
+///
+class RenderQueue {
+
+    // sort keys, and room for the radix sort to scatter them into
+    vector< uint64_t > keys;
+    vector< uint64_t > scratch;
+
+    // small ranks of the programs and textures, in order of first use
+    map< GLuint, int > programRank;
+    map< GLuint, int > textureRank;
+
+    ///
+    // Get the rank of a program or texture, giving it the next free
+    // rank the first time.
+    //
+    // @param ranks - the ranks given so far
+    // @param id    - the program or texture
+    //
+    // @return its rank, at most 255
+    ///
+    int rank( map< GLuint, int > &ranks, GLuint id );
+
+public:
+
+    ///
+    // Build and sort the keys of a frame, one per draw.
+    //
+    // @param objects - the objects in the scene
+    // @param batches - the instanced batches
+    // @param batchOf - the batch of each object, or -1; NULL to draw every
+    //                  object on its own
+    // @param skip    - the objects drawn some other way or not at all, or
+    //                  NULL; for a batch, the flag of its first member
+    // @param View    - viewing matrix of the current camera
+    // @param zfar    - distance of the far clipping plane
+    ///
+    void build( vector< Object > &objects,
+                const vector< InstanceBatch > &batches,
+                const vector< int > *batchOf, const vector< bool > *skip,
+                const mat4 &View, float zfar );
+
+    ///
+    // Get the number of draws in the queue.
+    //
+    // @return the number of draws
+    ///
+    size_t size( void ) const;
+
+    ///
+    // Get the object of a draw; for a batch, its first member.
+    //
+    // @param i - the position of the draw in key order
+    //
+    // @return the index of the object
+    ///
+    int item( size_t i ) const;
+};
+
+#endif
@@ -0,0 +1,86 @@
+//
+// RenderState.cpp
+//
+// The GL state bound for drawing, so a program, texture or vertex array
+// object is only bound again when it changes.
+//
+// Author:  Jietong Chen
+//
+
+#include "RenderState.h"
+
+// the bound state; ~0 matches no object, so the first call always binds
+static GLuint boundProgram = ~0u;
+static GLuint boundTexture = ~0u;
+static GLuint boundVertexArray = ~0u;
+
+// the state changes counted so far
+static StateCounts counts;
+
+///
+// Use a program, unless it is in use already.
+//
+// @param program - the ID of a shader program
+///
+void useProgram( GLuint program ) {
+    counts.programs++;
+
+    if( program != boundProgram ) {
+        glUseProgram( program );
+        boundProgram = program;
+        counts.programChanges++;
+    }
+}
+
+///
+// Bind a 2D texture, unless it is bound already.
+//
+// @param texture - the OpenGL texture handle
+///
+void bindTexture( GLuint texture ) {
+    counts.textures++;
+
+    if( texture != boundTexture ) {
+        glBindTexture( GL_TEXTURE_2D, texture );
+        boundTexture = texture;
+        counts.textureChanges++;
+    }
+}
+
+///
+// Bind a vertex array object, unless it is bound already.
+//
+// @param vao - the vertex array object
+///
+void bindVertexArray( GLuint vao ) {
+    counts.vertexArrays++;
+
+    if( vao != boundVertexArray ) {
+        glBindVertexArray( vao );
+        boundVertexArray = vao;
+        counts.vertexArrayChanges++;
+    }
+}
+
+///
+// Forget the bound state, after GL was called around the filter.
+///
+void invalidateState( void ) {
+    boundProgram = boundTexture = boundVertexArray = ~0u;
+}
+
+///
+// Get the state changes counted since the counts were last reset.
+//
+// @return the counts
+///
+const StateCounts &stateCounts( void ) {
+    return counts;
+}
+
+///
+// Start counting the state changes from zero.
+///
+void resetStateCounts( void ) {
+    counts = StateCounts();
+}
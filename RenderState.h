@@ -0,0 +1,72 @@
+//
+// RenderState.h
+//
+// The GL state bound for drawing, so a program, texture or vertex array
+// object is only bound again when it changes.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _RENDERSTATE_H_
+#define _RENDERSTATE_H_
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+#ifndef __APPLE__
+#include <GL/glew.h>
+#endif
+
+#include <GLFW/glfw3.h>
+
+///
+// Number of state changes asked for, and of those reaching GL.
+///
+struct StateCounts {
+    // calls made by the drawing code
+    int programs, textures, vertexArrays;
+
+    // calls issued to GL, the others repeated the bound value
+    int programChanges, textureChanges, vertexArrayChanges;
+};
+
+///
+// Use a program, unless it is in use already.
+//
+// @param program - the ID of a shader program
+///
+void useProgram( GLuint program );
+
+///
+// Bind a 2D texture, unless it is bound already.
+//
+// @param texture - the OpenGL texture handle
+///
+void bindTexture( GLuint texture );
+
+///
+// Bind a vertex array object, unless it is bound already.
+//
+// @param vao - the vertex array object
+///
+void bindVertexArray( GLuint vao );
+
+///
+// Forget the bound state, after GL was called around the filter.
+///
+void invalidateState( void );
+
+///
+// Get the state changes counted since the counts were last reset.
+//
+// @return the counts
+///
+const StateCounts &stateCounts( void );
+
+///
+// Start counting the state changes from zero.
+///
+void resetStateCounts( void );
+
+#endif
@@ -0,0 +1,710 @@
+//
+// SceneFile.cpp
+//
+// The description of a scene read from a file: the textures, materials
+// and objects, with the mesh, program and placement of each object.  The
+// text form is written by hand, and compiled to a binary form next to it
+// that later runs read instead.
+//
+// The text form has one statement per line, and '#' starts a comment:
+//
+//     texture <name> <image file>
+//
+//     material <name>
+//         ambient <r> <g> <b> <a>
+//         diffuse <r> <g> <b> <a>
+//         specular <r> <g> <b> <a>
+//         ka <value>
+//         kd <value>
+//         ks <value>
+//         shininess <value>
+//     end
+//
+//     object <name>
+//         mesh <shape>
+//         program phong | texture | glass
+//         material <name>
+//         texture <name>
+//         pass opaque | cutout | transparent
+//         parent <name of an earlier object>
+//         occluder
+//         scale <x> <y> <z>
+//         rotateX | rotateY | rotateZ <degrees>
+//         translate <x> <y> <z>
+//     end
+//
+// The transformations of an object apply in the order they are given.
+//
+// Author:  Jietong Chen
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "MeshRegistry.h"
+#include "SceneFile.h"
+#include "Shapes.h"
+#include "Textures.h"
+
+using namespace std;
+
+// "TCSC", the first bytes of every compiled scene
+static const unsigned int SCENE_MAGIC = 0x43534354;
+
+// bump whenever the layout of the compiled scene changes
+static const unsigned int SCENE_VERSION = 1;
+
+// the programs, by their PROGRAM_ macros
+static const char *const programNames[] = { "phong", "texture", "glass" };
+
+// the render passes, by their PASS_ macros
+static const char *const passNames[] = { "opaque", "cutout", "transparent" };
+
+///
+// Identifies the text a compiled scene was made from.
+///
+struct SceneKey {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long size;
+    long long mtime;
+    unsigned long long hash;
+};
+
+///
+// Header of a compiled scene, followed by the strings, the textures, the
+// materials and the objects exactly as a SceneDescription holds them.
+///
+struct SceneHeader {
+    SceneKey key;
+    unsigned int numStrings;
+    unsigned int numTextures;
+    unsigned int numMaterials;
+    unsigned int numObjects;
+};
+
+///
+// Get the name of the compiled form of a scene.
+//
+// @param filename - the name of the text form
+//
+// @return the name of the compiled form
+///
+static string compiledName( const char *filename ) {
+    return string( filename ) + ".bin";
+}
+
+///
+// Read a whole file.
+//
+// @param filename - the name of the file
+// @param text     - receives the contents of the file
+//
+// @return true if the file could be read
+///
+static bool readText( const char *filename, string &text ) {
+    FILE *fp = fopen( filename, "rb" );
+
+    if( fp == NULL ) {
+        return false;
+    }
+
+    fseek( fp, 0, SEEK_END );
+    long length = ftell( fp );
+    rewind( fp );
+
+    text.resize( size_t( length ) );
+    bool whole = length == 0 ||
+                 fread( &text[ 0 ], 1, size_t( length ), fp ) == size_t( length );
+
+    fclose( fp );
+
+    return whole;
+}
+
+///
+// Build the key of the text of a scene from the size and modification time
+// of its file and a 64-bit FNV-1a hash of its contents and of the names of
+// the shapes, in order.
+//
+// @param filename - the name of the text form
+// @param text     - the contents of the file
+// @param key      - receives the key
+//
+// @return true if the file could be found
+///
+static bool makeKey( const char *filename, const string &text,
+                     SceneKey &key ) {
+    struct stat info;
+
+    if( stat( filename, &info ) != 0 ) {
+        return false;
+    }
+
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i = 0;
+
+    for( ; i + 8 <= text.size(); i += 8 ) {
+        unsigned long long word;
+        memcpy( &word, text.data() + i, 8 );
+        hash = ( hash ^ word ) * 1099511628211ULL;
+    }
+
+    for( ; i < text.size(); i++ ) {
+        hash = ( hash ^ (unsigned char) text[ i ] ) * 1099511628211ULL;
+    }
+
+    // the compiled objects store their shapes by index, so the table of
+    // shapes is part of what they were compiled from
+    for( int k = 0; shapeName( k ) != NULL; k++ ) {
+        for( const char *c = shapeName( k ); ; c++ ) {
+            hash = ( hash ^ (unsigned char) *c ) * 1099511628211ULL;
+            if( *c == '\0' ) {
+                break;
+            }
+        }
+    }
+
+    memset( &key, 0, sizeof( key ) );
+    key.magic = SCENE_MAGIC;
+    key.version = SCENE_VERSION;
+    key.size = (unsigned long long) info.st_size;
+    key.mtime = (long long) info.st_mtime;
+    key.hash = hash;
+
+    return true;
+}
+
+///
+// Report an error in the text of a scene, and quit.
+//
+// @param filename - the name of the text form
+// @param line     - the line number of the error
+// @param message  - what is wrong
+///
+static void sceneError( const char *filename, int line,
+                        const string &message ) {
+    cerr << filename << ":" << line << ": " << message << endl;
+    exit( 1 );
+}
+
+///
+// Find a name in a list of names.
+//
+// @param names - the names
+// @param count - the number of names
+// @param name  - the name to find
+//
+// @return its index, or -1 if it is not in the list
+///
+static int lookup( const char *const *names, int count, const string &name ) {
+    for( int i = 0; i < count; i++ ) {
+        if( name == names[ i ] ) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+///
+// Add a string to the strings of a scene.
+//
+// @param scene - the scene
+// @param s     - the string
+//
+// @return its offset in the strings
+///
+static unsigned int addString( SceneDescription &scene, const string &s ) {
+    unsigned int at = (unsigned int) scene.strings.size();
+
+    scene.strings.insert( scene.strings.end(), s.begin(), s.end() );
+    scene.strings.push_back( '\0' );
+
+    return at;
+}
+
+///
+// Parse the text form of a scene.
+//
+// @param filename - the name of the text form, for reporting
+// @param text     - the text
+// @param scene    - receives the scene
+///
+static void parseScene( const char *filename, const string &text,
+                        SceneDescription &scene ) {
+    // the names given to the textures, materials and objects so far
+    map< string, int > textureOf, materialOf, objectOf;
+
+    // the block being read, and the object or material it describes
+    enum { BLOCK_NONE, BLOCK_MATERIAL, BLOCK_OBJECT } block = BLOCK_NONE;
+    Material *material = NULL;
+    SceneObject *object = NULL;
+
+    // the object being read, placed as the transformations are read
+    Object placed;
+
+    istringstream lines( text );
+    string line;
+    int lineNumber = 0;
+
+    while( getline( lines, line ) ) {
+        lineNumber++;
+
+        size_t comment = line.find( '#' );
+        if( comment != string::npos ) {
+            line.erase( comment );
+        }
+
+        istringstream in( line );
+        string keyword, name;
+
+        if( !( in >> keyword ) ) {
+            continue;
+        }
+
+        if( block == BLOCK_NONE ) {
+            if( keyword == "texture" ) {
+                string path;
+
+                if( !( in >> name >> path ) ) {
+                    sceneError( filename, lineNumber,
+                                "expected a texture name and file" );
+                }
+
+                textureOf[ name ] = int( scene.textures.size() );
+                scene.textures.push_back( addString( scene, path ) );
+            } else if( keyword == "material" ) {
+                if( !( in >> name ) ) {
+                    sceneError( filename, lineNumber,
+                                "expected a material name" );
+                }
+
+                materialOf[ name ] = int( scene.materials.size() );
+                scene.materials.push_back( Material() );
+                material = &scene.materials.back();
+                block = BLOCK_MATERIAL;
+            } else if( keyword == "object" ) {
+                if( !( in >> name ) ) {
+                    sceneError( filename, lineNumber,
+                                "expected an object name" );
+                }
+                if( objectOf.count( name ) ) {
+                    sceneError( filename, lineNumber,
+                                "object '" + name + "' is already defined" );
+                }
+
+                objectOf[ name ] = int( scene.objects.size() );
+
+                SceneObject added;
+                memset( &added, 0, sizeof( added ) );
+                added.name = addString( scene, name );
+                added.shape = -1;
+                added.program = PROGRAM_PHONG;
+                added.material = -1;
+                added.texture = -1;
+                added.pass = PASS_OPAQUE;
+                added.parent = -1;
+
+                scene.objects.push_back( added );
+                object = &scene.objects.back();
+                placed.reset();
+                block = BLOCK_OBJECT;
+            } else {
+                sceneError( filename, lineNumber,
+                            "unknown statement '" + keyword + "'" );
+            }
+        } else if( keyword == "end" ) {
+            if( block == BLOCK_OBJECT ) {
+                if( object->shape < 0 || object->material < 0 ) {
+                    sceneError( filename, lineNumber,
+                                "the object needs a mesh and a material" );
+                }
+
+                memcpy( object->model, value_ptr( placed.Model ),
+                        sizeof( object->model ) );
+            }
+
+            block = BLOCK_NONE;
+        } else if( block == BLOCK_MATERIAL ) {
+            vec4 *color = keyword == "ambient" ? &material->ambientColor :
+                          keyword == "diffuse" ? &material->diffuseColor :
+                          keyword == "specular" ? &material->specularColor :
+                          NULL;
+            float *value = keyword == "ka" ? &material->ka :
+                           keyword == "kd" ? &material->kd :
+                           keyword == "ks" ? &material->ks :
+                           keyword == "shininess" ? &material->shininess :
+                           NULL;
+
+            if( color != NULL ) {
+                if( !( in >> color->r >> color->g >> color->b >>
+                       color->a ) ) {
+                    sceneError( filename, lineNumber,
+                                "expected four color components" );
+                }
+            } else if( value != NULL ) {
+                if( !( in >> *value ) ) {
+                    sceneError( filename, lineNumber, "expected a value" );
+                }
+            } else {
+                sceneError( filename, lineNumber,
+                            "unknown material property '" + keyword + "'" );
+            }
+        } else if( keyword == "occluder" ) {
+            object->occluder = 1;
+        } else if( keyword == "scale" || keyword == "translate" ) {
+            float x, y, z;
+
+            if( !( in >> x >> y >> z ) ) {
+                sceneError( filename, lineNumber, "expected three values" );
+            }
+
+            if( keyword == "scale" ) {
+                placed.scale( x, y, z );
+            } else {
+                placed.translate( x, y, z );
+            }
+        } else if( keyword == "rotateX" || keyword == "rotateY" ||
+                   keyword == "rotateZ" ) {
+            float angle;
+
+            if( !( in >> angle ) ) {
+                sceneError( filename, lineNumber, "expected an angle" );
+            }
+
+            if( keyword == "rotateX" ) {
+                placed.rotateX( angle );
+            } else if( keyword == "rotateY" ) {
+                placed.rotateY( angle );
+            } else {
+                placed.rotateZ( angle );
+            }
+        } else {
+            if( !( in >> name ) ) {
+                sceneError( filename, lineNumber,
+                            "expected a name after '" + keyword + "'" );
+            }
+
+            int *field;
+            int index;
+
+            if( keyword == "mesh" ) {
+                field = &object->shape;
+                index = -1;
+                for( int k = 0; shapeName( k ) != NULL; k++ ) {
+                    if( name == shapeName( k ) ) {
+                        index = k;
+                    }
+                }
+            } else if( keyword == "program" ) {
+                field = &object->program;
+                index = lookup( programNames, NUM_PROGRAMS, name );
+            } else if( keyword == "pass" ) {
+                field = &object->pass;
+                index = lookup( passNames, PASS_TRANSPARENT + 1, name );
+            } else {
+                map< string, int > *names =
+                        keyword == "material" ? &materialOf :
+                        keyword == "texture" ? &textureOf :
+                        keyword == "parent" ? &objectOf : NULL;
+
+                if( names == NULL ) {
+                    sceneError( filename, lineNumber,
+                                "unknown object property '" + keyword + "'" );
+                }
+
+                field = keyword == "material" ? &object->material :
+                        keyword == "texture" ? &object->texture :
+                        &object->parent;
+
+                map< string, int >::iterator it = names->find( name );
+                index = it == names->end() ? -1 : it->second;
+            }
+
+            if( index < 0 ) {
+                sceneError( filename, lineNumber, "unknown " + keyword +
+                                                  " '" + name + "'" );
+            }
+
+            // the object itself is named already, but not placed yet
+            if( field == &object->parent &&
+                index >= int( scene.objects.size() ) - 1 ) {
+                sceneError( filename, lineNumber,
+                            "an object cannot rest on itself" );
+            }
+
+            *field = index;
+        }
+    }
+
+    if( block != BLOCK_NONE ) {
+        sceneError( filename, lineNumber, "missing 'end'" );
+    }
+}
+
+///
+// Check that every index and offset of a scene names something in it, as
+// instantiateScene() takes them on trust.
+//
+// @param scene - the scene
+//
+// @return true if the scene can be made
+///
+static bool validScene( const SceneDescription &scene ) {
+    size_t numStrings = scene.strings.size();
+
+    // every string ends within the strings
+    if( numStrings > 0 && scene.strings[ numStrings - 1 ] != '\0' ) {
+        return false;
+    }
+
+    for( size_t t = 0; t < scene.textures.size(); t++ ) {
+        if( scene.textures[ t ] >= numStrings ) {
+            return false;
+        }
+    }
+
+    int numMaterials = int( scene.materials.size() );
+    int numTextures = int( scene.textures.size() );
+
+    for( size_t i = 0; i < scene.objects.size(); i++ ) {
+        const SceneObject &desc = scene.objects[ i ];
+
+        if( desc.name >= numStrings || shapeName( desc.shape ) == NULL ||
+            desc.program < 0 || desc.program >= NUM_PROGRAMS ||
+            desc.material < 0 || desc.material >= numMaterials ||
+            desc.texture < -1 || desc.texture >= numTextures ||
+            desc.pass < PASS_OPAQUE || desc.pass > PASS_TRANSPARENT ||
+            desc.parent < -1 || desc.parent >= int( i ) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+///
+// Read the compiled form of a scene.
+//
+// @param filename - the name of the text form
+// @param key      - the key of the text as it is now
+// @param scene    - receives the scene
+//
+// @return true if the compiled form was made from the text as it is now,
+//         has been read and names only what is in it
+///
+static bool readCompiledScene( const char *filename, const SceneKey &key,
+                               SceneDescription &scene ) {
+    FILE *fp = fopen( compiledName( filename ).c_str(), "rb" );
+
+    if( fp == NULL ) {
+        return false;
+    }
+
+    fseek( fp, 0, SEEK_END );
+    unsigned long long length = (unsigned long long) ftell( fp );
+    rewind( fp );
+
+    SceneHeader header;
+    bool valid = fread( &header, sizeof( header ), 1, fp ) == 1 &&
+                 memcmp( &header.key, &key, sizeof( key ) ) == 0;
+
+    // the counts must fit in the file, before anything is made that large
+    valid = valid && sizeof( header ) +
+            (unsigned long long) header.numStrings +
+            (unsigned long long) header.numTextures * sizeof( unsigned int ) +
+            (unsigned long long) header.numMaterials * sizeof( Material ) +
+            (unsigned long long) header.numObjects * sizeof( SceneObject ) ==
+            length;
+
+    if( valid ) {
+        scene.strings.resize( header.numStrings );
+        scene.textures.resize( header.numTextures );
+        scene.materials.resize( header.numMaterials );
+        scene.objects.resize( header.numObjects );
+
+        valid = ( header.numStrings == 0 ||
+                  fread( &scene.strings[ 0 ], 1, header.numStrings, fp ) ==
+                  header.numStrings ) &&
+                ( header.numTextures == 0 ||
+                  fread( &scene.textures[ 0 ], sizeof( unsigned int ),
+                         header.numTextures, fp ) == header.numTextures ) &&
+                ( header.numMaterials == 0 ||
+                  fread( &scene.materials[ 0 ], sizeof( Material ),
+                         header.numMaterials, fp ) == header.numMaterials ) &&
+                ( header.numObjects == 0 ||
+                  fread( &scene.objects[ 0 ], sizeof( SceneObject ),
+                         header.numObjects, fp ) == header.numObjects );
+
+        if( valid && !validScene( scene ) ) {
+            cerr << compiledName( filename ) << " is not valid, ignored"
+                 << endl;
+            valid = false;
+        }
+    }
+
+    fclose( fp );
+
+    if( !valid ) {
+        scene = SceneDescription();
+    }
+
+    return valid;
+}
+
+///
+// Write the compiled form of a scene.
+//
+// @param filename - the name of the text form
+// @param key      - the key of the text it was made from
+// @param scene    - the scene
+///
+static void writeCompiledScene( const char *filename, const SceneKey &key,
+                                const SceneDescription &scene ) {
+    string name = compiledName( filename );
+    FILE *fp = fopen( name.c_str(), "wb" );
+
+    // the scene is still usable, just not compiled
+    if( fp == NULL ) {
+        cerr << "Cannot write " << name << endl;
+        return;
+    }
+
+    SceneHeader header;
+    memset( &header, 0, sizeof( header ) );
+    header.key = key;
+    header.numStrings = (unsigned int) scene.strings.size();
+    header.numTextures = (unsigned int) scene.textures.size();
+    header.numMaterials = (unsigned int) scene.materials.size();
+    header.numObjects = (unsigned int) scene.objects.size();
+
+    fwrite( &header, sizeof( header ), 1, fp );
+    if( !scene.strings.empty() ) {
+        fwrite( &scene.strings[ 0 ], 1, scene.strings.size(), fp );
+    }
+    if( !scene.textures.empty() ) {
+        fwrite( &scene.textures[ 0 ], sizeof( unsigned int ),
+                scene.textures.size(), fp );
+    }
+    if( !scene.materials.empty() ) {
+        fwrite( &scene.materials[ 0 ], sizeof( Material ),
+                scene.materials.size(), fp );
+    }
+    if( !scene.objects.empty() ) {
+        fwrite( &scene.objects[ 0 ], sizeof( SceneObject ),
+                scene.objects.size(), fp );
+    }
+
+    fclose( fp );
+}
+
+///
+// Read a scene, from its binary form if that was compiled from the text
+// as it is now, or else from the text, compiling the binary form for the
+// next run.
+//
+// @param filename - the name of the text form of the scene
+// @param scene    - receives the scene
+///
+void loadScene( const char *filename, SceneDescription &scene ) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    string text;
+    SceneKey key;
+
+    if( !readText( filename, text ) || !makeKey( filename, text, key ) ) {
+        cerr << "Cannot open " << filename << endl;
+        exit( 1 );
+    }
+
+    // warm load, the scene was compiled by an earlier run
+    bool warm = readCompiledScene( filename, key, scene );
+
+    if( !warm ) {
+        // cold load, parse and compile the text
+        scene = SceneDescription();
+        parseScene( filename, text, scene );
+        writeCompiledScene( filename, key, scene );
+    }
+
+    chrono::duration< double, milli > elapsed =
+            chrono::steady_clock::now() - start;
+
+    cout << filename << ": " << ( warm ? "warm" : "cold" ) << " load "
+         << elapsed.count() << " ms, " << scene.objects.size() << " objects, "
+         << scene.materials.size() << " materials, "
+         << scene.textures.size() << " textures" << endl;
+}
+
+///
+// Make the objects of a scene.  The meshes are made, and the textures
+// decoded, in parallel before any object is.
+//
+// @param scene     - the scene, kept as long as the objects are, since
+//                    they are named from its strings
+// @param programs  - the program of each PROGRAM_ macro
+// @param C         - the Canvas to make the shapes in, left clear
+// @param objects   - receives the objects
+// @param graph     - receives one node per object
+// @param occlusion - receives the occluders
+//
+// @return the handle of the node of each object
+///
+vector< int > instantiateScene( const SceneDescription &scene,
+                                const GLuint *programs, Canvas &C,
+                                vector< Object > &objects,
+                                SceneGraph &graph,
+                                OcclusionCuller &occlusion ) {
+    size_t n = scene.objects.size();
+
+    // every mesh of the scene, made together
+    vector< int > shapes( n );
+    for( size_t i = 0; i < n; i++ ) {
+        shapes[ i ] = scene.objects[ i ].shape;
+    }
+    preloadMeshes( shapes );
+
+    // every texture of the scene, decoded together
+    vector< const char * > files( scene.textures.size() );
+    for( size_t t = 0; t < files.size(); t++ ) {
+        files[ t ] = &scene.strings[ scene.textures[ t ] ];
+    }
+
+    vector< GLuint > textures;
+    loadTextures( files, textures );
+
+    vector< int > nodes( n );
+    objects.reserve( objects.size() + n );
+
+    for( size_t i = 0; i < n; i++ ) {
+        const SceneObject &desc = scene.objects[ i ];
+
+        Object obj( programs[ desc.program ], desc.shape, C );
+        obj.name = &scene.strings[ desc.name ];
+        obj.material = scene.materials[ desc.material ];
+        obj.texture = desc.texture < 0 ? 0 : textures[ desc.texture ];
+        obj.pass = desc.pass;
+        obj.Model = make_mat4( desc.model );
+
+        if( desc.occluder ) {
+            occlusion.addOccluder( obj, int( objects.size() ), desc.shape, C );
+        }
+
+        nodes[ i ] = graph.addNode( desc.parent < 0 ? -1 :
+                                    nodes[ desc.parent ],
+                                    int( objects.size() ), obj );
+        objects.push_back( obj );
+    }
+
+    return nodes;
+}
@@ -0,0 +1,103 @@
+//
+// SceneFile.h
+//
+// The description of a scene read from a file: the textures, materials
+// and objects, with the mesh, program and placement of each object.  The
+// text form is written by hand, and compiled to a binary form next to it
+// that later runs read instead.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _SCENEFILE_H_
+#define _SCENEFILE_H_
+
+#include <vector>
+
+#include "Canvas.h"
+#include "Material.h"
+#include "Object.h"
+#include "Occlusion.h"
+#include "SceneGraph.h"
+
+// Macros for the programs an object can be drawn with
+#define PROGRAM_PHONG   0
+#define PROGRAM_TEXTURE 1
+#define PROGRAM_GLASS   2
+#define NUM_PROGRAMS    3
+
+///
+// One object of a scene, as the binary form stores it.
+///
+struct SceneObject {
+    // offset of the name in the strings of the scene
+    unsigned int name;
+
+    // which shape the object draws
+    int shape;
+    // which program draws it
+    int program;
+    // index of its material, and of its texture or -1 for none
+    int material;
+    int texture;
+    // the render pass drawing it
+    int pass;
+
+    // index of the object it rests on, -1 for none; always an earlier one
+    int parent;
+    // whether it hides the objects behind it from the occlusion culling
+    int occluder;
+
+    // the model transformation, by column
+    float model[16];
+};
+
+///
+// The textures, materials and objects of a scene.
+///
+struct SceneDescription {
+    // the names of the objects and the files of the textures, each ending
+    // with a NUL
+    vector< char > strings;
+
+    // offset of the file of each texture in the strings
+    vector< unsigned int > textures;
+
+    // the materials
+    vector< Material > materials;
+
+    // the objects, in drawing order
+    vector< SceneObject > objects;
+};
+
+///
+// Read a scene, from its binary form if that was compiled from the text
+// as it is now, or else from the text, compiling the binary form for the
+// next run.
+//
+// @param filename - the name of the text form of the scene
+// @param scene    - receives the scene
+///
+void loadScene( const char *filename, SceneDescription &scene );
+
+///
+// Make the objects of a scene.  The meshes are made, and the textures
+// decoded, in parallel before any object is.
+//
+// @param scene     - the scene, kept as long as the objects are, since
+//                    they are named from its strings
+// @param programs  - the program of each PROGRAM_ macro
+// @param C         - the Canvas to make the shapes in, left clear
+// @param objects   - receives the objects
+// @param graph     - receives one node per object
+// @param occlusion - receives the occluders
+//
+// @return the handle of the node of each object
+///
+vector< int > instantiateScene( const SceneDescription &scene,
+                                const GLuint *programs, Canvas &C,
+                                vector< Object > &objects,
+                                SceneGraph &graph,
+                                OcclusionCuller &occlusion );
+
+#endif
@@ -0,0 +1,189 @@
+//
+// SceneGraph.cpp
+//
+// The placement of the objects in the scene as a hierarchy: each node is
+// placed relative to its parent, so moving a node carries everything
+// resting on it along.
+//
+// Author:  Jietong Chen
+//
+
+#include <algorithm>
+
+#include "SceneGraph.h"
+
+///
+// Mark a node as changed.
+//
+// @param p - position of the node
+///
+void SceneGraph::touch( int p ) {
+    if( !dirty[ p ] ) {
+        dirty[ p ] = 1;
+        pending.push_back( p );
+    }
+}
+
+///
+// Add a node placing an object where the object is now, relative to its
+// parent.  The model matrix of the object must be a translation times a
+// rotation times a scale, and the scale of the parent the same on every
+// axis.
+//
+// The node goes right after the subtree of its parent, keeping the order
+// depth first.  The object stays
+// exactly where it is until the node or one of its ancestors changes.
+//
+// @param parentNode - handle of the parent, -1 for a root
+// @param i          - index of the object
+// @param obj        - the object, placed
+//
+// @return the handle of the node
+///
+int SceneGraph::addNode( int parentNode, int i, const Object &obj ) {
+    int up = parentNode < 0 ? -1 : slot[ parentNode ];
+    int p = up < 0 ? int( parent.size() ) : up + size[ up ];
+
+    // the placement relative to the parent, split into its parts
+    mat4 Local = up < 0 ? obj.Model : inverse( world[ up ] ) * obj.Model;
+
+    vec3 s( length( vec3( Local[ 0 ] ) ), length( vec3( Local[ 1 ] ) ),
+            length( vec3( Local[ 2 ] ) ) );
+    mat3 R( vec3( Local[ 0 ] ) / s.x, vec3( Local[ 1 ] ) / s.y,
+            vec3( Local[ 2 ] ) / s.z );
+
+    // the nodes after it move one place on; an appended node moves none
+    if( p < int( parent.size() ) ) {
+        for( size_t k = 0; k < parent.size(); k++ ) {
+            if( parent[ k ] >= p ) {
+                parent[ k ]++;
+            }
+        }
+        for( size_t k = 0; k < slot.size(); k++ ) {
+            if( slot[ k ] >= p ) {
+                slot[ k ]++;
+            }
+        }
+        for( size_t k = 0; k < pending.size(); k++ ) {
+            if( pending[ k ] >= p ) {
+                pending[ k ]++;
+            }
+        }
+    }
+
+    // the ancestors come before it, so their positions stay
+    for( int a = up; a >= 0; a = parent[ a ] ) {
+        size[ a ]++;
+    }
+
+    parent.insert( parent.begin() + p, up );
+    size.insert( size.begin() + p, 1 );
+    translation.insert( translation.begin() + p, vec3( Local[ 3 ] ) );
+    rotation.insert( rotation.begin() + p, quat_cast( R ) );
+    scaling.insert( scaling.begin() + p, s );
+    world.insert( world.begin() + p, obj.Model );
+    objectOf.insert( objectOf.begin() + p, i );
+    dirty.insert( dirty.begin() + p, 0 );
+
+    slot.push_back( p );
+    return int( slot.size() ) - 1;
+}
+
+///
+// Get the local translation of a node.
+//
+// @param node - handle of the node
+//
+// @return its translation
+///
+vec3 SceneGraph::getTranslation( int node ) const {
+    return translation[ slot[ node ] ];
+}
+
+///
+// Set the local translation of a node.
+//
+// @param node - handle of the node
+// @param t    - the translation
+///
+void SceneGraph::setTranslation( int node, const vec3 &t ) {
+    translation[ slot[ node ] ] = t;
+    touch( slot[ node ] );
+}
+
+///
+// Set the local rotation of a node.
+//
+// @param node - handle of the node
+// @param q    - the rotation
+///
+void SceneGraph::setRotation( int node, const quat &q ) {
+    rotation[ slot[ node ] ] = q;
+    touch( slot[ node ] );
+}
+
+///
+// Set the local scale of a node.
+//
+// @param node - handle of the node
+// @param s    - the scale on each axis
+///
+void SceneGraph::setScale( int node, const vec3 &s ) {
+    scaling[ slot[ node ] ] = s;
+    touch( slot[ node ] );
+}
+
+///
+// Compute the world matrices of the changed nodes and their subtrees, and
+// place their objects; the nodes that did not change cost nothing.
+//
+// In depth first order a subtree is one run of nodes with every parent
+// computed before its children, so each changed node takes one pass over
+// its run; a changed node inside a run already computed is skipped.
+//
+// @param objects - the objects in the scene
+//
+// @return the number of nodes computed
+///
+int SceneGraph::update( vector< Object > &objects ) {
+    if( pending.empty() ) {
+        return 0;
+    }
+
+    sort( pending.begin(), pending.end() );
+
+    int end = 0, numComputed = 0;
+
+    for( size_t k = 0; k < pending.size(); k++ ) {
+        int p = pending[ k ];
+
+        if( p < end ) {
+            continue;
+        }
+        end = p + size[ p ];
+
+        for( int q = p; q < end; q++ ) {
+            mat3 R = mat3_cast( rotation[ q ] );
+            const vec3 &s = scaling[ q ];
+
+            mat4 Local( vec4( R[ 0 ] * s.x, 0.0f ), vec4( R[ 1 ] * s.y, 0.0f ),
+                        vec4( R[ 2 ] * s.z, 0.0f ),
+                        vec4( translation[ q ], 1.0f ) );
+
+            world[ q ] = parent[ q ] < 0 ? Local : world[ parent[ q ] ] * Local;
+            dirty[ q ] = 0;
+
+            if( objectOf[ q ] >= 0 ) {
+                Object &obj = objects[ objectOf[ q ] ];
+                obj.Model = world[ q ];
+                obj.moved = true;
+            }
+
+            numComputed++;
+        }
+    }
+
+    pending.clear();
+
+    return numComputed;
+}
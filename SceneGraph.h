@@ -0,0 +1,122 @@
+//
+// SceneGraph.h
+//
+// The placement of the objects in the scene as a hierarchy: each node is
+// placed relative to its parent, so moving a node carries everything
+// resting on it along.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _SCENEGRAPH_H_
+#define _SCENEGRAPH_H_
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Object.h"
+
+///
+// The nodes of the scene, as one array per field in depth first order, so
+// the subtree of a node is the nodes following it and a parent always
+// comes before its children.
+///
+class SceneGraph {
+
+    // position of the parent of each node, -1 for a root
+    vector< int > parent;
+
+    // number of nodes in the subtree of each node, itself included
+    vector< int > size;
+
+    // local translation, rotation and scale of each node
+    vector< vec3 > translation;
+    vector< quat > rotation;
+    vector< vec3 > scaling;
+
+    // world matrix of each node, as of the last update
+    vector< mat4 > world;
+
+    // object placed by each node, -1 for none
+    vector< int > objectOf;
+
+    // whether each node changed since the last update
+    vector< char > dirty;
+
+    // positions of the changed nodes
+    vector< int > pending;
+
+    // position of each node, by the handle given out for it
+    vector< int > slot;
+
+    ///
+    // Mark a node as changed.
+    //
+    // @param p - position of the node
+    ///
+    void touch( int p );
+
+public:
+
+    ///
+    // Add a node placing an object where the object is now, relative to
+    // its parent.  The model matrix of the object must be a translation
+    // times a rotation times a scale, and the scale of the parent the
+    // same on every axis.
+    //
+    // @param parentNode - handle of the parent, -1 for a root
+    // @param i          - index of the object
+    // @param obj        - the object, placed
+    //
+    // @return the handle of the node
+    ///
+    int addNode( int parentNode, int i, const Object &obj );
+
+    ///
+    // Get the local translation of a node.
+    //
+    // @param node - handle of the node
+    //
+    // @return its translation
+    ///
+    vec3 getTranslation( int node ) const;
+
+    ///
+    // Set the local translation of a node.
+    //
+    // @param node - handle of the node
+    // @param t    - the translation
+    ///
+    void setTranslation( int node, const vec3 &t );
+
+    ///
+    // Set the local rotation of a node.
+    //
+    // @param node - handle of the node
+    // @param q    - the rotation
+    ///
+    void setRotation( int node, const quat &q );
+
+    ///
+    // Set the local scale of a node.
+    //
+    // @param node - handle of the node
+    // @param s    - the scale on each axis
+    ///
+    void setScale( int node, const vec3 &s );
+
+    ///
+    // Compute the world matrices of the changed nodes and their subtrees,
+    // and place their objects; the nodes that did not change cost
+    // nothing.
+    //
+    // @param objects - the objects in the scene
+    //
+    // @return the number of nodes computed
+    ///
+    int update( vector< Object > &objects );
+};
+
+#endif
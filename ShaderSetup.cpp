@@ -20,6 +20,10 @@
 
 #include "ShaderSetup.h"
 
+#ifdef __cplusplus
+#include "AssetPack.h"
+#endif
+
 ///
 // readTextFile(name)
 //
@@ -33,6 +37,14 @@ GLchar *readTextFile( const char *name ) {
     GLchar *content = NULL;
     long count = 0;
 
+#ifdef __cplusplus
+    // a cooked file is copied out of the asset pack
+    content = name == NULL ? NULL : readPackedText( name );
+    if( content != NULL ) {
+        return content;
+    }
+#endif
+
     if( name != NULL ) {
 
         // Attempt to open the file
@@ -234,6 +246,66 @@ const char *errorString( ShaderError code ) {
 //      Returns 0, and assigns an error code to 'err'.
 ///
 GLuint shaderSetup( const char *vert, const char *frag, ShaderError *err ) {
+    return( shaderSetupDefines( vert, frag, NULL, err ) );
+}
+
+///
+// shaderSource(shader,src,defines)
+//
+// Attach source to a shader, with the 'defines' lines (if any) placed
+// right after its first line, which holds the #version directive, or
+// in place of that line if 'defines' starts with a #version of its own.
+///
+static void shaderSource( GLuint shader, const GLchar *src,
+                          const char *defines ) {
+    const GLchar *parts[3];
+    GLint lengths[3];
+    const GLchar *rest = src;
+
+    if( defines == NULL ) {
+        glShaderSource( shader, 1, &src, NULL );
+        return;
+    }
+
+    // split after the first line
+    while( *rest != '\0' && *rest != '\n' ) {
+        ++rest;
+    }
+    if( *rest == '\n' ) {
+        ++rest;
+    }
+
+    parts[0] = src;
+    lengths[0] = (GLint) ( rest - src );
+
+    // a variant needing a later version of the language
+    if( strncmp( defines, "#version", 8 ) == 0 ) {
+        lengths[0] = 0;
+    }
+    parts[1] = (const GLchar *) defines;
+    lengths[1] = (GLint) strlen( defines );
+    parts[2] = rest;
+    lengths[2] = -1;    // NUL-terminated
+
+    glShaderSource( shader, 3, parts, lengths );
+}
+
+///
+// shaderSetupDefines(vertex,fragment,defines,err)
+//
+// Set up a GLSL shader program, with extra preprocessor lines placed
+// right after the #version line of both shaders.
+//
+// Arguments:
+//      vert    - vertex shader program source file
+//      frag    - fragment shader program source file
+//      defines - lines such as "#define INSTANCED\n", or NULL
+//      err     - pointer to status variable
+//
+// Returns as shaderSetup() does.
+///
+GLuint shaderSetupDefines( const char *vert, const char *frag,
+                           const char *defines, ShaderError *err ) {
     GLchar *vsrc = NULL, *fsrc = NULL;
     GLuint vs, fs, prog;
     GLint flag;
@@ -268,8 +340,8 @@ GLuint shaderSetup( const char *vert, const char *frag, ShaderError *err ) {
     }
 
     // Attach the source to the shaders
-    glShaderSource( vs, 1, (const GLchar **) &vsrc, NULL );
-    glShaderSource( fs, 1, (const GLchar **) &fsrc, NULL );
+    shaderSource( vs, vsrc, defines );
+    shaderSource( fs, fsrc, defines );
 
     // We're done with the source code now
 #ifdef __cplusplus
@@ -302,6 +374,16 @@ GLuint shaderSetup( const char *vert, const char *frag, ShaderError *err ) {
     glAttachShader( prog, vs );
     glAttachShader( prog, fs );
 
+    // Fix the attribute locations; names a shader lacks are ignored
+    glBindAttribLocation( prog, ATTRIB_POSITION, "vPosition" );
+    glBindAttribLocation( prog, ATTRIB_COLOR, "vColor" );
+    glBindAttribLocation( prog, ATTRIB_NORMAL, "vNormal" );
+    glBindAttribLocation( prog, ATTRIB_TEXCOORD, "vTexCoord" );
+    glBindAttribLocation( prog, ATTRIB_INSTANCE_MODEL, "iModelMat" );
+    glBindAttribLocation( prog, ATTRIB_INSTANCE_NORMAL, "iNormalMat" );
+    glBindAttribLocation( prog, ATTRIB_INSTANCE_MATERIAL, "iMaterial" );
+    glBindAttribLocation( prog, ATTRIB_DRAW_INDEX, "iDrawIndex" );
+
     // Report any message log information
     printProgramInfoLog( prog );
 
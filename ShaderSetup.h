@@ -17,6 +17,20 @@
 
 #include <GLFW/glfw3.h>
 
+///
+// Locations of the vertex attributes, bound in every program before it
+// is linked so one vertex array object serves every program
+///
+
+#define ATTRIB_POSITION          0
+#define ATTRIB_COLOR             1
+#define ATTRIB_NORMAL            2
+#define ATTRIB_TEXCOORD          3
+#define ATTRIB_INSTANCE_MODEL    4    // four columns, 4 to 7
+#define ATTRIB_INSTANCE_NORMAL   8    // three columns, 8 to 10
+#define ATTRIB_INSTANCE_MATERIAL 11
+#define ATTRIB_DRAW_INDEX        12
+
 ///
 // Error codes returned by ShaderSetup()
 ///
@@ -83,4 +97,24 @@ const char *errorString( ShaderError code );
 ///
 GLuint shaderSetup( const char *vert, const char *frag, ShaderError *err );
 
+///
+// shaderSetupDefines(vertex,fragment,defines,err)
+//
+// Set up a GLSL shader program, as shaderSetup() does, with extra
+// preprocessor lines placed right after the #version line of both
+// shaders so one source can build several variants of a program.  When
+// the lines start with a #version directive of their own, it replaces
+// the one of the shaders.
+//
+// Arguments:
+//      vert    - vertex shader program source file
+//      frag    - fragment shader program source file
+//      defines - lines such as "#define INSTANCED\n", or NULL
+//      err     - pointer to status variable
+//
+// Returns as shaderSetup() does.
+///
+GLuint shaderSetupDefines( const char *vert, const char *frag,
+                           const char *defines, ShaderError *err );
+
 #endif
@@ -8,18 +8,38 @@
 //  Contributor:  Jietong Chen
 //
 
+#include <chrono>
 #include <iostream>
+#include <sstream>
 #include <cmath>
 #include <cstdio>
-#include <fstream>
-#include <sstream>
+#include <cstdlib>
+#include <cstring>
 #include <glm/glm.hpp>
 
 using namespace std;
 
 #include "Canvas.h"
 #include "Shapes.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "Object.h"
+#include "ThreadPool.h"
+
+// files at least this long are parsed on the shared thread pool
+static const size_t PARALLEL_PARSE_MIN_BYTES = 1 << 20;
+
+// the smallest chunk of a file handed to one parser thread
+static const size_t PARSE_CHUNK_MIN_BYTES = 64 << 10;
+
+// size of the FIFO post-transform cache the mesh statistics assume
+static const int ANALYZE_CACHE_SIZE = 16;
+
+// whether the shapes asking for it get the overdraw pass, and how much it
+// may raise the cache miss ratio of each cluster of triangles over the
+// vertex cache order, in hundredths; 105 allows 5%
+static bool overdrawEnabled = true;
+static unsigned int overdrawPercent = 105;
 
 /*
 ** The quad
@@ -134,6 +154,192 @@ static void makeQuad( Canvas &C ) {
     }
 }
 
+///
+// Turn the triangles read into the Canvas into the mesh handed to the GPU.
+//
+// @param name  - the name of the shape, for reporting
+// @param flags - the processing to apply
+// @param C     - the Canvas to use
+///
+static void processShape( const char *name, unsigned int flags,
+                          Canvas &C ) {
+    if( flags & SHAPE_CYLINDRICAL_UV ) {
+        // needs the unshared vertices of each face to fix up the seam
+        cylindricalUV( C );
+    }
+
+    // share the vertices common to adjacent faces
+    weldVertices( C );
+
+    float acmrBefore, atvrBefore, acmrAfter, atvrAfter;
+    analyzeVertexCache( C, ANALYZE_CACHE_SIZE, acmrBefore, atvrBefore );
+
+    // order the triangles for the post-transform cache
+    optimizeVertexCache( C );
+
+    if( flags & SHAPE_OPTIMIZE_OVERDRAW ) {
+        // then, at some cost in cache hits, outward facing surfaces first
+        float threshold = ( flags >> SHAPE_OVERDRAW_SHIFT ) / 100.0f;
+        optimizeOverdraw( C, ANALYZE_CACHE_SIZE, threshold );
+    }
+
+    // and finally the vertices for fetch
+    optimizeVertexFetch( C );
+
+    analyzeVertexCache( C, ANALYZE_CACHE_SIZE, acmrAfter, atvrAfter );
+
+    // one line at a time, as shapes are made on several threads
+    ostringstream line;
+    line << name << ": ACMR " << acmrBefore << " -> " << acmrAfter
+         << ", ATVR " << atvrBefore << " -> " << atvrAfter << endl;
+    cout << line.str();
+}
+
+///
+// Load a model file into the Canvas, through the mesh cache.
+//
+// @param filename - the name of the model file
+// @param flags    - the processing to apply after reading the model
+// @param C        - the Canvas to use
+///
+static void loadShape( const char *filename, unsigned int flags, Canvas &C ) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // warm load, the streams were built by an earlier run
+    bool warm = readMeshCache( filename, flags, C );
+
+    if( !warm ) {
+        // cold load, parse and process the model file
+        readShape( filename, C );
+        processShape( filename, flags, C );
+        writeMeshCache( filename, flags, C );
+    }
+
+    chrono::duration< double, milli > elapsed =
+            chrono::steady_clock::now() - start;
+
+    ostringstream line;
+    line << filename << ": " << ( warm ? "warm" : "cold" ) << " load "
+         << elapsed.count() << " ms, " << C.numVertices() << " vertices, "
+         << C.numIndices() << " elements" << endl;
+    cout << line.str();
+}
+
+///
+// Where each shape comes from, by its OBJ_ macro.
+///
+struct ShapeSource {
+    // the name scene files and the asset pack give it
+    const char *name;
+    // its model file, NULL if it is made in code
+    const char *file;
+    // the processing applied after reading it
+    unsigned int flags;
+};
+
+static const ShapeSource shapeSources[] = {
+    { "apple",    "model/Apple.obj",    0 },
+    { "cookies1", "model/Cookies1.obj", 0 },
+    { "cookies2", "model/Cookies2.obj", 0 },
+    // apply cylindrical texture mapping on the cup
+    { "cup",      "model/Cup.obj",
+      SHAPE_CYLINDRICAL_UV | SHAPE_OPTIMIZE_OVERDRAW },
+    { "doughnut", "model/Doughnut.obj", 0 },
+    { "foliage",  "model/Foliage.obj",  0 },
+    { "plate",    "model/Plate.obj",    0 },
+    // the glass is blended, so every hidden layer costs a fragment
+    { "pot",      "model/Pot.obj",      SHAPE_OPTIMIZE_OVERDRAW },
+    { "quad",     NULL,                 0 },
+    { "spoon",    "model/Spoon.obj",    0 },
+    { "table",    "model/Table.obj",    0 },
+    { "teapot",   "model/Teapot.obj",   0 }
+};
+
+///
+// Get the name of a shape, as scene files and the asset pack give it.
+//
+// @param choice - which shape
+//
+// @return its name, or NULL for no shape
+///
+const char *shapeName( int choice ) {
+    return choice >= 0 && choice <= OBJ_TEAPOT ?
+           shapeSources[ choice ].name : NULL;
+}
+
+///
+// Get the model file a shape is read from.
+//
+// @param choice - which shape
+//
+// @return the name of the file, or NULL if the shape is made in code
+///
+const char *shapeFile( int choice ) {
+    return choice >= 0 && choice <= OBJ_TEAPOT ?
+           shapeSources[ choice ].file : NULL;
+}
+
+///
+// Get the processing applied to a shape after it is read, as it is set
+// now.
+//
+// @param choice - which shape
+//
+// @return its SHAPE_ flags, with the overdraw threshold above
+//         SHAPE_OVERDRAW_SHIFT if it gets the overdraw pass
+///
+unsigned int shapeFlags( int choice ) {
+    if( choice < 0 || choice > OBJ_TEAPOT ) {
+        return 0;
+    }
+
+    unsigned int flags = shapeSources[ choice ].flags;
+
+    if( flags & SHAPE_OPTIMIZE_OVERDRAW ) {
+        if( overdrawEnabled ) {
+            flags |= overdrawPercent << SHAPE_OVERDRAW_SHIFT;
+        } else {
+            flags &= ~SHAPE_OPTIMIZE_OVERDRAW;
+        }
+    }
+
+    return flags;
+}
+
+///
+// Set the overdraw pass of the shapes asking for it.  Shapes made from
+// here on are processed so; those made already keep their order.
+//
+// @param enabled   - whether they get the pass
+// @param threshold - how much worse than the vertex cache order each
+//                    cluster's cache miss ratio may become, 1.05 allows 5%;
+//                    kept to hundredths, and at least 1
+///
+void setOverdrawOptimization( bool enabled, float threshold ) {
+    overdrawEnabled = enabled;
+    overdrawPercent = threshold > 1.0f ?
+                      (unsigned int) ( threshold * 100.0f + 0.5f ) : 100;
+}
+
+///
+// Do the shapes asking for it get the overdraw pass?
+//
+// @return true if they do
+///
+bool overdrawOptimization( void ) {
+    return overdrawEnabled;
+}
+
+///
+// Get the threshold of the overdraw pass.
+//
+// @return how much worse than the vertex cache order each cluster's cache
+//         miss ratio may become
+///
+float overdrawThreshold( void ) {
+    return overdrawPercent / 100.0f;
+}
+
 ///
 // Make the desired shape
 //
@@ -141,77 +347,190 @@ static void makeQuad( Canvas &C ) {
 // @param C      - the Canvas we'll use
 ///
 void makeShape( int choice, Canvas &C ) {
-    switch( choice ) {
-        case OBJ_APPLE:
-            readShape( "model/Apple.obj", C );
-            break;
+    if( choice == OBJ_QUAD ) {
+        makeQuad( C );
+        processShape( "quad", shapeFlags( choice ), C );
+    } else if( shapeFile( choice ) != NULL ) {
+        loadShape( shapeFile( choice ), shapeFlags( choice ), C );
+    } else {
+        cerr << "drawShape: unknown object " << choice << " - ignoring"
+             << endl;
+    }
+}
 
-        case OBJ_COOKIES1:
-            readShape( "model/Cookies1.obj", C );
-            break;
+///
+// Read a whole file into a NUL-terminated buffer.
+//
+// @param filename - the name of the file
+// @param buffer   - receives the contents of the file
+///
+static void readFile( const char *filename, vector< char > &buffer ) {
+    FILE *fp = fopen( filename, "rb" );
 
-        case OBJ_COOKIES2:
-            readShape( "model/Cookies2.obj", C );
-            break;
+    if( fp == NULL ) {
+        cerr << "Cannot open " << filename << endl;
+        exit( 1 );
+    }
 
-        case OBJ_CUP:
-            readShape( "model/Cup.obj", C );
-            // apply cylindrical texture mapping on the cup
-            cylindricalUV( C );
-            break;
+    // determine the length of the file
+    fseek( fp, 0, SEEK_END );
+    long count = ftell( fp );
+    rewind( fp );
 
-        case OBJ_DOUGHNUT:
-            readShape( "model/Doughnut.obj", C );
-            break;
+    if( count < 0 ) {
+        count = 0;
+    }
 
-        case OBJ_FOLIAGE:
-            readShape( "model/Foliage.obj", C );
-            break;
+    // one extra byte for the NUL sentinel the parser stops on
+    buffer.resize( count + 1 );
+    count = fread( &buffer[ 0 ], 1, count, fp );
+    buffer[ count ] = '\0';
+    buffer.resize( count + 1 );
 
-        case OBJ_PLATE:
-            readShape( "model/Plate.obj", C );
-            break;
+    fclose( fp );
+}
 
-        case OBJ_POT:
-            readShape( "model/Pot.obj", C );
-            break;
+///
+// Skip spaces and tabs.
+//
+// @param p - the current position in the buffer
+//
+// @return the first position which is not a space or tab
+///
+static inline const char *skipBlank( const char *p ) {
+    while( *p == ' ' || *p == '\t' ) {
+        p++;
+    }
 
-        case OBJ_QUAD:
-            makeQuad( C );
-            break;
+    return p;
+}
 
-        case OBJ_SPOON:
-            readShape( "model/Spoon.obj", C );
-            break;
+///
+// Skip to the beginning of the next line.
+//
+// @param p - the current position in the buffer
+//
+// @return the position after the end of the current line
+///
+static inline const char *skipLine( const char *p ) {
+    while( *p != '\0' && *p != '\n' ) {
+        p++;
+    }
 
-        case OBJ_TABLE:
-            readShape( "model/Table.obj", C );
-            break;
+    return *p == '\n' ? p + 1 : p;
+}
 
-        case OBJ_TEAPOT:
-            readShape( "model/Teapot.obj", C );
-            break;
+///
+// Parse an unsigned or signed integer.
+//
+// @param p - the current position in the buffer, advanced past the integer
+//
+// @return the value, or 0 if there is no integer at p
+///
+static inline int parseInt( const char *&p ) {
+    bool negative = false;
+
+    if( *p == '-' ) {
+        negative = true;
+        p++;
+    } else if( *p == '+' ) {
+        p++;
+    }
 
-        default:
-            cerr << "drawShape: unknown object " << choice << " - ignoring"
-                 << endl;
+    int value = 0;
+    while( *p >= '0' && *p <= '9' ) {
+        value = value * 10 + ( *p - '0' );
+        p++;
     }
+
+    return negative ? -value : value;
 }
 
 ///
-// Read the shape from an obj file.
+// Parse a decimal floating point number, with optional exponent.
 //
-// @param filename - the name of the model file
-// @param C        - the Canvas to use
+// @param p - the current position in the buffer, advanced past the number
+//
+// @return the value, or 0 if there is no number at p
 ///
-void readShape( const char *filename, Canvas &C ) {
-    ifstream in( filename, ios::in );
+static inline float parseFloat( const char *&p ) {
+    // exact powers of ten representable as double
+    static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = skipBlank( p );
+
+    bool negative = false;
+
+    if( *p == '-' ) {
+        negative = true;
+        p++;
+    } else if( *p == '+' ) {
+        p++;
+    }
 
-    if( !in ) {
-        cerr << "Cannot open " << filename << endl;
-        exit( 1 );
+    // accumulate the significant digits into an integer mantissa
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    while( *p >= '0' && *p <= '9' ) {
+        if( digits < 18 ) {
+            mantissa = mantissa * 10 + ( *p - '0' );
+            if( mantissa != 0 ) {
+                digits++;
+            }
+        } else {
+            exponent++;
+        }
+        p++;
     }
 
+    if( *p == '.' ) {
+        p++;
+        while( *p >= '0' && *p <= '9' ) {
+            if( digits < 18 ) {
+                mantissa = mantissa * 10 + ( *p - '0' );
+                if( mantissa != 0 ) {
+                    digits++;
+                }
+                exponent--;
+            }
+            p++;
+        }
+    }
+
+    if( *p == 'e' || *p == 'E' ) {
+        p++;
+        exponent += parseInt( p );
+    }
+
+    double value = double( mantissa );
+
+    if( exponent < 0 ) {
+        while( exponent < -22 ) {
+            value /= powers[ 22 ];
+            exponent += 22;
+        }
+        value /= powers[ -exponent ];
+    } else {
+        while( exponent > 22 ) {
+            value *= powers[ 22 ];
+            exponent -= 22;
+        }
+        value *= powers[ exponent ];
+    }
+
+    return float( negative ? -value : value );
+}
+
+///
+// The attribute streams and face indices of an obj file, or of a chunk of
+// one.
+///
+struct ObjData {
     // vertices of the shape
     vector< glm::vec3 > vertices;
     // normals of the shape
@@ -219,113 +538,363 @@ void readShape( const char *filename, Canvas &C ) {
     // texture coordinate of the shape
     vector< glm::vec3 > uvCoords;
 
-    // each group represent a triangle
+    // each group of three represent a triangle, an index of 0 means the
+    // attribute is absent for that corner
     vector< int > elements;
     vector< int > normalIndices;
     vector< int > uvIndices;
 
-    // the obj file contains normal information of the shape
-    bool hasNormal = false;
-    // the obj file contains texture coordinate of the shape
-    bool hasUV = false;
+    // positions in the index streams holding relative (negative) obj
+    // indices, resolved against the streams of this chunk only; they still
+    // need the count of attributes in the preceding chunks added
+    vector< size_t > elementFixups;
+    vector< size_t > normalFixups;
+    vector< size_t > uvFixups;
+};
 
-    // a line of the file
-    string line;
-    while( getline( in, line ) ) {
-        if( line.substr( 0, 2 ) == "v " ) {
+///
+// Resolve one face index of a corner.
+//
+// @param index  - the index as written in the file
+// @param count  - the number of attributes parsed so far
+// @param stream - the index stream the resolved index goes into
+// @param fixups - positions of chunk-relative indices in that stream
+///
+static inline void pushIndex( int index, size_t count, vector< int > &stream,
+                              vector< size_t > &fixups ) {
+    if( index < 0 ) {
+        // relative to the end of the attributes read so far
+        fixups.push_back( stream.size() );
+        index += int( count ) + 1;
+    }
+
+    stream.push_back( index );
+}
+
+///
+// Parse the records of an obj file held in a NUL-terminated buffer.
+//
+// @param p   - the beginning of the text, or of a chunk starting a line
+// @param end - the end of the text, or of a chunk ending a line
+// @param obj - receives the attribute streams and face indices
+///
+static void parseObj( const char *p, const char *end, ObjData &obj ) {
+    while( p < end && *p != '\0' ) {
+        p = skipBlank( p );
+
+        if( p[ 0 ] == 'v' && ( p[ 1 ] == ' ' || p[ 1 ] == '\t' ) ) {
             // vertex line
-            istringstream s( line.substr( 2 ) );
+            p += 2;
             glm::vec3 v;
-            s >> v.x;
-            s >> v.y;
-            s >> v.z;
-            vertices.push_back( v );
-        } else if( line.substr( 0, 3 ) == "vn " ) {
+            v.x = parseFloat( p );
+            v.y = parseFloat( p );
+            v.z = parseFloat( p );
+            obj.vertices.push_back( v );
+        } else if( p[ 0 ] == 'v' && p[ 1 ] == 'n' &&
+                   ( p[ 2 ] == ' ' || p[ 2 ] == '\t' ) ) {
             // normal line
-            hasNormal = true;
-
-            istringstream s( line.substr( 3 ) );
+            p += 3;
             glm::vec3 n;
-            s >> n.x;
-            s >> n.y;
-            s >> n.z;
-            normals.push_back( n );
-        } else if( line.substr( 0, 3 ) == "vt " ) {
+            n.x = parseFloat( p );
+            n.y = parseFloat( p );
+            n.z = parseFloat( p );
+            obj.normals.push_back( n );
+        } else if( p[ 0 ] == 'v' && p[ 1 ] == 't' &&
+                   ( p[ 2 ] == ' ' || p[ 2 ] == '\t' ) ) {
             // texture coordinate line
-            hasUV = true;
-
-            istringstream s( line.substr( 3 ) );
+            p += 3;
             glm::vec3 uv;
-            s >> uv.x;
-            s >> uv.y;
-            s >> uv.z;
-            uvCoords.push_back( uv );
-        } else if( line.substr( 0, 2 ) == "f " ) {
-            // face line
-            istringstream s( line.substr( 2 ) );
-
-            for( int i = 0; i < 3; i++ ) {
-                string str;
-                s >> str;
-
-                // locate the separators
-                u_int first = str.find_first_of( '/' );
-                u_int last = str.find_last_of( '/' );
-
-                // the index of vertex
-                int v = atoi( str.substr( 0, first ).c_str() );
-                elements.push_back( v - 1 );
+            uv.x = parseFloat( p );
+            uv.y = parseFloat( p );
+            uv.z = parseFloat( p );
+            obj.uvCoords.push_back( uv );
+        } else if( p[ 0 ] == 'f' && ( p[ 1 ] == ' ' || p[ 1 ] == '\t' ) ) {
+            // face line, polygons are split into a fan of triangles
+            p += 2;
+
+            int corners = 0;
+            int v0 = 0, t0 = 0, n0 = 0;
+            int vPrev = 0, tPrev = 0, nPrev = 0;
+
+            for( ;; ) {
+                p = skipBlank( p );
+                if( ( *p < '0' || *p > '9' ) && *p != '-' ) {
+                    break;
+                }
 
-                if( hasNormal ) {
-                    // the index of normal
-                    int n = atoi( str.substr( last + 1 ).c_str() );
-                    normalIndices.push_back( n - 1 );
+                // vertex/uv/normal, with uv and normal optional
+                int v = parseInt( p );
+                int t = 0;
+                int n = 0;
+
+                if( *p == '/' ) {
+                    p++;
+                    if( *p != '/' ) {
+                        t = parseInt( p );
+                    }
+                    if( *p == '/' ) {
+                        p++;
+                        n = parseInt( p );
+                    }
                 }
 
-                if( hasUV ) {
-                    // the index of texture coordinate
-                    int uv = atoi(
-                            str.substr( first + 1, last - first - 1 ).c_str() );
-                    uvIndices.push_back( uv - 1 );
+                if( corners == 0 ) {
+                    v0 = v;
+                    t0 = t;
+                    n0 = n;
+                } else if( corners >= 2 ) {
+                    size_t numV = obj.vertices.size();
+                    size_t numT = obj.uvCoords.size();
+                    size_t numN = obj.normals.size();
+
+                    pushIndex( v0, numV, obj.elements, obj.elementFixups );
+                    pushIndex( vPrev, numV, obj.elements, obj.elementFixups );
+                    pushIndex( v, numV, obj.elements, obj.elementFixups );
+                    pushIndex( t0, numT, obj.uvIndices, obj.uvFixups );
+                    pushIndex( tPrev, numT, obj.uvIndices, obj.uvFixups );
+                    pushIndex( t, numT, obj.uvIndices, obj.uvFixups );
+                    pushIndex( n0, numN, obj.normalIndices, obj.normalFixups );
+                    pushIndex( nPrev, numN, obj.normalIndices,
+                               obj.normalFixups );
+                    pushIndex( n, numN, obj.normalIndices, obj.normalFixups );
                 }
+
+                vPrev = v;
+                tPrev = t;
+                nPrev = n;
+                corners++;
             }
         }
+
+        p = skipLine( p );
+    }
+}
+
+///
+// Append one stream of a chunk at its place in the merged stream.
+//
+// @param src - the stream of the chunk
+// @param dst - the merged stream, already sized
+// @param at  - where the chunk begins in the merged stream
+///
+template< typename T >
+static void copyStream( const vector< T > &src, vector< T > &dst,
+                        size_t at ) {
+    if( !src.empty() ) {
+        memcpy( &dst[ at ], &src[ 0 ], src.size() * sizeof( T ) );
+    }
+}
+
+///
+// Append one index stream of a chunk at its place in the merged stream,
+// rebasing its chunk-relative indices.
+//
+// @param src    - the index stream of the chunk
+// @param fixups - positions of chunk-relative indices in src
+// @param dst    - the merged index stream, already sized
+// @param at     - where the chunk begins in the merged stream
+// @param base   - number of attributes in the preceding chunks
+///
+static void copyIndices( const vector< int > &src,
+                         const vector< size_t > &fixups, vector< int > &dst,
+                         size_t at, size_t base ) {
+    copyStream( src, dst, at );
+
+    for( size_t i = 0; i < fixups.size(); i++ ) {
+        dst[ at + fixups[ i ] ] += int( base );
     }
+}
 
-    for( int i = 0; i < elements.size() / 3; i++ ) {
-        // the vertices of the triangle
-        glm::vec3 p1 = vertices[ elements[ i * 3 ] ];
-        glm::vec3 p2 = vertices[ elements[ i * 3 + 1 ] ];
-        glm::vec3 p3 = vertices[ elements[ i * 3 + 2 ] ];
+///
+// Merge the chunks of an obj file parsed in parallel.  A prefix sum over
+// the per-chunk counts gives every chunk its place in the merged streams,
+// and the chunks are then copied in on the pool.
+//
+// @param chunks - the parsed chunks, in file order
+// @param obj    - receives the merged streams
+// @param pool   - the pool to copy on
+///
+static void mergeObj( const vector< ObjData > &chunks, ObjData &obj,
+                      ThreadPool &pool ) {
+    size_t n = chunks.size();
+
+    // where each chunk begins in the merged streams
+    vector< size_t > vAt( n + 1, 0 ), nAt( n + 1, 0 ), tAt( n + 1, 0 );
+    vector< size_t > eAt( n + 1, 0 );
+
+    for( size_t i = 0; i < n; i++ ) {
+        vAt[ i + 1 ] = vAt[ i ] + chunks[ i ].vertices.size();
+        nAt[ i + 1 ] = nAt[ i ] + chunks[ i ].normals.size();
+        tAt[ i + 1 ] = tAt[ i ] + chunks[ i ].uvCoords.size();
+        eAt[ i + 1 ] = eAt[ i ] + chunks[ i ].elements.size();
+    }
 
-        // the normal of the vertices
-        glm::vec3 n1, n2, n3;
-        // the texture coordinate of the vertices
-        glm::vec3 uv1, uv2, uv3;
+    obj.vertices.resize( vAt[ n ] );
+    obj.normals.resize( nAt[ n ] );
+    obj.uvCoords.resize( tAt[ n ] );
+    obj.elements.resize( eAt[ n ] );
+    obj.normalIndices.resize( eAt[ n ] );
+    obj.uvIndices.resize( eAt[ n ] );
+
+    JobGroup copies( pool );
+
+    for( size_t i = 0; i < n; i++ ) {
+        copies.submit( [ &, i ]() {
+            const ObjData &c = chunks[ i ];
+
+            copyStream( c.vertices, obj.vertices, vAt[ i ] );
+            copyStream( c.normals, obj.normals, nAt[ i ] );
+            copyStream( c.uvCoords, obj.uvCoords, tAt[ i ] );
+
+            copyIndices( c.elements, c.elementFixups, obj.elements,
+                         eAt[ i ], vAt[ i ] );
+            copyIndices( c.normalIndices, c.normalFixups, obj.normalIndices,
+                         eAt[ i ], nAt[ i ] );
+            copyIndices( c.uvIndices, c.uvFixups, obj.uvIndices,
+                         eAt[ i ], tAt[ i ] );
+        } );
+    }
 
-        if( hasNormal ) {
-            n1 = normals[ normalIndices[ i * 3 ] ];
-            n2 = normals[ normalIndices[ i * 3 + 1 ] ];
-            n3 = normals[ normalIndices[ i * 3 + 2 ] ];
-        }
+    copies.wait();
+}
 
-        if( hasUV ) {
-            uv1 = uvCoords[ uvIndices[ i * 3 ] ];
-            uv2 = uvCoords[ uvIndices[ i * 3 + 1 ] ];
-            uv3 = uvCoords[ uvIndices[ i * 3 + 2 ] ];
+///
+// Parse an obj file held in a NUL-terminated buffer on a pool of threads.
+// The text is split into chunks at line boundaries, and the chunks are
+// parsed independently and merged in file order, so the result is the same
+// as parsing it serially.
+//
+// @param text - the text of the file
+// @param size - the length of the text
+// @param obj  - receives the attribute streams and face indices
+// @param pool - the pool to parse on
+///
+static void parseObjParallel( const char *text, size_t size, ObjData &obj,
+                              ThreadPool &pool ) {
+    // a few chunks per thread so an uneven chunk doesn't stall the others
+    size_t numChunks = size_t( pool.size() ) * 4;
+    if( numChunks > size / PARSE_CHUNK_MIN_BYTES ) {
+        numChunks = size / PARSE_CHUNK_MIN_BYTES;
+    }
+    if( numChunks < 1 ) {
+        numChunks = 1;
+    }
+
+    // chunk boundaries, each moved forward to the start of a line
+    vector< const char * > bounds( numChunks + 1 );
+    bounds[ 0 ] = text;
+    bounds[ numChunks ] = text + size;
+
+    for( size_t i = 1; i < numChunks; i++ ) {
+        const char *p = text + size * i / numChunks;
+        if( p < bounds[ i - 1 ] ) {
+            p = bounds[ i - 1 ];
         }
+        bounds[ i ] = p > text && p[ -1 ] == '\n' ? p : skipLine( p );
+    }
+
+    vector< ObjData > chunks( numChunks );
+
+    // waits for these chunks only, not for the other jobs of the pool
+    JobGroup parses( pool );
+
+    for( size_t i = 0; i < numChunks; i++ ) {
+        parses.submit( [ &, i ]() {
+            parseObj( bounds[ i ], bounds[ i + 1 ], chunks[ i ] );
+        } );
+    }
+
+    parses.wait();
 
-        if( hasNormal && !hasUV ) {
-            // Add triangle and normal
-            C.addTriangleWithNorms( p1, n1, p2, n2, p3, n3 );
-        } else if( !hasNormal && hasUV ) {
-            // Add triangle and texture coordinates
-            C.addTriangleWithUV( p1, uv1, p2, uv2, p3, uv3 );
-        } else if( hasNormal && hasUV ) {
-            // Add triangle, normal and texture coordinates
-            C.addTriangleWithNormsUV( p1, n1, uv1, p2, n2, uv2, p3, n3, uv3 );
+    mergeObj( chunks, obj, pool );
+}
+
+///
+// Check the one-based obj indices of an attribute stream, and make them
+// zero-based in place.
+//
+// @param indices  - the indices into the attribute stream
+// @param count    - the number of attributes in the stream
+// @param filename - the name of the model file, for error reporting
+//
+// @return the indices, ready for Canvas::addTriangles()
+///
+static const GLuint *zeroBased( vector< int > &indices, size_t count,
+                                const char *filename ) {
+    for( size_t i = 0; i < indices.size(); i++ ) {
+        int index = indices[ i ];
+
+        if( index < 1 || index > int( count ) ) {
+            cerr << filename << ": index " << index << " out of range" << endl;
+            exit( 1 );
         }
+
+        indices[ i ] = index - 1;
     }
+
+    // non-negative now, so the ints read the same as GLuints
+    return reinterpret_cast< const GLuint * >( &indices[ 0 ] );
+}
+
+///
+// Read the shape from an obj file.
+//
+// @param filename   - the name of the model file
+// @param C          - the Canvas to use
+// @param numThreads - number of threads to parse on, 0 to parse large
+//                     files on the shared pool and small ones serially
+///
+void readShape( const char *filename, Canvas &C, int numThreads ) {
+    // the whole file, parsed in place
+    vector< char > buffer;
+    readFile( filename, buffer );
+
+    // the length of the text, without the NUL sentinel
+    size_t size = buffer.size() - 1;
+
+    ObjData obj;
+
+    if( numThreads == 0 && size >= PARALLEL_PARSE_MIN_BYTES ) {
+        parseObjParallel( &buffer[ 0 ], size, obj, ThreadPool::shared() );
+    } else if( numThreads > 1 ) {
+        ThreadPool pool( numThreads );
+        parseObjParallel( &buffer[ 0 ], size, obj, pool );
+    } else {
+        parseObj( &buffer[ 0 ], &buffer[ 0 ] + size, obj );
+    }
+
+    // the obj file contains normal information of the shape
+    bool hasNormal = !obj.normals.empty();
+    // the obj file contains texture coordinate of the shape
+    bool hasUV = !obj.uvCoords.empty();
+
+    // a shape needs normals or (u,v) to be drawn
+    if( obj.elements.empty() || ( !hasNormal && !hasUV ) ) {
+        return;
+    }
+
+    // the face count is known, so grow the canvas streams only once
+    int numTriangles = int( obj.elements.size() / 3 );
+    C.reserveTriangles( numTriangles, hasUV );
+
+    const GLuint *vIndices = zeroBased( obj.elements, obj.vertices.size(),
+                                        filename );
+    const GLuint *nIndices = NULL;
+    const GLuint *tIndices = NULL;
+
+    if( hasNormal ) {
+        nIndices = zeroBased( obj.normalIndices, obj.normals.size(),
+                              filename );
+    }
+
+    if( hasUV ) {
+        tIndices = zeroBased( obj.uvIndices, obj.uvCoords.size(), filename );
+    }
+
+    // without normals, each triangle gets its face normal
+    C.addTriangles( numTriangles, &obj.vertices[ 0 ], vIndices,
+                    hasNormal ? &obj.normals[ 0 ] : NULL, nIndices,
+                    hasUV ? &obj.uvCoords[ 0 ] : NULL, tIndices );
 }
 
 ///
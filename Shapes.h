@@ -12,6 +12,68 @@
 #include "Canvas.h"
 #include "Buffers.h"
 
+// Processing applied to a model after it is read
+#define SHAPE_CYLINDRICAL_UV    0x1
+#define SHAPE_OPTIMIZE_OVERDRAW 0x2
+
+// the overdraw threshold, in hundredths, is kept in the flags from this bit
+// up, so meshes cached or cooked with another threshold are not reused
+#define SHAPE_OVERDRAW_SHIFT    8
+
+///
+// Get the name of a shape, as scene files and the asset pack give it.
+//
+// @param choice - which shape
+//
+// @return its name, or NULL for no shape
+///
+const char *shapeName( int choice );
+
+///
+// Get the model file a shape is read from.
+//
+// @param choice - which shape
+//
+// @return the name of the file, or NULL if the shape is made in code
+///
+const char *shapeFile( int choice );
+
+///
+// Get the processing applied to a shape after it is read, as it is set
+// now.
+//
+// @param choice - which shape
+//
+// @return its SHAPE_ flags, with the overdraw threshold above
+//         SHAPE_OVERDRAW_SHIFT if it gets the overdraw pass
+///
+unsigned int shapeFlags( int choice );
+
+///
+// Set the overdraw pass of the shapes asking for it.  Shapes made from
+// here on are processed so; those made already keep their order.
+//
+// @param enabled   - whether they get the pass
+// @param threshold - how much worse than the vertex cache order each
+//                    cluster's cache miss ratio may become, 1.05 allows 5%
+///
+void setOverdrawOptimization( bool enabled, float threshold );
+
+///
+// Do the shapes asking for it get the overdraw pass?
+//
+// @return true if they do
+///
+bool overdrawOptimization( void );
+
+///
+// Get the threshold of the overdraw pass.
+//
+// @return how much worse than the vertex cache order each cluster's cache
+//         miss ratio may become
+///
+float overdrawThreshold( void );
+
 ///
 // Make the desired shape
 //
@@ -23,10 +85,15 @@ void makeShape( int choice, Canvas &C );
 ///
 // Read the shape from an obj file.
 //
-// @param filename - the name of the model file
-// @param C        - the Canvas to use
+// Large files are split at line boundaries and parsed on a thread pool;
+// the result is identical to parsing them serially.
+//
+// @param filename   - the name of the model file
+// @param C          - the Canvas to use
+// @param numThreads - number of threads to parse on, 0 to parse large
+//                     files on the shared pool and small ones serially
 ///
-void readShape( const char *filename, Canvas &C );
+void readShape( const char *filename, Canvas &C, int numThreads = 0 );
 
 ///
 // Apply cylindrical texture mapping on the shape.
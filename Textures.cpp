@@ -20,128 +20,220 @@
 #include <stdio.h>
 #endif
 
-#include "Textures.h"
-
-// this is here in case you are using SOIL;
-// if you're not, it can be deleted.
-#include <SOIL.h>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <mutex>
+
+#include "AssetPack.h"
+#include "Images.h"
+#include "Textures.h"
+#include "RenderState.h"
+#include "ThreadPool.h"
 
 #ifdef __cplusplus
 using namespace std;
 #endif
 
-// the texture handle of cup
-GLuint Texture::cup;
-// the texture handle of foliage
-GLuint Texture::foliage1;
-GLuint Texture::foliage2;
-GLuint Texture::foliage3;
-GLuint Texture::foliage4;
-
 ///
-// This function loads texture data for the GPU.
+// This function loads the texture data of an image file for the GPU.
+//
+// @param filename - the name of the image file
+//
+// @return the OpenGL texture handle, 0 if the file could not be loaded
 ///
-void loadTexture() {
-    // load the cup image by SOIL
-    Texture::cup = SOIL_load_OGL_texture( "texture/blueberry.png",
-                                          SOIL_LOAD_AUTO,
-                                          SOIL_CREATE_NEW_ID,
-                                          SOIL_FLAG_MIPMAPS |
-                                          SOIL_FLAG_INVERT_Y |
-                                          SOIL_FLAG_NTSC_SAFE_RGB |
-                                          SOIL_FLAG_COMPRESS_TO_DXT );
-
-    if( Texture::cup == 0 ) {
-        printf( "SOIL loading error: '%s'\n", SOIL_last_result() );
-    }
+GLuint loadTexture( const char *filename ) {
+    vector< GLuint > textures;
+    loadTextures( vector< const char * >( 1, filename ), textures );
 
-    // set up the texture parameters
-    glBindTexture( GL_TEXTURE_2D, Texture::cup );
+    return textures[0];
+}
+
+///
+// Set the parameters of the texture bound.
+///
+static void setParameters( void ) {
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+}
 
-    // load the first foliage image by SOIL
-    Texture::foliage1 = SOIL_load_OGL_texture( "texture/foliage1.png",
-                                               SOIL_LOAD_AUTO,
-                                               SOIL_CREATE_NEW_ID,
-                                               SOIL_FLAG_MIPMAPS |
-                                               SOIL_FLAG_INVERT_Y |
-                                               SOIL_FLAG_NTSC_SAFE_RGB |
-                                               SOIL_FLAG_COMPRESS_TO_DXT );
-
-    if( Texture::foliage1 == 0 ) {
-        printf( "SOIL loading error: '%s'\n", SOIL_last_result() );
-    }
+///
+// Get the milliseconds since a point in time.
+//
+// @param start - the point in time
+//
+// @return the milliseconds since
+///
+static double millisecondsSince( chrono::steady_clock::time_point start ) {
+    chrono::duration< double, milli > elapsed =
+            chrono::steady_clock::now() - start;
 
-    // set up the texture parameters
-    glBindTexture( GL_TEXTURE_2D, Texture::foliage1 );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    return elapsed.count();
+}
 
-    // load the second foliage image by SOIL
-    Texture::foliage2 = SOIL_load_OGL_texture( "texture/foliage2.png",
-                                               SOIL_LOAD_AUTO,
-                                               SOIL_CREATE_NEW_ID,
-                                               SOIL_FLAG_MIPMAPS |
-                                               SOIL_FLAG_INVERT_Y |
-                                               SOIL_FLAG_NTSC_SAFE_RGB |
-                                               SOIL_FLAG_COMPRESS_TO_DXT );
-
-    if( Texture::foliage2 == 0 ) {
-        printf( "SOIL loading error: '%s'\n", SOIL_last_result() );
-    }
+///
+// This function loads the texture data of several image files for the GPU,
+// decoding the images on worker threads all at once and uploading each on
+// this thread as soon as it is decoded.
+//
+// The images are processed as SOIL_load_OGL_texture() does with the
+// SOIL_FLAG_INVERT_Y, SOIL_FLAG_NTSC_SAFE_RGB and SOIL_FLAG_MIPMAPS flags,
+// but not compressed.  The images in the asset pack need no decoding and
+// are uploaded first.
+//
+// @param filenames - the names of the image files
+// @param textures  - receives the OpenGL texture handle of each file, 0 if
+//                    the file could not be loaded
+///
+void loadTextures( const vector< const char * > &filenames,
+                   vector< GLuint > &textures ) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
-    // set up the texture parameters
-    glBindTexture( GL_TEXTURE_2D, Texture::foliage2 );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    textures.assign( filenames.size(), 0 );
+
+    // the images still to decode
+    vector< size_t > missing;
+
+    for( size_t i = 0; i < filenames.size(); i++ ) {
+        chrono::steady_clock::time_point upload = chrono::steady_clock::now();
+        textures[ i ] = loadPackedTexture( filenames[ i ] );
 
-    // load the third foliage image by SOIL
-    Texture::foliage3 = SOIL_load_OGL_texture( "texture/foliage3.png",
-                                               SOIL_LOAD_AUTO,
-                                               SOIL_CREATE_NEW_ID,
-                                               SOIL_FLAG_MIPMAPS |
-                                               SOIL_FLAG_INVERT_Y |
-                                               SOIL_FLAG_NTSC_SAFE_RGB |
-                                               SOIL_FLAG_COMPRESS_TO_DXT );
-
-    if( Texture::foliage3 == 0 ) {
-        printf( "SOIL loading error: '%s'\n", SOIL_last_result() );
+        if( textures[ i ] == 0 ) {
+            missing.push_back( i );
+            continue;
+        }
+
+        setParameters();
+
+        cout << filenames[ i ] << ": uploaded from the pack in " <<
+             millisecondsSince( upload ) << " ms" << endl;
     }
 
-    // set up the texture parameters
-    glBindTexture( GL_TEXTURE_2D, Texture::foliage3 );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    vector< vector< Image > > levels( missing.size() );
+    vector< double > decodeTime( missing.size() );
+
+    // the images decoded, in the order they were, and the next to upload
+    vector< size_t > decoded;
+    size_t next = 0;
+    mutex lock;
+    condition_variable decodeDone;
+
+    // no pool at all when every image came from the pack
+    if( !missing.empty() ) {
+        // one thread per image, so the slowest image bounds the decoding
+        ThreadPool pool( int( missing.size() ) );
+
+        for( size_t k = 0; k < missing.size(); k++ ) {
+            pool.submit( [ &, k ]() {
+                chrono::steady_clock::time_point begin =
+                        chrono::steady_clock::now();
+
+                levels[ k ].resize( 1 );
+                if( decodeImage( filenames[ missing[ k ] ], levels[ k ][0] ) ) {
+                    mipmapImage( levels[ k ] );
+                } else {
+                    levels[ k ].clear();
+                }
+
+                decodeTime[ k ] = millisecondsSince( begin );
+
+                lock_guard< mutex > guard( lock );
+                decoded.push_back( k );
+                decodeDone.notify_one();
+            } );
+        }
+
+        // only this thread may upload, so it waits for each image in turn
+        while( next < missing.size() ) {
+            size_t k;
+
+            {
+                unique_lock< mutex > guard( lock );
+                decodeDone.wait( guard, [ & ]() {
+                    return decoded.size() > next;
+                } );
+                k = decoded[ next++ ];
+            }
+
+            const char *filename = filenames[ missing[ k ] ];
+
+            if( levels[ k ].empty() ) {
+                cerr << "Cannot decode texture " << filename << endl;
+                continue;
+            }
+
+            chrono::steady_clock::time_point upload =
+                    chrono::steady_clock::now();
+
+            vector< const unsigned char * > pixels( levels[ k ].size() );
+            for( size_t level = 0; level < pixels.size(); level++ ) {
+                pixels[ level ] = &levels[ k ][ level ].pixels[0];
+            }
+
+            const Image &image = levels[ k ][0];
+            textures[ missing[ k ] ] = makeTexture( image.width, image.height,
+                                                    image.channels,
+                                                    int( pixels.size() ),
+                                                    &pixels[0] );
+            setParameters();
+
+            // the pixels are on the GPU now
+            vector< Image >().swap( levels[ k ] );
+
+            cout << filename << ": decoded in " << decodeTime[ k ] <<
+                 " ms, uploaded in " << millisecondsSince( upload ) << " ms"
+                 << endl;
+        }
+    }
+
+    cout << filenames.size() << " textures loaded in " <<
+         millisecondsSince( start ) << " ms" << endl;
+}
+
+///
+// This function makes a texture from its mipmap levels, largest first,
+// each row bottom up and packed tightly.
+//
+// @param width     - width of the largest level
+// @param height    - height of the largest level
+// @param channels  - bytes per pixel, 1 to 4
+// @param numLevels - number of levels
+// @param levels    - the pixels of each level
+//
+// @return the OpenGL texture handle
+///
+GLuint makeTexture( int width, int height, int channels, int numLevels,
+                    const unsigned char *const *levels ) {
+    static const GLenum formats[] = {
+        GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA
+    };
+
+    GLenum format = formats[ channels - 1 ];
+    GLuint texture;
+
+    glGenTextures( 1, &texture );
+    glBindTexture( GL_TEXTURE_2D, texture );
+
+    // the rows of each level are packed tightly
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+
+    for( int level = 0; level < numLevels; level++ ) {
+        glTexImage2D( GL_TEXTURE_2D, level, format, width, height, 0, format,
+                      GL_UNSIGNED_BYTE, levels[ level ] );
 
-    // load the fourth foliage image by SOIL
-    Texture::foliage4 = SOIL_load_OGL_texture( "texture/foliage4.png",
-                                               SOIL_LOAD_AUTO,
-                                               SOIL_CREATE_NEW_ID,
-                                               SOIL_FLAG_MIPMAPS |
-                                               SOIL_FLAG_INVERT_Y |
-                                               SOIL_FLAG_NTSC_SAFE_RGB |
-                                               SOIL_FLAG_COMPRESS_TO_DXT );
-
-    if( Texture::foliage4 == 0 ) {
-        printf( "SOIL loading error: '%s'\n", SOIL_last_result() );
+        width = width / 2 > 0 ? width / 2 : 1;
+        height = height / 2 > 0 ? height / 2 : 1;
     }
 
-    // set up the texture parameters
-    glBindTexture( GL_TEXTURE_2D, Texture::foliage4 );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1 );
+
+    // bound behind the back of the state filter
+    invalidateState();
+
+    return texture;
 }
 
 ///
@@ -150,5 +242,6 @@ void loadTexture() {
 // @param texture - The OpenGL texture handle of the texture to use
 ///
 void setUpTexture( GLuint texture ) {
-    glBindTexture( GL_TEXTURE_2D, texture );
+    // bound only if another texture is bound now
+    bindTexture( texture );
 }
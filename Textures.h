@@ -27,25 +27,45 @@
 
 #include <GLFW/glfw3.h>
 
+#include <vector>
+
+using namespace std;
+
 ///
-// A simple texture class with texture handles.
+// This function loads the texture data of an image file for the GPU.
+//
+// @param filename - the name of the image file
+//
+// @return the OpenGL texture handle, 0 if the file could not be loaded
 ///
-class Texture {
+GLuint loadTexture( const char *filename );
 
-public:
-    // the texture handle of cup
-    static GLuint cup;
-    // the texture handle of foliages
-    static GLuint foliage1;
-    static GLuint foliage2;
-    static GLuint foliage3;
-    static GLuint foliage4;
-};
+///
+// This function loads the texture data of several image files for the GPU,
+// decoding the images on worker threads all at once and uploading each on
+// this thread as soon as it is decoded.
+//
+// @param filenames - the names of the image files
+// @param textures  - receives the OpenGL texture handle of each file, 0 if
+//                    the file could not be loaded
+///
+void loadTextures( const vector< const char * > &filenames,
+                   vector< GLuint > &textures );
 
 ///
-// This function loads texture data for the GPU.
+// This function makes a texture from its mipmap levels, largest first,
+// each row bottom up and packed tightly.
+//
+// @param width     - width of the largest level
+// @param height    - height of the largest level
+// @param channels  - bytes per pixel, 1 to 4
+// @param numLevels - number of levels
+// @param levels    - the pixels of each level
+//
+// @return the OpenGL texture handle
 ///
-void loadTexture();
+GLuint makeTexture( int width, int height, int channels, int numLevels,
+                    const unsigned char *const *levels );
 
 ///
 // This function sets up the parameters for texture use.
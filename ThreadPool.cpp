@@ -0,0 +1,210 @@
+//
+// ThreadPool.cpp
+//
+// A fixed-size pool of worker threads for CPU-side loading work.
+//
+// Author:  Jietong Chen
+//
+
+#include "ThreadPool.h"
+
+///
+// Constructor
+//
+// @param numThreads - number of worker threads, 0 for one per core
+///
+ThreadPool::ThreadPool( int numThreads ) : pending( 0 ), stopping( false ) {
+    if( numThreads <= 0 ) {
+        numThreads = int( std::thread::hardware_concurrency() );
+    }
+
+    if( numThreads <= 0 ) {
+        numThreads = 1;
+    }
+
+    for( int i = 0; i < numThreads; i++ ) {
+        workers.push_back( std::thread( &ThreadPool::workerLoop, this ) );
+    }
+}
+
+///
+// Destructor, finishes the queued jobs and joins the workers.
+///
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock< std::mutex > guard( lock );
+        stopping = true;
+    }
+
+    jobReady.notify_all();
+
+    for( size_t i = 0; i < workers.size(); i++ ) {
+        workers[ i ].join();
+    }
+}
+
+///
+// The loop run by each worker thread.
+///
+void ThreadPool::workerLoop() {
+    for( ;; ) {
+        std::function< void() > job;
+
+        {
+            std::unique_lock< std::mutex > guard( lock );
+
+            while( jobs.empty() && !stopping ) {
+                jobReady.wait( guard );
+            }
+
+            if( jobs.empty() ) {
+                // stopping, and nothing left to do
+                return;
+            }
+
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        job();
+
+        {
+            std::unique_lock< std::mutex > guard( lock );
+
+            if( --pending == 0 ) {
+                jobsDone.notify_all();
+            }
+        }
+    }
+}
+
+///
+// Queue a job to run on a worker thread.
+//
+// @param job - the job to run
+///
+void ThreadPool::submit( const std::function< void() > &job ) {
+    {
+        std::unique_lock< std::mutex > guard( lock );
+        jobs.push_back( job );
+        pending++;
+    }
+
+    jobReady.notify_one();
+}
+
+///
+// Block until every submitted job has finished, including the jobs of
+// other callers.  Use a JobGroup to wait for some jobs only.
+///
+void ThreadPool::wait() {
+    std::unique_lock< std::mutex > guard( lock );
+
+    while( pending > 0 ) {
+        jobsDone.wait( guard );
+    }
+}
+
+///
+// Get the number of worker threads.
+//
+// @return the number of worker threads
+///
+int ThreadPool::size() const {
+    return int( workers.size() );
+}
+
+///
+// Get the pool shared by the whole program.
+//
+// @return the shared pool, with one worker per core
+///
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+
+    return pool;
+}
+
+///
+// Constructor
+//
+// @param pool - the pool to run the jobs on
+///
+JobGroup::JobGroup( ThreadPool &pool ) : pool( pool ),
+    state( std::make_shared< State >() ) {
+    state->pending = 0;
+}
+
+///
+// Destructor, waits for the jobs of the group.
+///
+JobGroup::~JobGroup() {
+    wait();
+}
+
+///
+// Take the next job of the group off its queue and run it.
+//
+// @param state - the state of the group
+//
+// @return false if there was none left
+///
+bool JobGroup::runNext( State &state ) {
+    std::function< void() > job;
+
+    {
+        std::unique_lock< std::mutex > guard( state.lock );
+
+        if( state.jobs.empty() ) {
+            return false;
+        }
+
+        job = state.jobs.front();
+        state.jobs.pop_front();
+    }
+
+    job();
+
+    std::unique_lock< std::mutex > guard( state.lock );
+
+    if( --state.pending == 0 ) {
+        state.jobsDone.notify_all();
+    }
+
+    return true;
+}
+
+///
+// Queue a job of the group.
+//
+// @param job - the job to run
+///
+void JobGroup::submit( const std::function< void() > &job ) {
+    {
+        std::unique_lock< std::mutex > guard( state->lock );
+        state->jobs.push_back( job );
+        state->pending++;
+    }
+
+    // each worker picking this up runs whichever job of the group is next,
+    // or nothing if the waiting thread ran them all already
+    std::shared_ptr< State > shared = state;
+    pool.submit( [ shared ]() {
+        runNext( *shared );
+    } );
+}
+
+///
+// Block until every job of the group has finished, running those not
+// taken by a worker yet on this thread.
+///
+void JobGroup::wait() {
+    while( runNext( *state ) ) {
+    }
+
+    std::unique_lock< std::mutex > guard( state->lock );
+
+    while( state->pending > 0 ) {
+        state->jobsDone.wait( guard );
+    }
+}
@@ -0,0 +1,167 @@
+//
+// ThreadPool.h
+//
+// A fixed-size pool of worker threads for CPU-side loading work.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///
+// A pool of worker threads running jobs from a shared queue.
+///
+class ThreadPool {
+
+private:
+
+    // the worker threads
+    std::vector< std::thread > workers;
+
+    // jobs waiting for a worker
+    std::deque< std::function< void() > > jobs;
+
+    // number of jobs queued or running
+    int pending;
+
+    // the pool is shutting down
+    bool stopping;
+
+    // guards the queue and the counters
+    std::mutex lock;
+
+    // signalled when a job is queued or the pool stops
+    std::condition_variable jobReady;
+
+    // signalled when the last pending job finishes
+    std::condition_variable jobsDone;
+
+    ///
+    // The loop run by each worker thread.
+    ///
+    void workerLoop();
+
+public:
+
+    ///
+    // Constructor
+    //
+    // @param numThreads - number of worker threads, 0 for one per core
+    ///
+    explicit ThreadPool( int numThreads = 0 );
+
+    ///
+    // Destructor, finishes the queued jobs and joins the workers.
+    ///
+    ~ThreadPool();
+
+    ///
+    // Queue a job to run on a worker thread.
+    //
+    // @param job - the job to run
+    ///
+    void submit( const std::function< void() > &job );
+
+    ///
+    // Block until every submitted job has finished, including the jobs of
+    // other callers.  Use a JobGroup to wait for some jobs only.
+    ///
+    void wait();
+
+    ///
+    // Get the number of worker threads.
+    //
+    // @return the number of worker threads
+    ///
+    int size() const;
+
+    ///
+    // Get the pool shared by the whole program.
+    //
+    // @return the shared pool, with one worker per core
+    ///
+    static ThreadPool &shared();
+};
+
+///
+// Jobs run on a pool and waited for together, apart from the other jobs
+// of the pool.
+//
+// The jobs are held by the group and the pool only runs them; the thread
+// waiting runs those no worker has taken yet, so waiting never depends on
+// a free worker, even from a job of the same pool.
+///
+class JobGroup {
+
+private:
+
+    ///
+    // What the group shares with the workers running its jobs, which may
+    // outlive the group.
+    ///
+    struct State {
+        // jobs no one has taken yet
+        std::deque< std::function< void() > > jobs;
+
+        // number of jobs not finished
+        int pending;
+
+        // guards the queue and the counter
+        std::mutex lock;
+
+        // signalled when the last pending job finishes
+        std::condition_variable jobsDone;
+    };
+
+    // the pool the jobs run on
+    ThreadPool &pool;
+
+    std::shared_ptr< State > state;
+
+    ///
+    // Take the next job of the group off its queue and run it.
+    //
+    // @param state - the state of the group
+    //
+    // @return false if there was none left
+    ///
+    static bool runNext( State &state );
+
+public:
+
+    ///
+    // Constructor
+    //
+    // @param pool - the pool to run the jobs on
+    ///
+    explicit JobGroup( ThreadPool &pool );
+
+    ///
+    // Destructor, waits for the jobs of the group.
+    ///
+    ~JobGroup();
+
+    ///
+    // Queue a job of the group.
+    //
+    // @param job - the job to run
+    ///
+    void submit( const std::function< void() > &job );
+
+    ///
+    // Block until every job of the group has finished, running those not
+    // taken by a worker yet on this thread.
+    ///
+    void wait();
+};
+
+#endif
@@ -0,0 +1,294 @@
+//
+// Transforms.cpp
+//
+// The transformation pass of a frame: the matrices of every object are
+// computed together, four objects at a time, and only again for the
+// objects that moved or when the camera did.
+//
+// Author:  Jietong Chen
+//
+
+#include "Transforms.h"
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    ( defined(_M_IX86_FP) && _M_IX86_FP >= 1 )
+#include <xmmintrin.h>
+#define TRANSFORMS_SSE
+#endif
+
+// one element of the matrices of the objects of a step, and the few
+// operations the kernels need on them
+#ifdef TRANSFORMS_SSE
+
+typedef __m128 Lanes;
+
+static inline Lanes load( const float *p ) { return _mm_loadu_ps( p ); }
+static inline void store( float *p, Lanes a ) { _mm_storeu_ps( p, a ); }
+static inline Lanes splat( float f ) { return _mm_set1_ps( f ); }
+static inline Lanes add( Lanes a, Lanes b ) { return _mm_add_ps( a, b ); }
+static inline Lanes sub( Lanes a, Lanes b ) { return _mm_sub_ps( a, b ); }
+static inline Lanes mul( Lanes a, Lanes b ) { return _mm_mul_ps( a, b ); }
+static inline Lanes div( Lanes a, Lanes b ) { return _mm_div_ps( a, b ); }
+
+#else
+
+struct Lanes {
+    float v[ TRANSFORM_LANES ];
+};
+
+static inline Lanes load( const float *p ) {
+    Lanes a;
+    for( int k = 0; k < TRANSFORM_LANES; k++ ) a.v[ k ] = p[ k ];
+    return a;
+}
+
+static inline void store( float *p, Lanes a ) {
+    for( int k = 0; k < TRANSFORM_LANES; k++ ) p[ k ] = a.v[ k ];
+}
+
+static inline Lanes splat( float f ) {
+    Lanes a;
+    for( int k = 0; k < TRANSFORM_LANES; k++ ) a.v[ k ] = f;
+    return a;
+}
+
+static inline Lanes add( Lanes a, Lanes b ) {
+    for( int k = 0; k < TRANSFORM_LANES; k++ ) a.v[ k ] += b.v[ k ];
+    return a;
+}
+
+static inline Lanes sub( Lanes a, Lanes b ) {
+    for( int k = 0; k < TRANSFORM_LANES; k++ ) a.v[ k ] -= b.v[ k ];
+    return a;
+}
+
+static inline Lanes mul( Lanes a, Lanes b ) {
+    for( int k = 0; k < TRANSFORM_LANES; k++ ) a.v[ k ] *= b.v[ k ];
+    return a;
+}
+
+static inline Lanes div( Lanes a, Lanes b ) {
+    for( int k = 0; k < TRANSFORM_LANES; k++ ) a.v[ k ] /= b.v[ k ];
+    return a;
+}
+
+#endif
+
+///
+// Constructor
+///
+TransformSet::TransformSet() :
+    lastView( 1.0f ), lastProjection( 1.0f ), count( 0 ) {
+}
+
+///
+// Compute the normal matrices of a step from its model matrices.
+//
+// The inverse transpose of a 3x3 matrix has the cross products of its
+// columns, each with the next, as columns, over the determinant.
+//
+// @param s - index of the first object of the step
+///
+void TransformSet::normalStep( size_t s ) {
+    Lanes a[3][3], n[3][3];
+
+    for( int c = 0; c < 3; c++ ) {
+        for( int r = 0; r < 3; r++ ) {
+            a[ c ][ r ] = load( &linear[ 3 * c + r ][ s ] );
+        }
+    }
+
+    for( int c = 0; c < 3; c++ ) {
+        const Lanes *p = a[ ( c + 1 ) % 3 ], *q = a[ ( c + 2 ) % 3 ];
+
+        n[ c ][ 0 ] = sub( mul( p[1], q[2] ), mul( p[2], q[1] ) );
+        n[ c ][ 1 ] = sub( mul( p[2], q[0] ), mul( p[0], q[2] ) );
+        n[ c ][ 2 ] = sub( mul( p[0], q[1] ), mul( p[1], q[0] ) );
+    }
+
+    Lanes det = add( add( mul( a[0][0], n[0][0] ), mul( a[0][1], n[0][1] ) ),
+                     mul( a[0][2], n[0][2] ) );
+    Lanes inv = div( splat( 1.0f ), det );
+
+    float out[9][ TRANSFORM_LANES ];
+
+    for( int e = 0; e < 9; e++ ) {
+        Lanes v = mul( n[ e / 3 ][ e % 3 ], inv );
+
+        store( &normal[ e ][ s ], v );
+        store( out[ e ], v );
+    }
+
+    for( size_t k = 0; k < TRANSFORM_LANES && s + k < count; k++ ) {
+        mat3 &Normal = transforms[ s + k ].Normal;
+
+        for( int e = 0; e < 9; e++ ) {
+            Normal[ e / 3 ][ e % 3 ] = out[ e ][ k ];
+        }
+    }
+}
+
+///
+// Compute the camera space matrices of a step.
+//
+// Each element of a product is a sum of four products, an element of the
+// camera matrix, the same for every object, times an element of the
+// matrices of the objects.
+//
+// @param s        - index of the first object of the step
+// @param View     - viewing matrix of the camera
+// @param ViewProj - projection times viewing matrix of the camera
+///
+void TransformSet::cameraStep( size_t s, const mat4 &View,
+                               const mat4 &ViewProj ) {
+    Lanes w[16], n[9];
+
+    for( int e = 0; e < 16; e++ ) {
+        w[ e ] = load( &world[ e ][ s ] );
+    }
+    for( int e = 0; e < 9; e++ ) {
+        n[ e ] = load( &normal[ e ][ s ] );
+    }
+
+    float modelView[16][ TRANSFORM_LANES ], mvp[16][ TRANSFORM_LANES ];
+    float normalView[9][ TRANSFORM_LANES ];
+
+    for( int c = 0; c < 4; c++ ) {
+        for( int r = 0; r < 4; r++ ) {
+            Lanes mv = splat( 0.0f ), p = splat( 0.0f );
+
+            for( int k = 0; k < 4; k++ ) {
+                const Lanes &wk = w[ 4 * c + k ];
+
+                mv = add( mv, mul( splat( View[ k ][ r ] ), wk ) );
+                p = add( p, mul( splat( ViewProj[ k ][ r ] ), wk ) );
+            }
+
+            store( modelView[ 4 * c + r ], mv );
+            store( mvp[ 4 * c + r ], p );
+        }
+    }
+
+    // the view is rigid, so its upper 3x3 turns normals too
+    for( int c = 0; c < 3; c++ ) {
+        for( int r = 0; r < 3; r++ ) {
+            Lanes nv = splat( 0.0f );
+
+            for( int k = 0; k < 3; k++ ) {
+                nv = add( nv, mul( splat( View[ k ][ r ] ), n[ 3 * c + k ] ) );
+            }
+
+            store( normalView[ 3 * c + r ], nv );
+        }
+    }
+
+    for( size_t k = 0; k < TRANSFORM_LANES && s + k < count; k++ ) {
+        ObjectTransform &t = transforms[ s + k ];
+
+        for( int e = 0; e < 16; e++ ) {
+            t.ModelView[ e / 4 ][ e % 4 ] = modelView[ e ][ k ];
+            t.MVP[ e / 4 ][ e % 4 ] = mvp[ e ][ k ];
+        }
+        for( int e = 0; e < 9; e++ ) {
+            t.NormalView[ e / 3 ][ e % 3 ] = normalView[ e ][ k ];
+        }
+    }
+}
+
+///
+// Compute the matrices of the objects that moved, and the camera space
+// matrices of every object if the camera moved; each object is then
+// pointed at its matrices.
+//
+// @param objects    - the objects in the scene
+// @param View       - viewing matrix of the current camera
+// @param Projection - projection matrix of the current camera
+//
+// @return the number of objects that moved
+///
+int TransformSet::update( vector< Object > &objects, const mat4 &View,
+                          const mat4 &Projection ) {
+    // a new set of objects has every one of them moved; the padding holds
+    // identities, which have inverses
+    bool resized = objects.size() != count;
+
+    if( resized ) {
+        count = objects.size();
+
+        size_t padded = ( count + TRANSFORM_LANES - 1 ) / TRANSFORM_LANES *
+                        TRANSFORM_LANES;
+
+        for( int e = 0; e < 16; e++ ) {
+            world[ e ].assign( padded, e % 5 == 0 ? 1.0f : 0.0f );
+        }
+        for( int e = 0; e < 9; e++ ) {
+            linear[ e ].assign( padded, e % 4 == 0 ? 1.0f : 0.0f );
+            normal[ e ].assign( padded, e % 4 == 0 ? 1.0f : 0.0f );
+        }
+
+        dirty.assign( padded / TRANSFORM_LANES, 0 );
+        transforms.resize( count );
+    }
+
+    int numMoved = 0;
+
+    for( size_t i = 0; i < count; i++ ) {
+        Object &obj = objects[ i ];
+
+        if( obj.moved || resized ) {
+            mat4 World = obj.Model;
+            if( obj.bufferSet != NULL ) {
+                World = World * obj.bufferSet->decodeMat;
+            }
+
+            transforms[ i ].World = World;
+
+            for( int e = 0; e < 16; e++ ) {
+                world[ e ][ i ] = World[ e / 4 ][ e % 4 ];
+            }
+            for( int e = 0; e < 9; e++ ) {
+                linear[ e ][ i ] = obj.Model[ e / 3 ][ e % 3 ];
+            }
+
+            dirty[ i / TRANSFORM_LANES ] = 1;
+            obj.moved = false;
+            numMoved++;
+        }
+
+        obj.transform = &transforms[ i ];
+    }
+
+    // the steps with a moved object, or all of them for a new camera
+    bool newCamera = resized || View != lastView ||
+                     Projection != lastProjection;
+    mat4 ViewProj = Projection * View;
+
+    for( size_t s = 0; s < count; s += TRANSFORM_LANES ) {
+        char &stepDirty = dirty[ s / TRANSFORM_LANES ];
+
+        if( stepDirty ) {
+            normalStep( s );
+        }
+        if( stepDirty || newCamera ) {
+            cameraStep( s, View, ViewProj );
+        }
+
+        stepDirty = 0;
+    }
+
+    lastView = View;
+    lastProjection = Projection;
+
+    return numMoved;
+}
+
+///
+// Get the matrices of an object.
+//
+// @param i - index of the object
+//
+// @return its matrices
+///
+const ObjectTransform &TransformSet::transform( size_t i ) const {
+    return transforms[ i ];
+}
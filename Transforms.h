@@ -0,0 +1,112 @@
+//
+// Transforms.h
+//
+// The transformation pass of a frame: the matrices of every object are
+// computed together, four objects at a time, and only again for the
+// objects that moved or when the camera did.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _TRANSFORMS_H_
+#define _TRANSFORMS_H_
+
+#include <vector>
+
+#include "Object.h"
+
+// objects computed by one step of the transformation kernels
+#define TRANSFORM_LANES 4
+
+///
+// The matrices of one object, as the shaders take them.
+///
+struct ObjectTransform {
+    // model matrix, including the decoding of packed vertex locations
+    mat4 World;
+    // inverse transpose of the model matrix, in world space
+    mat3 Normal;
+
+    // viewing matrix times World
+    mat4 ModelView;
+    // projection matrix times ModelView
+    mat4 MVP;
+    // the normal matrix in camera space
+    mat3 NormalView;
+};
+
+///
+// The model matrices of the objects in the scene, as one array per element
+// so the kernels load the same element of several objects at once, and
+// the matrices computed from them.
+///
+class TransformSet {
+
+    // elements of the world matrices and of the upper 3x3 of the model
+    // matrices, by column, padded to whole steps
+    vector< float > world[16];
+    vector< float > linear[9];
+
+    // elements of the normal matrices, by column
+    vector< float > normal[9];
+
+    // whether an object of each step moved since the pass last ran
+    vector< char > dirty;
+
+    // the matrices of each object
+    vector< ObjectTransform > transforms;
+
+    // the camera the camera space matrices were computed for
+    mat4 lastView, lastProjection;
+
+    // number of objects
+    size_t count;
+
+    ///
+    // Compute the normal matrices of a step from its model matrices.
+    //
+    // @param s - index of the first object of the step
+    ///
+    void normalStep( size_t s );
+
+    ///
+    // Compute the camera space matrices of a step.
+    //
+    // @param s        - index of the first object of the step
+    // @param View     - viewing matrix of the camera
+    // @param ViewProj - projection times viewing matrix of the camera
+    ///
+    void cameraStep( size_t s, const mat4 &View, const mat4 &ViewProj );
+
+public:
+
+    ///
+    // Constructor
+    ///
+    TransformSet();
+
+    ///
+    // Compute the matrices of the objects that moved, and the camera space
+    // matrices of every object if the camera moved; each object is then
+    // pointed at its matrices.
+    //
+    // @param objects    - the objects in the scene
+    // @param View       - viewing matrix of the current camera
+    // @param Projection - projection matrix of the current camera
+    //
+    // @return the number of objects that moved
+    ///
+    int update( vector< Object > &objects, const mat4 &View,
+                const mat4 &Projection );
+
+    ///
+    // Get the matrices of an object.
+    //
+    // @param i - index of the object
+    //
+    // @return its matrices
+    ///
+    const ObjectTransform &transform( size_t i ) const;
+};
+
+#endif
@@ -0,0 +1,164 @@
+//
+// UniformBlocks.cpp
+//
+// Uniform buffer objects shared by every shader program: the per-frame
+// block with the camera and the lights, and the table of every material in
+// the scene.
+//
+// Author:  Jietong Chen
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "UniformBlocks.h"
+#include "Lighting.h"
+
+using namespace std;
+
+// the uniform buffers
+static GLuint frameBuffer = 0;
+static GLuint materialBuffer = 0;
+
+// the materials held in the material table, in slot order
+static vector< Material > materials;
+
+///
+// Upload one slot of the material table.
+//
+// @param slot - index of the material in the table
+///
+static void writeMaterial( int slot ) {
+    const Material &m = materials[ slot ];
+    MaterialBlock entry;
+
+    memcpy( entry.ambient, glm::value_ptr( m.ambientColor ),
+            sizeof( entry.ambient ) );
+    memcpy( entry.diffuse, glm::value_ptr( m.diffuseColor ),
+            sizeof( entry.diffuse ) );
+    memcpy( entry.specular, glm::value_ptr( m.specularColor ),
+            sizeof( entry.specular ) );
+
+    entry.ka = m.ka;
+    entry.kd = m.kd;
+    entry.ks = m.ks;
+    entry.shininess = m.shininess;
+
+    glBindBuffer( GL_UNIFORM_BUFFER, materialBuffer );
+    glBufferSubData( GL_UNIFORM_BUFFER, slot * sizeof( MaterialBlock ),
+                     sizeof( entry ), &entry );
+}
+
+///
+// Do two materials look the same?
+//
+// @param a - the first material
+// @param b - the second material
+//
+// @return true if every property is equal
+///
+bool sameMaterial( const Material &a, const Material &b ) {
+    return a.ambientColor == b.ambientColor &&
+           a.diffuseColor == b.diffuseColor &&
+           a.specularColor == b.specularColor &&
+           a.ka == b.ka && a.kd == b.kd && a.ks == b.ks &&
+           a.shininess == b.shininess;
+}
+
+///
+// Create the uniform buffers and attach them to their binding points.
+///
+void createUniformBlocks( void ) {
+    glGenBuffers( 1, &frameBuffer );
+    glBindBuffer( GL_UNIFORM_BUFFER, frameBuffer );
+    glBufferData( GL_UNIFORM_BUFFER, sizeof( FrameBlock ), NULL,
+                  GL_DYNAMIC_DRAW );
+
+    glGenBuffers( 1, &materialBuffer );
+    glBindBuffer( GL_UNIFORM_BUFFER, materialBuffer );
+    glBufferData( GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof( MaterialBlock ),
+                  NULL, GL_DYNAMIC_DRAW );
+
+    glBindBufferBase( GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameBuffer );
+    glBindBufferBase( GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING,
+                      materialBuffer );
+
+    // materials found before the buffers existed
+    for( size_t i = 0; i < materials.size(); i++ ) {
+        writeMaterial( int( i ) );
+    }
+}
+
+///
+// Connect the uniform blocks a program declares to their binding points.
+//
+// @param program - the ID of a linked shader program
+///
+void bindUniformBlocks( GLuint program ) {
+    GLuint frame = glGetUniformBlockIndex( program, "Frame" );
+    if( frame != GL_INVALID_INDEX ) {
+        glUniformBlockBinding( program, frame, FRAME_BLOCK_BINDING );
+    }
+
+    GLuint table = glGetUniformBlockIndex( program, "Materials" );
+    if( table != GL_INVALID_INDEX ) {
+        glUniformBlockBinding( program, table, MATERIAL_BLOCK_BINDING );
+    }
+}
+
+///
+// Write the camera and the lights into the Frame block, once per frame.
+//
+// @param View       - viewing matrix of the current camera
+// @param Projection - projection matrix of the current camera
+///
+void updateFrameBlock( const glm::mat4 &View, const glm::mat4 &Projection ) {
+    FrameBlock frame;
+
+    memcpy( frame.viewMat, glm::value_ptr( View ),
+            sizeof( frame.viewMat ) );
+    memcpy( frame.projectionMat, glm::value_ptr( Projection ),
+            sizeof( frame.projectionMat ) );
+
+    // the lights, with the point light already in camera space
+    setUpLight( View, frame );
+
+    glBindBuffer( GL_UNIFORM_BUFFER, frameBuffer );
+    glBufferSubData( GL_UNIFORM_BUFFER, 0, sizeof( frame ), &frame );
+}
+
+///
+// Find the slot of a material in the material table, adding and uploading
+// it if no slot holds it yet.
+//
+// @param m - the material
+//
+// @return its index into the Materials block
+///
+int materialSlot( const Material &m ) {
+    for( size_t i = 0; i < materials.size(); i++ ) {
+        if( sameMaterial( materials[ i ], m ) ) {
+            return int( i );
+        }
+    }
+
+    if( materials.size() == MAX_MATERIALS ) {
+        cerr << "Error - more than " << MAX_MATERIALS <<
+             " distinct materials in the scene" << endl;
+        exit( 1 );
+    }
+
+    materials.push_back( m );
+
+    // only a new material is written; the table is never uploaded whole
+    int slot = int( materials.size() - 1 );
+    if( materialBuffer != 0 ) {
+        writeMaterial( slot );
+    }
+
+    return slot;
+}
@@ -0,0 +1,104 @@
+//
+// UniformBlocks.h
+//
+// Uniform buffer objects shared by every shader program: the per-frame
+// block with the camera and the lights, and the table of every material in
+// the scene.
+//
+// Author:  Jietong Chen
+//
+
+#ifndef _UNIFORMBLOCKS_H_
+#define _UNIFORMBLOCKS_H_
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+#ifndef __APPLE__
+#include <GL/glew.h>
+#endif
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "Material.h"
+
+// binding points of the uniform blocks
+#define FRAME_BLOCK_BINDING    0
+#define MATERIAL_BLOCK_BINDING 1
+
+// most distinct materials the material table holds
+#define MAX_MATERIALS 64
+
+// preprocessor lines sizing the material table of a shader
+#define BLOCK_DEFINES "#define MAX_MATERIALS 64\n"
+
+///
+// The Frame uniform block, in std140 layout.
+///
+struct FrameBlock {
+    // viewing matrix of the current camera
+    GLfloat viewMat[16];
+    // projection matrix of the current camera
+    GLfloat projectionMat[16];
+    // point light position (in camera space)
+    GLfloat pLightPosition[4];
+    // ambient light color
+    GLfloat aLightColor[4];
+    // point light color
+    GLfloat pLightColor[4];
+};
+
+///
+// One entry of the Materials uniform block, in std140 layout.
+///
+struct MaterialBlock {
+    GLfloat ambient[4];
+    GLfloat diffuse[4];
+    GLfloat specular[4];
+    GLfloat ka, kd, ks;
+    GLfloat shininess;
+};
+
+///
+// Do two materials look the same?
+//
+// @param a - the first material
+// @param b - the second material
+//
+// @return true if every property is equal
+///
+bool sameMaterial( const Material &a, const Material &b );
+
+///
+// Create the uniform buffers and attach them to their binding points.
+///
+void createUniformBlocks( void );
+
+///
+// Connect the uniform blocks a program declares to their binding points.
+//
+// @param program - the ID of a linked shader program
+///
+void bindUniformBlocks( GLuint program );
+
+///
+// Write the camera and the lights into the Frame block, once per frame.
+//
+// @param View       - viewing matrix of the current camera
+// @param Projection - projection matrix of the current camera
+///
+void updateFrameBlock( const glm::mat4 &View, const glm::mat4 &Projection );
+
+///
+// Find the slot of a material in the material table, adding and uploading
+// it if no slot holds it yet.
+//
+// @param m - the material
+//
+// @return its index into the Materials block
+///
+int materialSlot( const Material &m );
+
+#endif
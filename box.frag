@@ -0,0 +1,14 @@
+#version 140
+
+// Bounding box fragment shader, for occlusion queries
+//
+// Author:  Jietong Chen
+
+// OUTGOING DATA
+out vec4 finalColor;
+
+void main()
+{
+    // only the samples passing the depth test count; the color is masked
+    finalColor = vec4( 1.0 );
+}
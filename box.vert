@@ -0,0 +1,48 @@
+#version 140
+
+// Bounding box vertex shader, for occlusion queries
+//
+// Author:  Jietong Chen
+
+// INCOMING DATA
+
+// Corner of the unit box, from -1 to 1 on each axis
+in vec4 vPosition;
+
+// Center of the box (in world space)
+uniform vec3 boxCenter;
+
+// Half size of the box (in world space)
+uniform vec3 boxExtent;
+
+// Camera and lights, shared by every object of the frame
+layout( std140 ) uniform Frame
+{
+    // Viewing matrix
+    mat4 viewMat;
+
+    // Projection matrix
+    mat4 projectionMat;
+
+    // Point light position (in camera space)
+    vec4 pLightPosition;
+
+    // Ambient light color
+    vec4 aLightColor;
+
+    // Point light color
+    vec4 pLightColor;
+};
+
+//
+// Main function
+//
+
+void main()
+{
+    // stretch the unit box over the bounds of the object
+    vec4 corner = vec4( boxCenter + boxExtent * vPosition.xyz, 1.0 );
+
+    // Transform the vertex location into clip space
+    gl_Position = projectionMat * viewMat * corner;
+}
@@ -10,7 +10,10 @@
 //  Main program for lighting/shading/texturing assignment
 //
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -27,14 +30,30 @@
 
 #include <GLFW/glfw3.h>
 
+#include "AssetPack.h"
+#include "BufferArena.h"
 #include "Buffers.h"
 #include "ShaderSetup.h"
 #include "Canvas.h"
+#include "Culling.h"
 #include "Shapes.h"
 #include "Lighting.h"
 #include "Textures.h"
 #include "Camera.h"
 #include "Object.h"
+#include "Occlusion.h"
+#include "OcclusionQuery.h"
+#include "MeshRegistry.h"
+#include "IndirectDraw.h"
+#include "Instancing.h"
+#include "ProgramInfo.h"
+#include "RenderQueue.h"
+#include "RenderState.h"
+#include "SceneFile.h"
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+#include "Transforms.h"
+#include "UniformBlocks.h"
 
 using namespace std;
 
@@ -62,22 +81,78 @@ bool animating = false;
 // Initial animation rotation angles for the objects
 GLfloat angles = 0.0f;
 
+// report the pipeline statistics of the next frame
+bool reportStats = false;
+
+// report the state changes of the next frame, starting with the first
+bool reportStates = true;
+
 // program IDs...for shader programs
 GLuint pshader, gshader, tshader;
 
-///
-// Create vertex and element buffers for a shape.
-//
-// @param obj - which shape to create
-// @param C   - the Canvas to use
-///
-void createShape( int obj, Canvas &C ) {
-    // clear any previous shape
-    C.clear();
-
-    // make the shape
-    makeShape( obj, C );
-}
+// program IDs of the instanced variants, 0 if instancing is unavailable
+GLuint pishader, tishader;
+
+// program ID of the indirect variant of the Phong shader, 0 if indirect
+// drawing is unavailable
+GLuint pdshader;
+
+// program ID of the bounding box shader, 0 if occlusion queries are
+// unavailable
+GLuint bshader;
+
+// groups of Phong objects drawn with one indirect call each
+vector< IndirectGroup > group;
+// whether a group draws each object
+vector< bool > indirectOf;
+// draw the groups, rather than their objects one by one
+bool drawIndirect = true;
+
+// batches of objects drawn with one instanced call each
+vector< InstanceBatch > batch;
+// the batch of each object, -1 if it is drawn alone
+vector< int > batchOf;
+
+// the draws of the frame, in state order
+RenderQueue queue;
+
+// the scene read from its file; the objects are named from it
+SceneDescription sceneFile;
+
+// where the objects rest, each relative to what it rests on
+SceneGraph scene;
+// the node of the plate, carrying the cookies on it, -1 for no plate
+int plateNode = -1;
+// where the plate was put on the table
+vec3 plateHome;
+
+// the matrices of every object, computed once per frame
+TransformSet transforms;
+
+// world space bounds of the objects, for frustum culling
+CullSet cullSet;
+// whether each object may be seen from the current camera
+vector< char > visible;
+// skip the objects outside the view volume
+bool cullObjects = true;
+// objects seen in the last frame, -1 before the first
+int lastVisible = -1;
+
+// the large opaque objects, hiding what is behind them
+OcclusionCuller occlusion;
+// skip the objects behind the occluders
+bool occludeObjects = true;
+// the occluders drawn on a worker, ahead of the frame after the one they
+// were drawn for
+JobGroup occluderJobs( ThreadPool::shared() );
+// whether they were drawn ahead, and the camera they were drawn with
+bool occludersAhead = false;
+mat4 aheadView, aheadProjection;
+
+// the bounding box queries of the objects on the GPU
+OcclusionQueries occlusionQueries;
+// how the query results are used; the queries replace the occluders
+int queryMode = QUERY_OFF;
 
 ///
 // Create the cameras in the scene.
@@ -108,7 +183,8 @@ void createCamera() {
 void initShader() {
     // Load shaders, verifying each
     ShaderError error;
-    pshader = shaderSetup( "phong.vert", "phong.frag", &error );
+    pshader = shaderSetupDefines( "phong.vert", "phong.frag", BLOCK_DEFINES,
+                              &error );
     if( !pshader ) {
         cerr << "Error setting up Phong shader - " <<
              errorString( error ) << endl;
@@ -116,7 +192,8 @@ void initShader() {
         exit( 1 );
     }
 
-    gshader = shaderSetup( "glass.vert", "glass.frag", &error );
+    gshader = shaderSetupDefines( "glass.vert", "glass.frag", BLOCK_DEFINES,
+                              &error );
     if( !gshader ) {
         cerr << "Error setting up Phong shader - " <<
              errorString( error ) << endl;
@@ -124,389 +201,507 @@ void initShader() {
         exit( 1 );
     }
 
-    tshader = shaderSetup( "texture.vert", "texture.frag", &error );
+    tshader = shaderSetupDefines( "texture.vert", "texture.frag", BLOCK_DEFINES,
+                              &error );
     if( !tshader ) {
         cerr << "Error setting up texture shader - " <<
              errorString( error ) << endl;
         glfwTerminate();
         exit( 1 );
     }
+
+    // the instanced variants need per-instance attributes (GL 3.3);
+    // without them every object is drawn on its own
+    pishader = tishader = 0;
+#ifndef __APPLE__
+    if( GLEW_VERSION_3_3 ) {
+        pishader = shaderSetupDefines( "phong.vert", "phong.frag",
+                                       INSTANCED_DEFINES, &error );
+        tishader = shaderSetupDefines( "texture.vert", "texture.frag",
+                                       INSTANCED_DEFINES, &error );
+        if( !pishader || !tishader ) {
+            cerr << "Error setting up instanced shaders - " <<
+                 errorString( error ) << ", drawing without instancing" <<
+                 endl;
+            pishader = tishader = 0;
+        }
+    }
+#endif
+
+    // the indirect variant needs GL 4.3; without it the Phong objects are
+    // drawn as the others are
+    pdshader = 0;
+    if( indirectSupported() ) {
+        pdshader = shaderSetupDefines( "phong.vert", "phong.frag",
+                                       INDIRECT_DEFINES, &error );
+        if( !pdshader ) {
+            cerr << "Error setting up indirect shader - " <<
+                 errorString( error ) << ", drawing without it" << endl;
+        }
+    }
+
+    // the occlusion queries need GL 3.3; without them the objects are
+    // only culled on the CPU
+    bshader = 0;
+    if( queriesSupported() ) {
+        bshader = shaderSetup( "box.vert", "box.frag", &error );
+        if( !bshader ) {
+            cerr << "Error setting up box shader - " <<
+                 errorString( error ) << ", drawing without queries" << endl;
+        }
+    }
+
+    // look up the locations of every program once, ahead of drawing, and
+    // connect the programs to the shared uniform blocks
+    GLuint programs[] = { pshader, gshader, tshader, pishader, tishader,
+                          pdshader, bshader };
+
+    for( int i = 0; i < 7; i++ ) {
+        if( programs[ i ] != 0 ) {
+            reflectProgram( programs[ i ] );
+            bindUniformBlocks( programs[ i ] );
+        }
+    }
 }
 
 ///
-// Create every objects in the scene and set up the material properties and
-// the model transformation.
+// Create every objects in the scene from the scene file, which sets up the
+// material properties and the model transformation of each.
 ///
 void createObject() {
-    // the table
-    createShape( OBJ_TABLE, *canvas );
-    Object table = Object( pshader, *canvas );
-
-    table.material.ambientColor = vec4( 0.1f, 0.5f, 0.9f, 1.0f );
-    table.material.diffuseColor = vec4( 0.18f, 0.19f, 0.19f, 1.0f );
-    table.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    table.material.ka = 0.1f;
-    table.material.kd = 0.9f;
-    table.material.ks = 1.0f;
-    table.material.shininess = 48.0f;
-
-    table.translate( 0.0f, -0.1f, 0.0f );
-
-    object.push_back( table );
-
-    // the yellow teapot
-    createShape( OBJ_TEAPOT, *canvas );
-    Object teapot = Object( pshader, *canvas );
-
-    teapot.material.ambientColor = vec4( 0.949f, 0.804f, 0.149f, 1.0f );
-    teapot.material.diffuseColor = vec4( 0.949f, 0.804f, 0.149f, 1.0f );
-    teapot.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    teapot.material.ka = 0.7f;
-    teapot.material.kd = 0.9f;
-    teapot.material.ks = 1.0f;
-    teapot.material.shininess = 48.0f;
-
-    teapot.scale( 2.43f, 2.43f, 2.43f );
-    teapot.rotateY( 145.0f );
-    teapot.translate( 1.19f, 0.0f, -1.48f );
-
-    object.push_back( teapot );
-
-    // the cup with blueberry texture
-    createShape( OBJ_CUP, *canvas );
-    Object cup = Object( tshader, *canvas );
-
-    cup.material.ka = 0.7f;
-    cup.material.kd = 1.0f;
-    cup.material.ks = 1.0f;
-    cup.material.shininess = 48.0f;
-
-    cup.texture = Texture::cup;
-
-    cup.rotateY( -28.0f );
-    cup.translate( 2.05f, 0.0f, 0.34f );
-
-    object.push_back( cup );
-
-    // the sliver spoon
-    createShape( OBJ_SPOON, *canvas );
-    Object spoon = Object( pshader, *canvas );
-
-    spoon.material.ambientColor = vec4( 0.672f, 0.637f, 0.585f, 1.0f );
-    spoon.material.diffuseColor = vec4( 0.672f, 0.637f, 0.585f, 1.0f );
-    spoon.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    spoon.material.ka = 0.2f;
-    spoon.material.kd = 0.7f;
-    spoon.material.ks = 1.0f;
-    spoon.material.shininess = 10.0f;
-
-    spoon.scale( 1.35f, 1.35f, 1.35f );
-    spoon.rotateY( 9.0f );
-    spoon.translate( 1.58f, 0.0f, 1.5f );
-
-    object.push_back( spoon );
-
-    // the porcelain plate
-    createShape( OBJ_PLATE, *canvas );
-    Object plate = Object( pshader, *canvas );
-
-    plate.material.ambientColor = vec4( 0.992f, 1.0f, 0.988f, 1.0f );
-    plate.material.diffuseColor = vec4( 0.992f, 1.0f, 0.988f, 1.0f );
-    plate.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    plate.material.ka = 0.5f;
-    plate.material.kd = 0.7f;
-    plate.material.ks = 1.0f;
-    plate.material.shininess = 10.0f;
-
-    plate.scale( 1.05f, 1.05f, 1.05f );
-    plate.translate( -0.65f, 0.0f, 1.1f );
-
-    object.push_back( plate );
-
-    // the first doughnut
-    createShape( OBJ_DOUGHNUT, *canvas );
-    Object doughnut1 = Object( pshader, *canvas );
-
-    doughnut1.material.ambientColor = vec4( 0.788f, 0.439f, 0.078f, 1.0f );
-    doughnut1.material.diffuseColor = vec4( 0.788f, 0.439f, 0.078f, 1.0f );
-    doughnut1.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    doughnut1.material.ka = 0.5f;
-    doughnut1.material.kd = 0.7f;
-    doughnut1.material.ks = 0.3f;
-    doughnut1.material.shininess = 10.0f;
-
-    doughnut1.scale( 0.67f, 0.67f, 0.67f );
-    doughnut1.rotateX( -84.0f );
-    doughnut1.rotateY( 40.0f );
-    doughnut1.translate( -1.7f, 1.6f, -1.3f );
-
-    object.push_back( doughnut1 );
-
-    // the second doughnut
-    Object doughnut2 = Object( pshader, *canvas );
-    doughnut2.material = doughnut1.material;
-
-    doughnut2.scale( 0.6f, 0.6f, 0.6f );
-    doughnut2.rotateX( -68.0f );
-    doughnut2.rotateY( -118.0f );
-    doughnut2.translate( -2.2f, 1.6f, -1.7f );
-
-    object.push_back( doughnut2 );
-
-    // the first yellow apple
-    createShape( OBJ_APPLE, *canvas );
-    Object apple1 = Object( pshader, *canvas );
-
-    apple1.material.ambientColor = vec4( 0.873f, 0.363f, 0.128f, 1.0f );
-    apple1.material.diffuseColor = vec4( 0.973f, 0.851f, 0.008f, 1.0f );
-    apple1.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    apple1.material.ka = 0.5f;
-    apple1.material.kd = 0.9f;
-    apple1.material.ks = 0.3f;
-    apple1.material.shininess = 16.0f;
-
-    apple1.scale( 0.82f, 0.82f, 0.82f );
-    apple1.rotateX( 6.0f );
-    apple1.rotateY( 298.0f );
-    apple1.translate( -0.68f, 0.0f, -1.3f );
+    GLuint programs[ NUM_PROGRAMS ] = { pshader, tshader, gshader };
 
-    object.push_back( apple1 );
-
-    // the second yellow apple
-    Object apple2 = Object( pshader, *canvas );
-    apple2.material = apple1.material;
+    loadScene( "scene/tea.scene", sceneFile );
+    vector< int > nodes = instantiateScene( sceneFile, programs, *canvas,
+                                            object, scene, occlusion );
 
-    apple2.scale( 0.87f, 0.87f, 0.87f );
-    apple2.rotateY( -15.0f );
-    apple2.rotateX( 40.0f );
-    apple2.rotateZ( -74.0f );
-    apple2.translate( -2.85f, 0.3f, -0.8f );
-
-    object.push_back( apple2 );
-
-    // the first pirouline cookies
-    createShape( OBJ_COOKIES1, *canvas );
-    Object cookies1 = Object( pshader, *canvas );
-
-    cookies1.material.ambientColor = vec4( 0.847f, 0.490f, 0.071f, 1.0f );
-    cookies1.material.diffuseColor = vec4( 0.961f, 0.843f, 0.6f, 1.0f );
-    cookies1.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    cookies1.material.ka = 1.0f;
-    cookies1.material.kd = 0.7f;
-    cookies1.material.ks = 0.1f;
-    cookies1.material.shininess = 1.0f;
-
-    cookies1.scale( 0.54f, 0.54f, 0.54f );
-    cookies1.rotateZ( 155.0f );
-    cookies1.rotateX( 5.0f );
-    cookies1.rotateY( -31.0f );
-    cookies1.translate( -0.38f, 0.278f, 1.08f );
+    // the plate slides with the cookies on it
+    plateNode = -1;
+    for( int i = 0; i < object.size(); i++ ) {
+        if( strcmp( object[ i ].name, "plate" ) == 0 ) {
+            plateNode = nodes[ i ];
+            plateHome = scene.getTranslation( plateNode );
+        }
+    }
+}
 
-    object.push_back( cookies1 );
+///
+// OpenGL initialization
+///
+void init( void ) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
-    // the second pirouline cookies
-    Object cookies2 = Object( pshader, *canvas );
-    cookies2.material = cookies1.material;
-
-    cookies2.scale( 0.54f, 0.54f, 0.51f );
-    cookies2.rotateZ( -84.0f );
-    cookies2.rotateX( 3.0f );
-    cookies2.rotateY( -32.0f );
-    cookies2.translate( -0.65f, 0.278f, 1.03f );
+    // the cooked assets, if there are any, stand in for their files
+    if( openAssetPack( "assets.pack" ) ) {
+        cout << "Loading the assets from assets.pack" << endl;
+    }
 
-    object.push_back( cookies2 );
+    // Create our Canvas
+    canvas = new Canvas( w_width, w_height );
 
-    // the third pirouline cookies
-    Object cookies3 = Object( pshader, *canvas );
-    cookies3.material = cookies1.material;
+    if( canvas == NULL ) {
+        cerr << "error - cannot create Canvas" << endl;
+        glfwTerminate();
+        exit( 1 );
+    }
 
-    cookies3.scale( 0.54f, 0.54f, 0.52f );
-    cookies3.rotateZ( -147.0f );
-    cookies3.rotateX( -9.0f );
-    cookies3.rotateY( -41.0f );
-    cookies3.translate( -1.12f, 0.338f, 1.18f );
+    // create the cameras
+    createCamera();
 
-    object.push_back( cookies3 );
+    // initialize the shader programs
+    initShader();
 
-    // the fourth short pirouline cookies
-    createShape( OBJ_COOKIES2, *canvas );
-    Object cookies4 = Object( pshader, *canvas );
-    cookies4.material = cookies1.material;
+    // the camera, lights and materials shared by every program
+    createUniformBlocks();
 
-    cookies4.scale( 0.50f, 0.50f, 0.50f );
-    cookies4.rotateZ( -83.0f );
-    cookies4.rotateY( 11.0f );
-    cookies4.translate( -2.05f, 0.124f, 1.37f );
+    // Other OpenGL initialization
+    glEnable( GL_DEPTH_TEST );
+    glEnable( GL_CULL_FACE );
+    glCullFace( GL_BACK );
+    glEnable( GL_BLEND );
+    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 
-    object.push_back( cookies4 );
+    glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+    glClearColor( 0.0f, 0.0f, 0.0f, 0.0f );
+    glDepthFunc( GL_LEQUAL );
+    glClearDepth( 1.0f );
 
-    // the fifth short pirouline cookies
-    Object cookies5 = Object( pshader, *canvas );
-    cookies5.material = cookies1.material;
+    // Create all our objects, with their meshes and textures
+    createObject();
 
-    cookies5.scale( 0.6f, 0.6f, 0.432f );
-    cookies5.rotateZ( -102.0f );
-    cookies5.rotateY( 240.0f );
-    cookies5.translate( -2.64f, 0.1536f, 1.21f );
+    // objects drawing the same shape share its buffers
+    int numMeshes;
+    long numBytes;
+    meshUsage( numMeshes, numBytes );
 
-    object.push_back( cookies5 );
+    cout << object.size() << " objects share " << numMeshes <<
+         " meshes, " << numBytes << " bytes of buffers" << endl;
 
-    // the big foliage
-    createShape( OBJ_QUAD, *canvas );
-    Object foliage1 = Object( tshader, *canvas );
+    int numPages;
+    long pageUsed, pageBytes;
+    arenaUsage( numPages, pageUsed, pageBytes );
 
-    foliage1.material.ka = 0.5f;
-    foliage1.material.kd = 1.0f;
-    foliage1.material.ks = 0.7f;
-    foliage1.material.shininess = 10.0f;
+    cout << numMeshes << " meshes in " << numPages << " arena pages, " <<
+         pageUsed << " of " << pageBytes << " bytes in use" << endl;
 
-    foliage1.texture = Texture::foliage1;
+    // the matrices of the objects, which the batches and groups copy
+    transforms.update( object, camera[ currentCamera ].getViewMat(),
+                       camera[ currentCamera ].getProjectionMat() );
 
-    foliage1.scale( 1.16f, 1.16f, 1.16f );
-    foliage1.rotateX( -9.0f );
-    foliage1.rotateZ( 22.0f );
-    foliage1.translate( -2.5f, 2.7f, -2.5f );
+    // group the opaque Phong objects into indirect draws
+    if( pdshader != 0 ) {
+        makeIndirectGroups( object, pshader, pdshader, group, indirectOf );
+    } else {
+        indirectOf.assign( object.size(), false );
+    }
 
-    object.push_back( foliage1 );
+    // batch the objects sharing a mesh, program and texture; the Phong
+    // objects are batched only if no indirect group draws them
+    map< GLuint, GLuint > instanced;
+    if( pishader != 0 ) {
+        if( pdshader == 0 ) {
+            instanced[ pshader ] = pishader;
+        }
+        instanced[ tshader ] = tishader;
+    }
+    makeBatches( object, instanced, batch, batchOf );
 
-    // the first small foliage
-    createShape( OBJ_FOLIAGE, *canvas );
-    Object foliage2 = Object( tshader, *canvas );
+    int numDraws = object.size();
+    for( int i = 0; i < batch.size(); i++ ) {
+        numDraws -= batch[ i ].members.size() - 1;
+    }
+    for( int i = 0; i < group.size(); i++ ) {
+        numDraws -= group[ i ].members.size() - 1;
+    }
 
-    foliage2.material = foliage1.material;
-    foliage2.texture = Texture::foliage2;
+    cout << object.size() << " objects in " << numDraws <<
+         " draw calls" << endl;
 
-    foliage2.scale( 0.38f, 0.32f, 0.38f );
-    foliage2.rotateX( -53.0f );
-    foliage2.rotateY( -128.0f );
-    foliage2.translate( 0.9f, 0.1f, 0.5f );
+    // the objects stay where they are, so they are bounded once
+    cullSet.updateBounds( object );
 
-    object.push_back( foliage2 );
+    cout << occlusion.numTriangles() << " occluder triangles" << endl;
 
-    // the second small foliage
-    Object foliage3 = Object( tshader, *canvas );
+    if( bshader != 0 ) {
+        occlusionQueries.create( bshader, object.size() );
+    }
 
-    foliage3.material = foliage1.material;
-    foliage3.texture = Texture::foliage3;
+    chrono::duration< double, milli > elapsed =
+            chrono::steady_clock::now() - start;
 
-    foliage3.scale( 0.47f, 0.47f, 0.47f );
-    foliage3.rotateZ( 28.0f );
-    foliage3.rotateX( 66.0f );
-    foliage3.rotateY( 3.0f );
-    foliage3.translate( -1.1f, 2.05f, -2.0f );
+    cout << "Initialized in " << elapsed.count() << " ms" << endl;
+}
 
-    object.push_back( foliage3 );
+///
+// Display callback
+//
+// Invoked whenever the image must be redrawn
+///
+void display( void ) {
+    mat4 View = camera[ currentCamera ].getViewMat();
+    mat4 Projection = camera[ currentCamera ].getProjectionMat();
 
-    // the third small foliage
-    Object foliage4 = Object( tshader, *canvas );
+    // the occluders drawn ahead by the last frame are done before anything
+    // they read changes
+    occluderJobs.wait();
 
-    foliage4.material = foliage1.material;
-    foliage4.texture = Texture::foliage4;
+    // place the objects under the nodes that changed
+    scene.update( object );
 
-    foliage4.scale( 0.77f, 0.77f, 0.77f );
-    foliage4.rotateZ( 8.0f );
-    foliage4.rotateX( 55.0f );
-    foliage4.rotateY( -41.0f );
-    foliage4.translate( -0.8f, 2.1f, -2.0f );
+    // the matrices of the objects that moved, and of every object when the
+    // camera did; the bounds, occluders, batches and groups of moved
+    // objects follow
+    int occludersMoved = 0;
 
-    object.push_back( foliage4 );
+    if( transforms.update( object, View, Projection ) > 0 ) {
+        cullSet.updateBounds( object );
+        occludersMoved = occlusion.follow( object );
 
-    // the fourth small foliage
-    Object foliage5 = Object( tshader, *canvas );
+        for( int b = 0; b < batch.size(); b++ ) {
+            batch[ b ].createInstances( object );
+        }
+        for( int g = 0; g < group.size(); g++ ) {
+            group[ g ].updateDraws( object );
+        }
+    }
 
-    foliage5.material = foliage1.material;
-    foliage5.texture = Texture::foliage3;
+    // the commands of the groups whose meshes moved in their page; if one
+    // left its page, the groups are made again
+    bool regroup = false;
+    for( int g = 0; g < group.size(); g++ ) {
+        regroup = !group[ g ].refreshCommands( object ) || regroup;
+    }
+    if( regroup ) {
+        makeIndirectGroups( object, pshader, pdshader, group, indirectOf );
+    }
 
-    foliage5.scale( 0.7f, 0.7f, 0.7f );
-    foliage5.rotateX( 124.0f );
-    foliage5.rotateY( -48.0f );
-    foliage5.translate( -2.4f, 1.65f, -0.7f );
+    // count the fragment shader invocations of each object, if asked to
+    bool measure = false;
+    vector< GLuint > queries;
 
-    object.push_back( foliage5 );
+    if( reportStats ) {
+        reportStats = false;
+#ifndef __APPLE__
+        measure = GLEW_ARB_pipeline_statistics_query;
+#endif
+        if( measure ) {
+            queries.resize( object.size() );
+            glGenQueries( queries.size(), &queries[ 0 ] );
+        } else {
+            cerr << "Pipeline statistics queries are not supported" << endl;
+        }
+    }
 
-    // the fifth small foliage
-    Object foliage6 = Object( tshader, *canvas );
+    // the occluders drawn ahead serve if neither the camera nor they have
+    // moved since; if not, they are drawn on a worker now, while the frame
+    // is set up here
+    bool querying = queryMode != QUERY_OFF && bshader != 0 && cullObjects &&
+                    !measure;
+    bool occlude = occludeObjects && cullObjects && !measure && !querying;
+    bool ahead = occludersAhead && occludersMoved == 0 &&
+                 View == aheadView && Projection == aheadProjection;
+    occludersAhead = false;
+
+    if( occlude && !ahead ) {
+        occluderJobs.submit( [ View, Projection ]() {
+            occlusion.render( Projection, View );
+        } );
+    }
 
-    foliage6.material = foliage1.material;
-    foliage6.texture = Texture::foliage4;
+    // clear and draw params..
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
-    foliage6.scale( 0.89f, 0.89f, 0.89f );
-    foliage6.rotateZ( -4.0f );
-    foliage6.rotateX( 149.0f );
-    foliage6.rotateY( -68.0f );
-    foliage6.translate( -2.7f, 1.8f, -1.0f );
+    // the camera and lights, once for every object of the frame
+    updateFrameBlock( View, Projection );
 
-    object.push_back( foliage6 );
+    // leave out the objects outside the view volume; measured objects are
+    // all drawn, to count each of them
+    int numVisible = object.size();
+    int numOutside = 0, numHidden = 0;
 
-    // the glass pot
-    createShape( OBJ_POT, *canvas );
-    Object pot = Object( gshader, *canvas );
+    if( cullObjects && !measure ) {
+        Frustum frustum = extractFrustum( Projection, View );
+        numVisible = cullSet.cull( frustum, visible );
+        numOutside = object.size() - numVisible;
+    } else {
+        visible.assign( object.size(), 1 );
+    }
 
-    pot.material.ambientColor = vec4( 0.769f, 0.992f, 0.969f, 0.5f );
-    pot.material.diffuseColor = vec4( 0.769f, 0.992f, 0.969f, 0.5f );
-    pot.material.specularColor = vec4( 1.0f, 1.0f, 1.0f, 1.0f );
-    pot.material.ka = 1.0f;
-    pot.material.kd = 0.2f;
-    pot.material.ks = 1.0f;
-    pot.material.shininess = 48.0f;
+    // then the objects behind the occluders
+    if( occlude ) {
+        occluderJobs.wait();
+        numHidden = occlusion.cull( cullSet, visible );
+        numVisible -= numHidden;
+    }
 
-    pot.scale( 1.76f, 1.76f, 1.76f );
-    pot.translate( -1.8f, 0.0f, -1.4f );
+    // or those an earlier query found hidden; under conditional render
+    // only the objects sharing a call with others, as each of the rest
+    // is queried right before it is drawn.  The boxes of every object in
+    // the view are queried again, hidden or not.
+    bool indirect = drawIndirect && !measure && !group.empty();
+    vector< char > inView;
 
-    object.push_back( pot );
-}
+    if( querying ) {
+        occlusionQueries.collect();
+        inView = visible;
 
-///
-// OpenGL initialization
-///
-void init( void ) {
-    // Create our Canvas
-    canvas = new Canvas( w_width, w_height );
+        vector< bool > shared( object.size() );
+        for( int i = 0; i < object.size(); i++ ) {
+            shared[ i ] = batchOf[ i ] >= 0 || ( indirect && indirectOf[ i ] );
+        }
 
-    if( canvas == NULL ) {
-        cerr << "error - cannot create Canvas" << endl;
-        glfwTerminate();
-        exit( 1 );
+        numHidden = occlusionQueries.hide(
+                visible, queryMode == QUERY_CONDITIONAL ? &shared : NULL );
+        numVisible -= numHidden;
     }
 
-    // Load texture image(s)
-    loadTexture();
+    if( numVisible != lastVisible ) {
+        lastVisible = numVisible;
 
-    // create the cameras
-    createCamera();
+        cout << numVisible << " objects visible, " << numOutside <<
+             " outside the view, " << numHidden << " occluded" << endl;
+    }
 
-    // initialize the shader programs
-    initShader();
+    resetStateCounts();
 
-    // Other OpenGL initialization
-    glEnable( GL_DEPTH_TEST );
-    glEnable( GL_CULL_FACE );
-    glCullFace( GL_BACK );
-    glEnable( GL_BLEND );
-    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    // the opaque Phong objects, each group with one call
+    if( indirect ) {
+        for( int i = 0; i < group.size(); i++ ) {
+            group[ i ].drawGroup( visible );
+        }
+    }
 
-    glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
-    glClearColor( 0.0f, 0.0f, 0.0f, 0.0f );
-    glDepthFunc( GL_LEQUAL );
-    glClearDepth( 1.0f );
+    // the draws left to the queue; a batch is drawn by its first member
+    // while any of its members may be seen
+    vector< bool > skip( object.size() );
 
-    // Create all our objects
-    createObject();
+    for( int i = 0; i < object.size(); i++ ) {
+        skip[ i ] = !visible[ i ] || ( indirect && indirectOf[ i ] );
+    }
+
+    if( !measure ) {
+        for( int b = 0; b < batch.size(); b++ ) {
+            bool seen = false;
+
+            for( int m = 0; m < batch[ b ].members.size(); m++ ) {
+                seen = seen || visible[ batch[ b ].members[ m ] ];
+            }
+
+            skip[ batch[ b ].members[ 0 ] ] = !seen;
+        }
+    }
+
+    // sort the other draws by state; measured objects are counted one by
+    // one
+    queue.build( object, batch, measure ? NULL : &batchOf, &skip, View,
+                 camera[ currentCamera ].zfar );
+
+    // draw all objects
+    for( size_t d = 0; d < queue.size(); d++ ) {
+        int i = queue.item( d );
+
+#ifndef __APPLE__
+        if( measure ) {
+            glBeginQuery( GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[ i ] );
+        }
+#endif
+
+        // an object drawn alone is drawn only if its box passes samples
+        bool conditional = querying && queryMode == QUERY_CONDITIONAL &&
+                           batchOf[ i ] < 0;
+        if( conditional ) {
+            occlusionQueries.beginBoxes();
+            conditional = occlusionQueries.query(
+                    cullSet, i, camera[ currentCamera ].position,
+                    camera[ currentCamera ].znear );
+            occlusionQueries.endBoxes();
+        }
+
+        if( conditional ) {
+            occlusionQueries.beginConditional( i );
+            object[ i ].drawObject();
+            occlusionQueries.endConditional();
+        } else if( measure || batchOf[ i ] < 0 ) {
+            // counted one by one when measuring
+            object[ i ].drawObject();
+        } else {
+            // the first member draws the whole batch
+            batch[ batchOf[ i ] ].drawBatch( object, visible );
+        }
+
+#ifndef __APPLE__
+        if( measure ) {
+            glEndQuery( GL_FRAGMENT_SHADER_INVOCATIONS_ARB );
+        }
+#endif
+    }
+
+    // query the boxes against the finished depth buffer, for the next
+    // frame; those queried above are still pending
+    if( querying ) {
+        occlusionQueries.beginBoxes();
+
+        for( int i = 0; i < object.size(); i++ ) {
+            if( inView[ i ] ) {
+                occlusionQueries.query( cullSet, i,
+                                        camera[ currentCamera ].position,
+                                        camera[ currentCamera ].znear );
+            }
+        }
+
+        occlusionQueries.endBoxes();
+    }
+
+    if( measure ) {
+        GLuint total = 0;
+
+        for( int i = 0; i < object.size(); i++ ) {
+            GLuint invocations;
+            glGetQueryObjectuiv( queries[ i ], GL_QUERY_RESULT,
+                                 &invocations );
+            total += invocations;
+
+            cout << object[ i ].name << ": " << invocations
+                 << " fragment shader invocations" << endl;
+        }
+
+        cout << "total: " << total << " fragment shader invocations"
+             << endl;
+
+        glDeleteQueries( queries.size(), &queries[ 0 ] );
+    }
+
+    // draw the occluders for the next frame, as seen by this one, while
+    // this one is swapped and drawn by the GPU and the events are read
+    occludersAhead = occludeObjects && cullObjects &&
+                     ( queryMode == QUERY_OFF || bshader == 0 );
+    if( occludersAhead ) {
+        aheadView = View;
+        aheadProjection = Projection;
+        occluderJobs.submit( [ View, Projection ]() {
+            occlusion.render( Projection, View );
+        } );
+    }
+
+    if( reportStates ) {
+        reportStates = false;
+
+        // every draw used to set its program, texture and vertex array
+        const StateCounts &counts = stateCounts();
+
+        cout << queue.size() + ( indirect ? group.size() : 0 ) <<
+             " draws set " << counts.programs <<
+             " programs, " << counts.textures << " textures, " <<
+             counts.vertexArrays << " vertex arrays" << endl;
+        cout << "in state order " << counts.programChanges <<
+             " programs, " << counts.textureChanges << " textures, " <<
+             counts.vertexArrayChanges << " vertex arrays changed" << endl;
+    }
 }
 
 ///
-// Display callback
+// Set the overdraw pass of the shapes, and make again the meshes whose
+// processing changed, so their fragment shader invocations can be compared
+// with 'p' before and after.
 //
-// Invoked whenever the image must be redrawn
+// @param enabled   - whether the shapes asking for it get the pass
+// @param threshold - how much worse than the vertex cache order each
+//                    cluster's cache miss ratio may become
 ///
-void display( void ) {
-    // clear and draw params..
-    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+void reprocessShapes( bool enabled, float threshold ) {
+    vector< unsigned int > before( OBJ_TEAPOT + 1 );
+    for( int s = 0; s <= OBJ_TEAPOT; s++ ) {
+        before[ s ] = shapeFlags( s );
+    }
 
-    // draw all objects
-    for( int i = 0; i < object.size(); i++ ) {
-        object[ i ].drawObject();
+    setOverdrawOptimization( enabled, threshold );
+
+    cout << "overdraw optimization " << ( enabled ? "on" : "off" ) <<
+         ", threshold " << overdrawThreshold() << endl;
+
+    vector< BufferSet * > remade;
+    for( int s = 0; s <= OBJ_TEAPOT; s++ ) {
+        BufferSet *mesh = before[ s ] != shapeFlags( s ) ? remakeMesh( s ) :
+                          NULL;
+        if( mesh != NULL ) {
+            remade.push_back( mesh );
+        }
+    }
+
+    // the vertex array objects of the batches read the pages of the old
+    // ranges; the groups see the arena change and refresh their commands,
+    // or are made again
+    for( int b = 0; b < batch.size(); b++ ) {
+        BufferSet *mesh = object[ batch[ b ].members[ 0 ] ].bufferSet;
+
+        if( find( remade.begin(), remade.end(), mesh ) != remade.end() ) {
+            glDeleteVertexArrays( 1, &batch[ b ].vao );
+            batch[ b ].vao = 0;
+            batch[ b ].createInstances( object );
+        }
     }
+
+    invalidateState();
 }
 
 ///
@@ -544,9 +739,75 @@ void keyboard( GLFWwindow *window, int key, int scan, int action, int mods ) {
             animating = false;
             break;
 
+        case GLFW_KEY_C:    // toggle frustum culling
+            cullObjects = !cullObjects;
+            cout << "frustum culling " << ( cullObjects ? "on" : "off" ) <<
+                 endl;
+            break;
+
+        case GLFW_KEY_G:    // switch how the occlusion queries are used
+            if( bshader == 0 ) {
+                cerr << "Occlusion queries are not supported" << endl;
+                break;
+            }
+
+            if( queryMode != QUERY_OFF ) {
+                occlusionQueries.report( object );
+            }
+            occlusionQueries.reset();
+
+            queryMode = ( queryMode + 1 ) % 3;
+            cout << "occlusion queries " <<
+                 ( queryMode == QUERY_OFF ? "off" :
+                   queryMode == QUERY_CONDITIONAL ? "with conditional render" :
+                   "on the previous frame" ) << endl;
+            break;
+
+        case GLFW_KEY_M:    // toggle the indirect draws
+            drawIndirect = !drawIndirect;
+            cout << "indirect draws " << ( drawIndirect ? "on" : "off" ) <<
+                 endl;
+            reportStates = true;
+            break;
+
+        case GLFW_KEY_O:    // toggle occlusion culling
+            occludeObjects = !occludeObjects;
+            cout << "occlusion culling " <<
+                 ( occludeObjects ? "on" : "off" ) << endl;
+            break;
+
+        case GLFW_KEY_P:    // report the pipeline statistics
+            reportStats = true;
+            reportStates = true;
+            break;
+
+        case GLFW_KEY_V:    // toggle the overdraw pass of the pot and cup
+            reprocessShapes( !overdrawOptimization(), overdrawThreshold() );
+            break;
+
+        case GLFW_KEY_LEFT_BRACKET:     // change the overdraw threshold
+        case GLFW_KEY_RIGHT_BRACKET:
+            reprocessShapes( overdrawOptimization(), overdrawThreshold() +
+                             ( key == GLFW_KEY_LEFT_BRACKET ? -0.05f :
+                                                              0.05f ) );
+            break;
+
         case GLFW_KEY_R:    // reset transformations
             camera[ 0 ].position = vec3( 0.0f, 3.65f, 11.3f );
             angles = 0.0f;
+            if( plateNode >= 0 ) {
+                scene.setTranslation( plateNode, plateHome );
+            }
+            break;
+
+        case GLFW_KEY_LEFT:     // slide the plate, with the cookies on it
+        case GLFW_KEY_RIGHT:
+            if( plateNode >= 0 ) {
+                float step = key == GLFW_KEY_LEFT ? -0.1f : 0.1f;
+                scene.setTranslation( plateNode, scene.getTranslation(
+                                          plateNode ) + vec3( step, 0.0f,
+                                                              0.0f ) );
+            }
             break;
 
         case GLFW_KEY_ESCAPE:   // terminate the program
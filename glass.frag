@@ -1,4 +1,4 @@
-#version 130
+#version 140
 
 // Glass fragment shader
 //
@@ -12,9 +12,6 @@ in vec3 position;
 // Normal vector at vertex (in camera space)
 in vec3 normal;
 
-// Point light position (in camera space)
-in vec3 pLightPos;
-
 // struct of material properties
 struct Material
 {
@@ -36,14 +33,35 @@ struct Material
     float shininess;
 };
 
-// Material properties of the object
-uniform Material material;
+// Material properties of every object in the scene
+layout( std140 ) uniform Materials
+{
+    Material materials[ MAX_MATERIALS ];
+};
+
+// Index of the material of this fragment
+flat in int materialIndex;
+
+#define material materials[ materialIndex ]
 
-// Ambient light color
-uniform vec4 aLightColor;
+// Camera and lights, shared by every object of the frame
+layout( std140 ) uniform Frame
+{
+    // Viewing matrix
+    mat4 viewMat;
+
+    // Projection matrix
+    mat4 projectionMat;
+
+    // Point light position (in camera space)
+    vec4 pLightPosition;
 
-// Point light color
-uniform vec4 pLightColor;
+    // Ambient light color
+    vec4 aLightColor;
+
+    // Point light color
+    vec4 pLightColor;
+};
 
 // OUTGOING DATA
 out vec4 finalColor;
@@ -53,7 +71,7 @@ void main()
     // the normal vector
     vec3 n = normalize( normal );
     // the light direction vector
-    vec3 l = normalize( pLightPos - position );
+    vec3 l = normalize( pLightPosition.xyz - position );
     // the viewing direction vector
     vec3 v = normalize( -position );
     // the reflection vector
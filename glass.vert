@@ -1,4 +1,4 @@
-#version 130
+#version 140
 
 // Glass vertex shader
 //
@@ -12,20 +12,35 @@ in vec4 vPosition;
 // Normal vector at vertex (in model space)
 in vec3 vNormal;
 
-// Model transformations
-uniform mat4 modelMat;
+// Model view and model view projection matrices, the camera multiplied
+// in once per object
+uniform mat4 modelViewMat;
+uniform mat4 mvpMat;
 
-// Viewing matrix
-uniform mat4 viewMat;
+// Normal matrix (in camera space)
+uniform mat3 normalMat;
 
-// Projection matrix
-uniform mat4 projectionMat;
+// Index of the material of the object
+uniform int materialSlot;
 
-// Normal matrix
-uniform mat3 normalMat;
+// Camera and lights, shared by every object of the frame
+layout( std140 ) uniform Frame
+{
+    // Viewing matrix
+    mat4 viewMat;
+
+    // Projection matrix
+    mat4 projectionMat;
 
-// Point light position (in world space)
-uniform vec4 pLightPosition;
+    // Point light position (in camera space)
+    vec4 pLightPosition;
+
+    // Ambient light color
+    vec4 aLightColor;
+
+    // Point light color
+    vec4 pLightColor;
+};
 
 // OUTGOING DATA
 
@@ -35,8 +50,8 @@ out vec3 position;
 // Normal vector at vertex (in camera space)
 out vec3 normal;
 
-// Point light position (in camera space)
-out vec3 pLightPos;
+// Index of the material of this vertex
+flat out int materialIndex;
 
 //
 // Main function
@@ -44,15 +59,13 @@ out vec3 pLightPos;
 
 void main()
 {
-    // convert the vertex location into camera space
-    position = ( viewMat * modelMat * vPosition ).xyz;
-
-    // convert the normal vector into camera space
+    // convert the vertex location and the normal into camera space
+    position = ( modelViewMat * vPosition ).xyz;
     normal = normalMat * vNormal;
 
-    // convert the point light position into camera space
-    pLightPos = ( viewMat * pLightPosition ).xyz;
+    // pass the material of the object
+    materialIndex = materialSlot;
 
     // Transform the vertex location into clip space
-    gl_Position =  projectionMat * viewMat  * modelMat * vPosition;
+    gl_Position = mvpMat * vPosition;
 }
@@ -1,4 +1,4 @@
-#version 130
+#version 140
 
 // Phong vertex shader
 //
@@ -12,20 +12,70 @@ in vec4 vPosition;
 // Normal vector at vertex (in model space)
 in vec3 vNormal;
 
-// Model transformations matrix
-uniform mat4 modelMat;
+// Model view and model view projection matrices, the camera multiplied
+// in once per object
+uniform mat4 modelViewMat;
+uniform mat4 mvpMat;
 
-// Viewing matrix
-uniform mat4 viewMat;
+// Normal matrix (in camera space)
+uniform mat3 normalMat;
 
-// Projection matrix
-uniform mat4 projectionMat;
+// Index of the material of the object
+uniform int materialSlot;
 
-// Normal matrix
-uniform mat3 normalMat;
+// Camera and lights, shared by every object of the frame
+layout( std140 ) uniform Frame
+{
+    // Viewing matrix
+    mat4 viewMat;
+
+    // Projection matrix
+    mat4 projectionMat;
+
+    // Point light position (in camera space)
+    vec4 pLightPosition;
 
-// Point light position (in world space)
-uniform vec4 pLightPosition;
+    // Ambient light color
+    vec4 aLightColor;
+
+    // Point light color
+    vec4 pLightColor;
+};
+
+#ifdef INSTANCED
+// Model transformations of this instance
+in mat4 iModelMat;
+
+// Normal matrix of this instance (in world space)
+in mat3 iNormalMat;
+
+// Index of the material of this instance
+in float iMaterial;
+#endif
+
+#ifdef INDIRECT
+// Transformations and material of one draw of a group
+struct DrawData
+{
+    // Model transformations (in world space)
+    mat4 modelMat;
+
+    // Normal matrix (in world space)
+    mat3 normalMat;
+
+    // Index of the material
+    int material;
+};
+
+// Transformations and materials of every draw of the group
+layout( std430 ) readonly buffer Draws
+{
+    DrawData draws[];
+};
+
+// Index of the draw of this vertex, from the base instance of the draw
+in uint iDrawIndex;
+#endif
 
 // OUTGOING DATA
 
@@ -35,8 +85,8 @@ out vec3 position;
 // Normal vector at vertex (in camera space)
 out vec3 normal;
 
-// Point light position (in camera space)
-out vec3 pLightPos;
+// Index of the material of this vertex
+flat out int materialIndex;
 
 //
 // Main function
@@ -44,15 +94,34 @@ out vec3 pLightPos;
 
 void main()
 {
-    // convert the vertex location into camera space
-    position = ( viewMat * modelMat * vPosition ).xyz;
+#if defined( INSTANCED ) || defined( INDIRECT )
+#ifdef INSTANCED
+    mat4 model = iModelMat;
+    mat3 normalModel = iNormalMat;
+    materialIndex = int( iMaterial );
+#else
+    mat4 model = draws[ iDrawIndex ].modelMat;
+    mat3 normalModel = draws[ iDrawIndex ].normalMat;
+    materialIndex = draws[ iDrawIndex ].material;
+#endif
+
+    // convert the vertex location into camera space, one matrix at a time
+    vec4 eye = viewMat * ( model * vPosition );
+    position = eye.xyz;
+
+    // the view is rigid, so it turns world space normals into camera space
+    normal = mat3( viewMat ) * ( normalModel * vNormal );
 
-    // convert the normal vector into camera space
-    normal = normalMat * vNormal;
+    // Transform the vertex location into clip space
+    gl_Position = projectionMat * eye;
+#else
+    materialIndex = materialSlot;
 
-    // convert the point light position into camera space
-    pLightPos = ( viewMat * pLightPosition ).xyz;
+    // convert the vertex location and the normal into camera space
+    position = ( modelViewMat * vPosition ).xyz;
+    normal = normalMat * vNormal;
 
     // Transform the vertex location into clip space
-    gl_Position =  projectionMat * viewMat  * modelMat * vPosition;
+    gl_Position = mvpMat * vPosition;
+#endif
 }
@@ -1,4 +1,4 @@
-#version 130
+#version 140
 
 // Texture mapping vertex shader
 //
@@ -15,12 +15,14 @@ in vec3 normal;
 // Texture coordinate for this vertex
 in vec2 texCoord;
 
-// Point light position (in camera space)
-in vec3 pLightPos;
-
 // struct of material properties
 struct Material
 {
+    // the material colors, unused under a texture
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+
     // the ambient reflection coefficient
     float ka;
     // the diffuse reflection coefficient
@@ -32,14 +34,35 @@ struct Material
     float shininess;
 };
 
-// Material properties of the object
-uniform Material material;
+// Material properties of every object in the scene
+layout( std140 ) uniform Materials
+{
+    Material materials[ MAX_MATERIALS ];
+};
+
+// Index of the material of this fragment
+flat in int materialIndex;
 
-// Ambient light color
-uniform vec4 aLightColor;
+#define material materials[ materialIndex ]
 
-// Point light color
-uniform vec4 pLightColor;
+// Camera and lights, shared by every object of the frame
+layout( std140 ) uniform Frame
+{
+    // Viewing matrix
+    mat4 viewMat;
+
+    // Projection matrix
+    mat4 projectionMat;
+
+    // Point light position (in camera space)
+    vec4 pLightPosition;
+
+    // Ambient light color
+    vec4 aLightColor;
+
+    // Point light color
+    vec4 pLightColor;
+};
 
 // Texture of front face
 uniform sampler2D tex;
@@ -60,7 +83,7 @@ void main()
     // the normal vector
     vec3 n = normalize( normal );
     // the light direction vector
-    vec3 l = normalize( pLightPos - position );
+    vec3 l = normalize( pLightPosition.xyz - position );
     // the viewing direction vector
     vec3 v = normalize( -position );
     // the reflection vector
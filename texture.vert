@@ -1,4 +1,4 @@
-#version 130
+#version 140
 
 // Texture mapping vertex shader
 //
@@ -15,20 +15,46 @@ in vec3 vNormal;
 // Texture coordinate for this vertex
 in vec2 vTexCoord;
 
-// Model transformations
-uniform mat4 modelMat;
+// Model view and model view projection matrices, the camera multiplied
+// in once per object
+uniform mat4 modelViewMat;
+uniform mat4 mvpMat;
 
-// Viewing matrix
-uniform mat4 viewMat;
+// Normal matrix (in camera space)
+uniform mat3 normalMat;
 
-// Projection matrix
-uniform mat4 projectionMat;
+// Index of the material of the object
+uniform int materialSlot;
 
-// Normal matrix
-uniform mat3 normalMat;
+// Camera and lights, shared by every object of the frame
+layout( std140 ) uniform Frame
+{
+    // Viewing matrix
+    mat4 viewMat;
+
+    // Projection matrix
+    mat4 projectionMat;
+
+    // Point light position (in camera space)
+    vec4 pLightPosition;
+
+    // Ambient light color
+    vec4 aLightColor;
+
+    // Point light color
+    vec4 pLightColor;
+};
+
+#ifdef INSTANCED
+// Model transformations of this instance
+in mat4 iModelMat;
+
+// Normal matrix of this instance (in world space)
+in mat3 iNormalMat;
 
-// Point light position (in world space)
-uniform vec4 pLightPosition;
+// Index of the material of this instance
+in float iMaterial;
+#endif
 
 // OUTGOING DATA
 
@@ -41,8 +67,8 @@ out vec3 normal;
 // Texture coordinate for this vertex
 out vec2 texCoord;
 
-// Point light position (in camera space)
-out vec3 pLightPos;
+// Index of the material of this vertex
+flat out int materialIndex;
 
 //
 // Main function
@@ -50,18 +76,29 @@ out vec3 pLightPos;
 
 void main()
 {
-    // convert the vertex location into camera space
-    position = ( viewMat * modelMat * vPosition ).xyz;
+#ifdef INSTANCED
+    materialIndex = int( iMaterial );
 
-    // convert the normal vector into camera space
-    normal = normalMat * vNormal;
+    // convert the vertex location into camera space, one matrix at a time
+    vec4 eye = viewMat * ( iModelMat * vPosition );
+    position = eye.xyz;
 
-    // simply pass the texture coordinate
-    texCoord = vTexCoord;
+    // the view is rigid, so it turns world space normals into camera space
+    normal = mat3( viewMat ) * ( iNormalMat * vNormal );
 
-    // convert the point light position into camera space
-    pLightPos = ( viewMat * pLightPosition ).xyz;
+    // Transform the vertex location into clip space
+    gl_Position = projectionMat * eye;
+#else
+    materialIndex = materialSlot;
+
+    // convert the vertex location and the normal into camera space
+    position = ( modelViewMat * vPosition ).xyz;
+    normal = normalMat * vNormal;
 
     // Transform the vertex location into clip space
-    gl_Position =  projectionMat * viewMat  * modelMat * vPosition;
+    gl_Position = mvpMat * vPosition;
+#endif
+
+    // simply pass the texture coordinate
+    texCoord = vTexCoord;
 }